@@ -0,0 +1,178 @@
+#######################################################################
+# DCC COMMAND STATION FOR ESP32
+#
+# COPYRIGHT (c) 2019 Mike Dunston
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see http://www.gnu.org/licenses
+#######################################################################
+
+# Verifies that everything used by the DCC signal ISRs has been placed in
+# IRAM/DRAM, if any of these end up in flash the signal will crash as soon
+# as the flash cache is disabled (ie: during SPIFFS writes).
+#
+# The ISR entry points are found by scanning the sources for the interrupt
+# registration calls, from there the call graph is followed through the
+# disassembly of the firmware: every function called and every literal
+# (function or data address) loaded by an ISR reachable function is checked,
+# functions defined by the project are followed recursively. Calls made via
+# a pointer loaded at runtime (virtual methods, callbacks) can not be followed.
+
+Import("env")
+import glob
+import os
+import re
+import struct
+import subprocess
+
+# interrupt registration calls and the index of the handler argument.
+ISR_REGISTRATIONS = {
+    'timerAttachInterrupt': 1,
+    'rmt_isr_register': 0,
+}
+
+# address ranges of flash mapped instructions and data.
+FLASH_RANGES = [
+    (0x400C2000, 0x40C00000),
+    (0x3F400000, 0x3F800000),
+]
+
+CALL_RE = re.compile(r'\s(?:call0|call4|call8|call12|j)\s+([0-9a-f]+)\b')
+L32R_RE = re.compile(r'\sl32r\s+a\d+,\s*([0-9a-f]+)\b')
+FUNCTION_RE = re.compile(r'^([0-9a-f]+) <(.+)>:$')
+
+def in_flash(address):
+    for start, end in FLASH_RANGES:
+        if address >= start and address < end:
+            return True
+    return False
+
+def find_isr_handlers(src_dir):
+    handlers = set()
+    for path in glob.glob(os.path.join(src_dir, '*.cpp')):
+        with open(path) as f:
+            source = f.read()
+        for call, index in ISR_REGISTRATIONS.items():
+            for match in re.finditer(r'\b%s\s*\(([^;]*)\);' % call, source):
+                args = [arg.strip() for arg in match.group(1).split(',')]
+                if len(args) > index:
+                    handlers.add(args[index].lstrip('&'))
+    return handlers
+
+def read_symbols(nm, path):
+    # returns {address: name} for the defined function and object symbols.
+    output = subprocess.check_output([nm, '--defined-only', path])
+    if not isinstance(output, str):
+        output = output.decode('utf-8')
+    symbols = {}
+    for line in output.splitlines():
+        parts = line.split(' ', 2)
+        if len(parts) == 3 and parts[1] in 'TtWwDdBbRrV':
+            symbols[int(parts[0], 16)] = parts[2].strip()
+    return symbols
+
+class ElfImage(object):
+    # minimal 32 bit little endian ELF reader used to resolve l32r literals.
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2E)
+        self.sections = []
+        for index in range(shnum):
+            base = shoff + index * shentsize
+            sh_type, flags, addr, offset, size = struct.unpack_from('<IIIII', self.data, base + 4)
+            # SHT_NOBITS sections (.bss) have no file data
+            if addr and sh_type != 8:
+                self.sections.append((addr, offset, size))
+
+    def word(self, address):
+        for addr, offset, size in self.sections:
+            if address >= addr and address + 4 <= addr + size:
+                return struct.unpack_from('<I', self.data, offset + address - addr)[0]
+        return None
+
+def disassemble(objdump, path):
+    # returns {function address: [instruction lines]}
+    output = subprocess.check_output([objdump, '-d', path])
+    if not isinstance(output, str):
+        output = output.decode('utf-8')
+    functions = {}
+    current = None
+    for line in output.splitlines():
+        match = FUNCTION_RE.match(line)
+        if match:
+            current = functions.setdefault(int(match.group(1), 16), [])
+        elif current is not None and line.strip():
+            current.append(line)
+    return functions
+
+def check_isr_placement(source, target, env):
+    elf_path = target[0].get_abspath()
+    nm = env.subst('$CC').replace('gcc', 'nm')
+    objdump = env.subst('$CC').replace('gcc', 'objdump')
+    cppfilt = env.subst('$CC').replace('gcc', 'c++filt')
+    symbols = read_symbols(nm, elf_path)
+    addresses = dict((name, address) for address, name in symbols.items())
+    project_symbols = set()
+    for obj in glob.glob(os.path.join(env.subst('$BUILD_DIR'), 'src', '*.o')):
+        project_symbols.update(read_symbols(nm, obj).values())
+    functions = disassemble(objdump, elf_path)
+    image = ElfImage(elf_path)
+
+    def demangle(name):
+        output = subprocess.check_output([cppfilt, name])
+        if not isinstance(output, str):
+            output = output.decode('utf-8')
+        return output.strip()
+
+    def describe(address):
+        if address in symbols:
+            return '%s (0x%08X)' % (demangle(symbols[address]), address)
+        return '0x%08X' % address
+
+    pending = []
+    for handler in find_isr_handlers(os.path.join(env.subst('$PROJECT_DIR'), 'src')):
+        # the handlers are plain functions, match them by their mangled prefix
+        for name, address in addresses.items():
+            if name == handler or name.startswith('_Z%d%s' % (len(handler), handler)):
+                pending.append(address)
+    visited = set()
+    failed = False
+    while pending:
+        function = pending.pop()
+        if function in visited:
+            continue
+        visited.add(function)
+        if in_flash(function):
+            print('ERROR: %s is used by a DCC signal ISR but is in flash' % describe(function))
+            failed = True
+            continue
+        for line in functions.get(function, []):
+            references = [int(match, 16) for match in CALL_RE.findall(line)]
+            for match in L32R_RE.findall(line):
+                literal = image.word(int(match, 16))
+                if literal is not None:
+                    references.append(literal)
+            for address in references:
+                if in_flash(address):
+                    print('ERROR: %s references %s which is in flash' % (describe(function), describe(address)))
+                    failed = True
+                elif address in symbols and symbols[address] in project_symbols and address in functions:
+                    pending.append(address)
+    if not visited:
+        print('ERROR: no DCC signal ISR handlers were found in the firmware')
+        failed = True
+    if failed:
+        env.Exit(1)
+    print('DCC signal ISR call graph (%d functions) verified to be in IRAM/DRAM' % len(visited))
+
+env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', check_isr_placement)
@@ -0,0 +1,197 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// default allocator for the index table, same interface as the ring buffer
+// allocators (see RingBuffer.h).
+struct AddressIndexHeapAllocator {
+  static void *allocate(size_t count, size_t size) {
+    return calloc(count, size);
+  }
+  static void release(void *ptr) {
+    free(ptr);
+  }
+};
+
+// Compact open addressing (linear probing) map from a DCC address (or
+// locomotive register) to an object pointer.
+//
+// Keys are limited to 0-0xFFFE (long DCC addresses only go up to 10239), the
+// value 0xFFFF marks an empty slot. The table starts small and doubles when it
+// becomes half full so lookups for a typical layout (a few hundred active
+// addresses at most) touch one or two slots. Removal uses backward shift
+// deletion so no tombstones build up as locomotives come and go.
+//
+// When the table can not be grown (out of memory) it keeps working at its
+// current size until all but one slot is used, put() then returns false. A
+// table whose initial allocation failed behaves as an empty table and retries
+// the allocation on the next put().
+//
+// This does not perform any locking, callers are expected to serialize access
+// in the same way as the lists the index is built from.
+template<typename T, typename Allocator = AddressIndexHeapAllocator>
+class AddressIndex {
+public:
+  AddressIndex(uint16_t capacity=32) {
+    allocate(roundUpToPowerOfTwo(capacity));
+  }
+  ~AddressIndex() {
+    Allocator::release(_slots);
+  }
+  // the table is owned by the index, a copy would release it twice.
+  AddressIndex(const AddressIndex &) = delete;
+  AddressIndex &operator=(const AddressIndex &) = delete;
+  uint16_t size() const {
+    return _count;
+  }
+  T *get(uint16_t key) const {
+    if(_slots == nullptr) {
+      return nullptr;
+    }
+    for(uint16_t index = slotFor(key); _slots[index].key != EMPTY_KEY; index = (index + 1) & _mask) {
+      if(_slots[index].key == key) {
+        return _slots[index].value;
+      }
+    }
+    return nullptr;
+  }
+  bool contains(uint16_t key) const {
+    return get(key) != nullptr;
+  }
+  // adds or replaces the entry for key, returns false when a new entry could
+  // not be added as the table is full and could not be grown.
+  bool put(uint16_t key, T *value) {
+    const uint32_t count = _count;
+    if((count + 1) * 2 > tableSize() && !resize(roundUpToPowerOfTwo(tableSize() * 2)) &&
+       count + 1 >= tableSize() && !contains(key)) {
+      // at least one slot must stay empty so lookups stop on it
+      return false;
+    }
+    uint16_t index = slotFor(key);
+    while(_slots[index].key != EMPTY_KEY && _slots[index].key != key) {
+      index = (index + 1) & _mask;
+    }
+    if(_slots[index].key == EMPTY_KEY) {
+      _count++;
+    }
+    _slots[index].key = key;
+    _slots[index].value = value;
+    return true;
+  }
+  // removes the entry for key, returns false if there was no entry.
+  bool remove(uint16_t key) {
+    if(_slots == nullptr) {
+      return false;
+    }
+    uint16_t index = slotFor(key);
+    while(_slots[index].key != key) {
+      if(_slots[index].key == EMPTY_KEY) {
+        return false;
+      }
+      index = (index + 1) & _mask;
+    }
+    // shift any following entries of the same probe run back into the hole so
+    // lookups never stop early on an empty slot.
+    uint16_t hole = index;
+    for(index = (index + 1) & _mask; _slots[index].key != EMPTY_KEY; index = (index + 1) & _mask) {
+      const uint16_t home = slotFor(_slots[index].key);
+      if(((index - home) & _mask) >= ((index - hole) & _mask)) {
+        _slots[hole] = _slots[index];
+        hole = index;
+      }
+    }
+    _slots[hole].key = EMPTY_KEY;
+    _slots[hole].value = nullptr;
+    _count--;
+    return true;
+  }
+  // removes the entry for key only when it currently maps to value.
+  bool remove(uint16_t key, T *value) {
+    if(get(key) == value) {
+      return remove(key);
+    }
+    return false;
+  }
+  void clear() {
+    for(uint32_t index = 0; index < tableSize(); index++) {
+      _slots[index].key = EMPTY_KEY;
+      _slots[index].value = nullptr;
+    }
+    _count = 0;
+  }
+private:
+  static constexpr uint16_t EMPTY_KEY = 0xFFFF;
+  static constexpr uint32_t MAX_TABLE_SIZE = 32768;
+  struct Slot {
+    uint16_t key;
+    T *value;
+  };
+  static uint32_t roundUpToPowerOfTwo(uint32_t value) {
+    uint32_t result = 8;
+    while(result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+  // fibonacci hashing spreads sequential addresses across the table.
+  uint16_t slotFor(uint16_t key) const {
+    return (uint32_t)(key * 2654435769UL) >> _shift;
+  }
+  uint32_t tableSize() const {
+    return _slots == nullptr ? 0 : _mask + 1;
+  }
+  // replaces the table with an empty one of the given size, the current table
+  // is left untouched when the allocation fails.
+  bool allocate(uint32_t capacity) {
+    if(capacity > MAX_TABLE_SIZE) {
+      return false;
+    }
+    Slot *slots = static_cast<Slot *>(Allocator::allocate(capacity, sizeof(Slot)));
+    if(slots == nullptr) {
+      return false;
+    }
+    _slots = slots;
+    _mask = capacity - 1;
+    _shift = 32;
+    for(uint32_t size = capacity; size > 1; size >>= 1) {
+      _shift--;
+    }
+    clear();
+    return true;
+  }
+  bool resize(uint32_t capacity) {
+    Slot *oldSlots = _slots;
+    const uint32_t oldCapacity = tableSize();
+    if(!allocate(capacity)) {
+      return false;
+    }
+    for(uint32_t index = 0; index < oldCapacity; index++) {
+      if(oldSlots[index].key != EMPTY_KEY) {
+        put(oldSlots[index].key, oldSlots[index].value);
+      }
+    }
+    Allocator::release(oldSlots);
+    return true;
+  }
+  Slot *_slots{nullptr};
+  uint16_t _mask{0};
+  uint8_t _shift{32};
+  uint16_t _count{0};
+};
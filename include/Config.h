@@ -75,6 +75,13 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 // uncomment the line below if you wish to have a hardware CAN interface used as well.
 //#include "Config_LCC.h"
 
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// The RailCom interface is an optional module which generates the RailCom cutout
+// on the OPS track and decodes the feedback sent by locomotive decoders. Uncomment
+// the line below and edit the Config_RailCom.h file to match your configuration.
+//#include "Config_RailCom.h"
+
 /////////////////////////////////////////////////////////////////////////////////////
 //
 // The following pins are considered reserved pins by Espressif and should not
@@ -91,3 +98,27 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 //#define ALLOW_USAGE_OF_RESTRICTED_GPIO_PINS
 
 /////////////////////////////////////////////////////////////////////////////////////
+//
+// The following defines control how often (in milliseconds) the packets for
+// each active locomotive are refreshed on the OPS track. Changes to speed or
+// functions are always sent immediately, refresh packets are only sent when the
+// OPS track has nothing else to send and a packet has not been refreshed
+// within these intervals, otherwise idle packets are sent. Stopped locomotives
+// are refreshed at the slower of their normal rate and
+// LOCOMOTIVE_STOPPED_REFRESH_INTERVAL. Uncomment and adjust as
+// needed.
+//#define LOCOMOTIVE_SPEED_REFRESH_INTERVAL 50
+//#define LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL 250
+//#define LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL 2000
+//#define LOCOMOTIVE_STOPPED_REFRESH_INTERVAL 500
+
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// The following defines control the maximum number of locomotives (including
+// locomotives that are part of a consist), consists and roster entries. The
+// storage for these is reserved at startup. Uncomment and adjust as needed.
+//#define MAX_LOCOMOTIVES 64
+//#define MAX_LOCOMOTIVE_CONSISTS 16
+//#define MAX_ROSTER_ENTRIES 64
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -55,6 +55,15 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 // PROG TRACK MOTORBOARD MOTOR_BOARD_TYPE
 #define MOTORBOARD_TYPE_PROG ARDUINO_SHIELD
 
+// ADDITIONAL OPS TRACK DISTRICTS (BOOSTERS)
+// Each district receives the same DCC signal as the OPS track on its own signal pin
+// and has its own enable pin, current sense and overcurrent handling so a short in
+// one district does not shut down the others. The signal pin may be the same as
+// DCC_SIGNAL_PIN_OPERATIONS when the boosters share the signal wiring. Each entry
+// is {NAME, CURRENT SENSE ADC PIN, ENABLE PIN, SIGNAL PIN, MOTOR_BOARD_TYPE} and
+// entries are separated by a comma.
+//#define MOTORBOARD_OPS_DISTRICTS {"OPS2", ADC1_CHANNEL_4, 26, 27, ARDUINO_SHIELD}, {"OPS3", ADC1_CHANNEL_5, 14, 13, ARDUINO_SHIELD}
+
 /////////////////////////////////////////////////////////////////////////////////////
 //
 // DEFINE WHICH PINS ARE USED FOR DCC SIGNAL GENERATION
@@ -65,6 +74,12 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 // PROGRAMMING TRACK DCC SIGNAL PIN
 #define DCC_SIGNAL_PIN_PROGRAMMING 18
 
+// By default the DCC signal is generated by the ESP32 hardware timers which
+// requires two interrupts for every DCC bit. Uncomment the next line to have
+// the DCC signal generated by the RMT peripheral instead which only requires
+// one interrupt for every 64 DCC bits.
+//#define DCC_SIGNAL_GENERATOR_RMT true
+
 /////////////////////////////////////////////////////////////////////////////////////
 //
 // DEFINE THE CURRENT SENSE ATTENUATION. THIS IS USED BY THE ADC SYSTEM TO SCALE
@@ -0,0 +1,35 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// RailCom support requires a motor board which can short the track outputs
+// during the cutout (ie: the BRAKE input of the LMD18200) and a RailCom
+// detector connected to the RX pin of a UART. RailCom is only supported on the
+// OPS track and only with the hardware timer signal generator.
+
+// pin connected to the BRAKE input of the OPS motor board, this will be HIGH
+// for the duration of the cutout.
+#define RAILCOM_BRAKE_PIN 22
+
+// UART (1 or 2) and pin connected to the RailCom detector.
+#define RAILCOM_UART 2
+#define RAILCOM_UART_RX_PIN 16
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+#define RAILCOM_ENABLED true
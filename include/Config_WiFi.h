@@ -51,6 +51,16 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 //
 #define DCCPP_JMRI_CLIENT_PORT 2560
 
+// Each JMRI client has its own output buffer, a client which falls further
+// behind than this is disconnected instead of delaying all other clients.
+//#define DCCPP_CLIENT_OUTPUT_BUFFER_SIZE 4096
+
+// Clients which send commands at high rates can use the compact binary
+// protocol (see DCCppBinaryProtocol.h) on a second port, this is advertised
+// via mDNS as dccpp-bin.tcp.
+//#define DCCPP_BINARY_PROTOCOL_ENABLED true
+//#define DCCPP_BINARY_CLIENT_PORT 2561
+
 /////////////////////////////////////////////////////////////////////////////////////
 //
 // DEFINE HOSTNAME TO USE FOR WiFi CONNECTIONS AND mDNS BROADCASTS
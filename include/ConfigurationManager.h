@@ -51,6 +51,9 @@ extern String JSON_TYPE_NODE;
 extern String JSON_IDLE_NODE;
 extern String JSON_IDLE_ON_STARTUP_NODE;
 extern String JSON_DEFAULT_ON_THROTTLE_NODE;
+extern String JSON_ACCELERATION_NODE;
+extern String JSON_BRAKING_NODE;
+extern String JSON_TARGET_SPEED_NODE;
 extern String JSON_FUNCTIONS_NODE;
 extern String JSON_LOCOS_NODE;
 extern String JSON_LOCO_NODE;
@@ -0,0 +1,143 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_BYTES_IN_PACKET 10
+
+// standard DCC packet (S-9.2)
+// byte #
+// 0         1         2         3
+// 1111 1111 1111 1111 1111 110X XXXX XXXX
+// 0xFF      0xFF      0xFC
+// 22 BIT PREAMBLE            ^ marker for END of preamble, must be zero
+//   minimum is 14 bits        ^ bit 7 of first byte of payload
+//                                       ^ bit 7 of second byte of payload
+// 4         5         6         7
+// XXXX XXXX XXXX XXXX XXXX XXXX XXXX XXXX
+//         ^ bit 7 of third byte
+//                   ^ bit 7 of fourth byte
+//                             ^ bit 7 of fifth byte
+//                                       ^ bit 7 of sixth byte
+// 8         9
+// XXXX XXXX XXXX XXXX
+//        ^ bit 1 of sixth byte (last bit of packet)
+struct Packet {
+  uint8_t buffer[MAX_BYTES_IN_PACKET];
+  uint8_t numberOfBits;
+  uint8_t numberOfRepeats;
+  uint8_t currentBit;
+  // time (in microseconds) when the packet was queued.
+  uint32_t queuedAt;
+  // decoder address and instruction type of the packet, a newer packet with
+  // the same key replaces this one while it is still queued. Zero indicates
+  // the packet can not be replaced.
+  uint32_t supersedeKey;
+  // task (TaskHandle_t) to notify when the final repeat of the packet has
+  // been sent, kept as void * so this header does not depend on FreeRTOS.
+  void *completionTask;
+};
+
+// number of one bits sent before the packet start bit.
+static constexpr uint8_t DCC_PREAMBLE_BITS = 22;
+
+// maximum number of payload bytes (excluding the checksum) that fit into
+// Packet::buffer, each byte (including the checksum) takes nine bits.
+static constexpr uint8_t MAX_DCC_PAYLOAD_BYTES = ((MAX_BYTES_IN_PACKET * 8 - DCC_PREAMBLE_BITS) / 9) - 1;
+
+// The functions below are used by encodeDCCPacket() to build a Packet at
+// compile time, they are written as single expressions so they remain valid
+// C++11 constexpr functions.
+
+// XOR of all payload bytes.
+constexpr uint8_t dccPacketChecksum(const uint8_t *data, uint8_t length) {
+  return length == 0 ? 0 : data[length - 1] ^ dccPacketChecksum(data, length - 1);
+}
+
+// number of bits in the encoded packet, the preamble followed by a zero bit
+// and eight data bits for each payload byte and the checksum.
+constexpr uint8_t dccPacketBits(uint8_t length) {
+  return DCC_PREAMBLE_BITS + (length + 1) * 9;
+}
+
+// payload byte (or the checksum for the byte following the payload).
+constexpr uint8_t dccPayloadByte(const uint8_t *data, uint8_t length, uint8_t index) {
+  return index < length ? data[index] : dccPacketChecksum(data, length);
+}
+
+// value of a single bit of the encoded packet.
+constexpr uint8_t dccEncodedBit(const uint8_t *data, uint8_t length, uint16_t bit) {
+  return bit < DCC_PREAMBLE_BITS ? 1 :
+    bit >= dccPacketBits(length) ? 0 :
+    (bit - DCC_PREAMBLE_BITS) % 9 == 0 ? 0 :
+    (dccPayloadByte(data, length, (bit - DCC_PREAMBLE_BITS) / 9) >> (8 - ((bit - DCC_PREAMBLE_BITS) % 9))) & 1;
+}
+
+// value of a single byte of the encoded packet.
+constexpr uint8_t dccEncodedByte(const uint8_t *data, uint8_t length, uint8_t index, uint8_t bit = 0) {
+  return bit == 8 ? 0 :
+    (dccEncodedBit(data, length, index * 8 + bit) << (7 - bit)) | dccEncodedByte(data, length, index, bit + 1);
+}
+
+template<uint8_t... I> struct DCCPacketIndices {};
+template<uint8_t N, uint8_t... I> struct MakeDCCPacketIndices : MakeDCCPacketIndices<N - 1, N - 1, I...> {};
+template<uint8_t... I> struct MakeDCCPacketIndices<0, I...> {
+  typedef DCCPacketIndices<I...> type;
+};
+
+template<uint8_t... I>
+constexpr Packet encodeDCCPacket(const uint8_t *data, uint8_t length, uint8_t repeats, DCCPacketIndices<I...>) {
+  return Packet {
+    { dccEncodedByte(data, length, I)... }, // packet bytes
+    dccPacketBits(length), // number of bits
+    repeats, // number of repeats
+    0, // current bit
+    0, // queued at
+    0, // supersede key
+    nullptr // completion task
+  };
+}
+
+// compile time encoder for a constant packet payload, the checksum is added
+// automatically.
+template<uint8_t N>
+constexpr Packet encodeDCCPacket(const uint8_t (&data)[N], uint8_t repeats = 0) {
+  static_assert(N > 0 && N <= MAX_DCC_PAYLOAD_BYTES, "Invalid DCC packet payload length");
+  return encodeDCCPacket(data, N, repeats, typename MakeDCCPacketIndices<MAX_BYTES_IN_PACKET>::type());
+}
+
+// run time encoder for a packet payload of up to MAX_DCC_PAYLOAD_BYTES, the
+// checksum is added automatically. Returns false if the payload is too long.
+bool encodeDCCPacket(Packet &, const uint8_t *, uint8_t, uint8_t repeats = 0);
+
+// returns a key identifying the decoder an encoded packet is addressed to,
+// all packets for the same decoder have the same key. Zero is returned for
+// broadcast and idle packets.
+uint16_t getDCCPacketAddressKey(const Packet &);
+
+// S-9.2 baseline packet (idle)
+static constexpr uint8_t idlePacket[] = {0xFF, 0x00};
+// S-9.2 baseline packet (decoder reset)
+static constexpr uint8_t resetPacket[] = {0x00, 0x00};
+// S-9.2 baseline packet (eStop, direction bit ignored)
+static constexpr uint8_t eStopPacket[] = {0x00, 0x41};
+
+// pre-encoded versions of the above packets
+static constexpr Packet encodedIdlePacket = encodeDCCPacket(idlePacket);
+static constexpr Packet encodedResetPacket = encodeDCCPacket(resetPacket);
+static constexpr Packet encodedEStopPacket = encodeDCCPacket(eStopPacket);
@@ -17,6 +17,7 @@ COPYRIGHT (c) 2019 Mike Dunston
 #pragma once
 
 #include <stdint.h>
+#include <functional>
 
 enum CV_NAMES {
   SHORT_ADDRESS=1,
@@ -65,6 +66,45 @@ enum CONSIST_FUNCTION_CONTROL_FL_F9_F12_BITS {
 };
 
 
+// maximum number of programming track jobs which can be waiting for the
+// programming track worker task.
+static constexpr uint8_t PROG_TRACK_JOB_QUEUE_SIZE = 16;
+
+// stack size for the programming track worker task, jobs may build JSON
+// responses so this is larger than DEFAULT_THREAD_STACKSIZE.
+static constexpr uint16_t PROG_TRACK_TASK_STACK_SIZE = 4096;
+
+// work to be done on the programming track, this is called from the
+// programming track worker task with the parameter indicating if the
+// programming track was successfully energized. The job is responsible for
+// sending its own response, responses sent via wifiInterface.send/printf are
+// routed to the client which queued the job.
+using ProgTrackJob = std::function<void(bool)>;
+
+// All access to the programming track is serialized via a single job queue
+// which is processed by a dedicated worker task, this keeps the (multi second)
+// CV reads and writes from blocking the calling context (TCP clients, web
+// server, LocoNet). Concurrent requests are queued and run in order.
+class ProgTrackManager {
+public:
+  static void init();
+  // queues the job for the worker task, returns false if the job queue is
+  // full in which case the job will not be called. When provided accepted is
+  // called once room for the job has been reserved but before the worker task
+  // can start it, so an acknowledgement sent from it always precedes any
+  // response sent by the job.
+  static bool queue(ProgTrackJob, std::function<void()> accepted=nullptr);
+private:
+  static void progTrackTask(void *);
+  static QueueHandle_t _jobQueue;
+  // free entries in _jobQueue, taken by queue() before the job is sent and
+  // given back by the worker task when it receives a job.
+  static SemaphoreHandle_t _freeSlots;
+  static TaskHandle_t _taskHandle;
+};
+
+// set while the programming track worker task has the programming track
+// energized.
 extern bool progTrackBusy;
 
 bool enterProgrammingMode();
@@ -17,90 +17,223 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #pragma once
 
 #include <Arduino.h>
-#include <queue>
 #include <stdint.h>
+#include <vector>
+#include "RingBuffer.h"
+#include "InternalRAMAllocator.h"
+#include "DCCPacket.h"
 
-#define MAX_BYTES_IN_PACKET 10
-
-// standard DCC packet (S-9.2)
-// byte #
-// 0         1         2         3
-// 1111 1111 1111 1111 1111 110X XXXX XXXX
-// 0xFF      0xFF      0xFC
-// 22 BIT PREAMBLE            ^ marker for END of preamble, must be zero
-//   minimum is 14 bits        ^ bit 7 of first byte of payload
-//                                       ^ bit 7 of second byte of payload
-// 4         5         6         7
-// XXXX XXXX XXXX XXXX XXXX XXXX XXXX XXXX
-//         ^ bit 7 of third byte
-//                   ^ bit 7 of fourth byte
-//                             ^ bit 7 of fifth byte
-//                                       ^ bit 7 of sixth byte
-// 8         9
-// XXXX XXXX XXXX XXXX
-//        ^ bit 1 of sixth byte (last bit of packet)
-struct Packet {
-  uint8_t buffer[MAX_BYTES_IN_PACKET];
-  uint8_t numberOfBits;
-  uint8_t numberOfRepeats;
-  uint8_t currentBit;
+// packet priority classes, each class has its own bounded queue. Emergency
+// and interactive packets are always sent before any accessory or refresh
+// packets, accessory and refresh packets share the remaining bandwidth using
+// a weighted round robin.
+enum DCC_PACKET_PRIORITY {
+  DCC_PACKET_PRIORITY_EMERGENCY,
+  DCC_PACKET_PRIORITY_INTERACTIVE,
+  DCC_PACKET_PRIORITY_ACCESSORY,
+  DCC_PACKET_PRIORITY_REFRESH,
+  MAX_DCC_PACKET_PRIORITY
+};
+
+// snapshot of the state of a single packet priority queue.
+struct PacketQueueStatus {
+  uint16_t depth;
+  uint16_t capacity;
+  uint16_t maxDepth;
+  uint32_t maxWait;
+  uint32_t sent;
+  uint32_t replaced;
+};
+
+// number of packets handed to the ISR ahead of time, this is kept short so a
+// newly queued high priority packet does not wait behind a long backlog.
+static constexpr uint8_t DCC_WIRE_QUEUE_DEPTH = 4;
+// when the ISR has this many (or fewer) packets left the feeder task will be
+// woken up to move more packets from the priority queues.
+static constexpr uint8_t DCC_WIRE_QUEUE_LOW_WATER = 2;
+// number of consecutive packets the accessory and refresh classes may send
+// before yielding to the other class.
+static constexpr uint8_t DCC_ACCESSORY_PACKET_WEIGHT = 2;
+static constexpr uint8_t DCC_REFRESH_PACKET_WEIGHT = 1;
+
+// when no packets are queued a refresh packet is pulled from the refresh
+// source (if any) while the wire queue holds fewer than this many packets
+// (including the packet being sent). This keeps the wire busy without
+// delaying newly queued packets behind a backlog of refresh packets.
+static constexpr uint8_t DCC_REFRESH_PULL_DEPTH = 2;
+
+// maximum time to wait for a packet to be sent by loadPacketAndWait.
+static constexpr uint32_t DCC_PACKET_COMPLETION_TIMEOUT_MS = 2000;
+
+// upper limit (in microseconds) for each bucket of the enqueue to first bit
+// latency histogram.
+static constexpr uint8_t DCC_LATENCY_HISTOGRAM_BUCKETS = 10;
+static constexpr DRAM_ATTR uint32_t DCC_LATENCY_HISTOGRAM_LIMITS[DCC_LATENCY_HISTOGRAM_BUCKETS] = {
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, UINT32_MAX
+};
+
+// signal generator counters, most of these are updated by the ISR and are
+// read without locking so a snapshot may be slightly inconsistent.
+struct SignalGeneratorTelemetry {
+  // number of packets sent (including repeats and idle packets)
+  uint32_t packets;
+  // number of idle packets sent due to no packets being queued
+  uint32_t idlePackets;
+  // number of bits sent (including idle packets)
+  uint64_t bits;
+  // number of bits sent as part of idle packets
+  uint64_t idleBits;
+  // highest number of packets waiting in the priority queues
+  uint16_t queuedHighWater;
+  // number of times loadPacket had to wait for room in a queue
+  uint32_t queueFull;
+  // time (in microseconds) from the last emergency stop request to the first
+  // bit of the eStop packet
+  uint32_t eStopLatency;
+  // enqueue to first bit latency, see DCC_LATENCY_HISTOGRAM_LIMITS
+  uint32_t latency[DCC_LATENCY_HISTOGRAM_BUCKETS];
+  // number of signal generator ISR calls and the CPU cycles spent in them
+  uint32_t isrCalls;
+  uint64_t isrCycles;
+  uint32_t isrMaxCycles;
+};
+
+// packet handed to the ISR, the duration (in microseconds) of each half of
+// every bit is rendered by the feeder task when the packet is moved to the
+// wire queue so the timer ISR only needs a single lookup per bit.
+struct WirePacket : Packet {
+  uint8_t halfBitDurations[MAX_BYTES_IN_PACKET * 8];
+};
+
+// source of refresh packets for a signal generator, the signal generator pulls
+// the next packet from the source when it has nothing else to send. This is
+// called from the signal generator feeder task with the signal generator lock
+// held so it must not block or queue packets itself.
+class DCCPacketSource {
+public:
+  // fills the packet and returns true when there is a packet to send.
+  virtual bool getRefreshPacket(Packet &) = 0;
 };
 
 class SignalGenerator {
 public:
   void startSignal(bool=true);
   void stopSignal();
-  void loadBytePacket(const uint8_t *, uint8_t, uint8_t, bool=false);
-  void loadPacket(std::vector<uint8_t>, int, bool=false);
+  void loadBytePacket(const uint8_t *, uint8_t, uint8_t, bool=false, DCC_PACKET_PRIORITY=DCC_PACKET_PRIORITY_INTERACTIVE);
+  void loadPacket(const Packet &, uint8_t, bool=false, DCC_PACKET_PRIORITY=DCC_PACKET_PRIORITY_INTERACTIVE);
+  // queues multiple packets as a single batch, each packet uses its own
+  // numberOfRepeats.
+  void loadPacketBatch(const Packet *, uint8_t, DCC_PACKET_PRIORITY=DCC_PACKET_PRIORITY_INTERACTIVE);
+  bool loadBytePacketAndWait(const uint8_t *, uint8_t, uint8_t);
+  bool loadPacketAndWait(const Packet &, uint8_t);
   void waitForQueueEmpty();
   bool isQueueEmpty();
   bool isEnabled();
   void drainQueue();
-  virtual Packet *getPacket();
+  void startEmergencyStop();
+  void clearEmergencyStop();
+  bool isEmergencyStopActive() {
+    return _emergencyStop;
+  }
+  PacketQueueStatus getQueueStatus(DCC_PACKET_PRIORITY);
+  SignalGeneratorTelemetry getTelemetry() {
+    return _telemetry;
+  }
+  void toJson(JsonObject &);
+  void setRefreshSource(DCCPacketSource *source) {
+    _refreshSource = source;
+  }
+  static uint32_t getSupersedeKey(const uint8_t *, uint8_t);
+  const String &getName() {
+    return _name;
+  }
+  // adds an additional output pin which will receive the same signal as the
+  // primary signal pin, this allows multiple boosters (districts) to share a
+  // single packet stream.
+  void addOutputPin(uint8_t);
+  // NOTE: this is called from the ISR and must not be virtual as the vtable
+  // lives in flash which is not accessible while the flash cache is disabled.
+  WirePacket *getPacket();
+  // returns the current packet when its last bit has been sent (before it is
+  // repeated or released) otherwise nullptr, this is called from the ISR.
+  __attribute__((always_inline)) const Packet *getCompletedPacket() {
+    if(_currentPacket != nullptr && _currentPacket->currentBit >= _currentPacket->numberOfBits) {
+      return _currentPacket;
+    }
+    return nullptr;
+  }
+
+  // records the CPU cycles spent in a single call of the ISR.
+  __attribute__((always_inline)) void recordISRCycles(uint32_t cycles) {
+    _telemetry.isrCalls++;
+    _telemetry.isrCycles += cycles;
+    if(cycles > _telemetry.isrMaxCycles) {
+      _telemetry.isrMaxCycles = cycles;
+    }
+  }
+
+  // signal generators are always allocated from internal DRAM as the ISR
+  // accesses them while the flash cache may be disabled.
+  static void *operator new(size_t size) {
+    return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  static void operator delete(void *ptr) {
+    heap_caps_free(ptr);
+  }
 
 protected:
   SignalGenerator(String, uint16_t, uint8_t, uint8_t);
   virtual void enable() = 0;
   virtual void disable() = 0;
-  void lockSendQueue() {
-    portENTER_CRITICAL(&_sendQueueMUX);
-  }
-  void unlockSendQueue() {
-    portEXIT_CRITICAL(&_sendQueueMUX);
-  }
-  virtual void lockSendQueueISR() {
-    lockSendQueue();
-  }
-  virtual void unlockSendQueueISR() {
-    unlockSendQueue();
-  }
+  // called when a pin is added via addOutputPin.
+  virtual void attachOutputPin(uint8_t) = 0;
+  void configureOutputPin(uint8_t);
 
   const String _name;
   const uint8_t _signalID;
-  portMUX_TYPE _sendQueueMUX = portMUX_INITIALIZER_UNLOCKED;
+  // all pins the signal is sent to, the first entry is the primary pin.
+  std::vector<uint8_t> _outputPins;
 private:
-  std::queue<Packet *> _toSend;
-  std::queue<Packet *> _availablePackets;
-  Packet *_currentPacket;
+  static void feederTask(void *);
+  void fillWireQueue();
+  static void renderHalfBitDurations(WirePacket &);
+  bool enqueuePacket(const Packet &, uint8_t, DCC_PACKET_PRIORITY);
+  Packet *findSupersededPacket(uint32_t, DCC_PACKET_PRIORITY);
+  DCC_PACKET_PRIORITY nextPriority();
+  DCC_PACKET_PRIORITY spacePackets(DCC_PACKET_PRIORITY);
+
+  // packets waiting to be scheduled, one queue per priority class. These are
+  // only accessed with _producerLock held.
+  SPSCRingBuffer<Packet, InternalRAMAllocator> *_queues[MAX_DCC_PACKET_PRIORITY];
+  PacketQueueStatus _queueStatus[MAX_DCC_PACKET_PRIORITY];
+  volatile uint16_t _queuedPackets{0};
+  SignalGeneratorTelemetry _telemetry;
+  DCC_PACKET_PRIORITY _weightedPriority{DCC_PACKET_PRIORITY_REFRESH};
+  uint8_t _weightedCredit{0};
+  // address key (see getDCCPacketAddressKey) of the last packet moved to
+  // _toSend, used to space out packets to the same decoder.
+  uint16_t _lastAddressKey{0};
+
+  // packets scheduled to be sent, the ISR is the only consumer of this ring
+  // and all producers are serialized via _producerLock.
+  SPSCRingBuffer<WirePacket, InternalRAMAllocator> _toSend;
+  xSemaphoreHandle _producerLock;
+  TaskHandle_t _feederTask{nullptr};
+  WirePacket *_currentPacket{nullptr};
+  DCCPacketSource *_refreshSource{nullptr};
 
   // pre-encoded idle packet that gets sent when the _toSend queue is empty.
-  Packet _idlePacket {
-    { 0xFF, 0xFF, 0xFD, 0xFE, 0x00, 0x7F, 0x80, 0x00, 0x00, 0x00 }, // packet bytes
-    49, // number of bits
-    0, // number of repeats
-    0 // current bit
-  };
+  WirePacket _idlePacket;
+
+  // when set the ISR will send _eStopPacket continuously starting at the next
+  // packet boundary, all other packets are discarded.
+  volatile bool _emergencyStop{false};
+  volatile uint32_t _eStopRequestedAt{0};
+  WirePacket _eStopPacket;
 
   bool _enabled{false};
 };
 
-// S-9.2 baseline packet (idle)
-static constexpr DRAM_ATTR uint8_t idlePacket[] = {0xFF, 0x00};
-// S-9.2 baseline packet (decoder reset)
-static constexpr DRAM_ATTR uint8_t resetPacket[] = {0x00, 0x00};
-// S-9.2 baseline packet (eStop, direction bit ignored)
-static constexpr DRAM_ATTR uint8_t eStopPacket[] = {0x00, 0x41};
-
 // number of microseconds for each half of the DCC signal for a zero
 static constexpr uint64_t DCC_ZERO_BIT_PULSE_DURATION=98;
 // number of microseconds for each half of the DCC signal for a one
@@ -124,3 +257,4 @@ void startDCCSignalGenerators();
 bool stopDCCSignalGenerators();
 bool isDCCSignalEnabled();
 void sendDCCEmergencyStop();
+void clearDCCEmergencyStop();
@@ -0,0 +1,52 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include "DCCSignalGenerator.h"
+#include <driver/rmt.h>
+
+// number of RMT memory blocks used by each signal generator, each block holds
+// 64 RMT items (one DCC bit per item). The RMT channel is used in wrap-around
+// mode with the memory split in two halves, while one half is being sent by
+// the RMT peripheral the other half is refilled from the packet queue.
+static constexpr uint8_t DCC_RMT_MEMORY_BLOCKS = 2;
+static constexpr uint16_t DCC_RMT_ITEMS_PER_HALF = (DCC_RMT_MEMORY_BLOCKS * 64) / 2;
+
+// this controls the RMT tick frequency, this results in a 1uS tick frequency.
+static constexpr uint8_t DCC_RMT_CLOCK_DIVIDER = 80;
+
+// RMT items for a DCC one and zero bit, the first half of the bit is sent as
+// HIGH and the second half as LOW.
+static constexpr uint32_t DCC_RMT_ONE_BIT =
+  (DCC_ONE_BIT_PULSE_DURATION << 16) | (1 << 15) | DCC_ONE_BIT_PULSE_DURATION;
+static constexpr uint32_t DCC_RMT_ZERO_BIT =
+  (DCC_ZERO_BIT_PULSE_DURATION << 16) | (1 << 15) | DCC_ZERO_BIT_PULSE_DURATION;
+
+class SignalGenerator_RMT : public SignalGenerator {
+public:
+  SignalGenerator_RMT(String, uint16_t, uint8_t, uint8_t);
+  // these need to be public for the ISR handler to access them
+  void fillItems(uint16_t, uint16_t);
+  const rmt_channel_t _channel;
+  uint16_t _refillOffset{0};
+protected:
+  void enable() override;
+  void disable() override;
+  void attachOutputPin(uint8_t) override;
+private:
+  const uint8_t _pin;
+};
@@ -19,15 +19,41 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #include "DCCSignalGenerator.h"
 #include <esp32-hal-timer.h>
 
+// states of the RailCom cutout which is sent after each packet on the OPS
+// track when RAILCOM_ENABLED is set.
+enum RAILCOM_CUTOUT_STATE : uint8_t {
+  // no cutout in progress
+  RAILCOM_CUTOUT_IDLE,
+  // the HIGH half of the packet end bit is being sent
+  RAILCOM_CUTOUT_END_BIT,
+  // the LOW half of the packet end bit is being sent
+  RAILCOM_CUTOUT_END_BIT_LOW,
+  // the end bit has been sent, the outputs are held LOW until the cutout
+  // starts
+  RAILCOM_CUTOUT_START,
+  // the track outputs are shorted, channel 1 data is being received
+  RAILCOM_CUTOUT_CHANNEL1,
+  // the track outputs are shorted, channel 2 data is being received
+  RAILCOM_CUTOUT_CHANNEL2
+};
+
 class SignalGenerator_HardwareTimer : public SignalGenerator {
 public:
   SignalGenerator_HardwareTimer(String, uint16_t, uint8_t, uint8_t);
   // these need to be public for the ISR handler to access them
   hw_timer_t *_timer;
+  const uint8_t _timerNum;
   bool _topOfWave{true};
+  RAILCOM_CUTOUT_STATE _cutoutState{RAILCOM_CUTOUT_IDLE};
+  // packet being sent by the ISR, the half bit durations of the packet are
+  // rendered by the feeder task so each bit only needs a single lookup.
+  WirePacket *_packet{nullptr};
+  // GPIO masks for all output pins (GPIO0-31 and GPIO32-39), all pins are
+  // set/cleared with a single register write each.
+  uint32_t _pinMask{0};
+  uint32_t _pinMaskHigh{0};
 protected:
   void enable() override;
   void disable() override;
-  void lockSendQueueISR() override;
-  void unlockSendQueueISR() override;
+  void attachOutputPin(uint8_t) override;
 };
\ No newline at end of file
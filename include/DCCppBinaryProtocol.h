@@ -0,0 +1,161 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <WString.h>
+#include "DCCppProtocol.h"
+
+/**********************************************************************
+
+The binary protocol is an optional alternative to the DCC++ text protocol for
+clients which send commands at high rates. Each message is framed as:
+
+  {SYNC} {LENGTH} {TYPE} {PAYLOAD...} {CRC}
+
+where
+
+  SYNC:    0xA5
+  LENGTH:  number of bytes in TYPE and PAYLOAD (uint16_t)
+  TYPE:    one of the DCCPP_BINARY_MESSAGE_TYPE values (uint8_t)
+  PAYLOAD: the fixed layout for TYPE, see below
+  CRC:     CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of LENGTH,
+           TYPE and PAYLOAD (uint16_t)
+
+All multi-byte values are little endian. Messages with an invalid LENGTH or
+CRC are discarded and the receiver resyncs on the next SYNC byte following
+the SYNC byte of the discarded message.
+
+Commands are processed by the same command handlers as the text protocol,
+responses which have a binary layout are sent in that layout and all other
+responses are sent as TEXT messages.
+
+**********************************************************************/
+
+static constexpr uint8_t DCCPP_BINARY_SYNC = 0xA5;
+
+// largest TYPE and PAYLOAD accepted, this allows a TEXT message to carry any
+// command accepted by the text protocol.
+static constexpr uint16_t DCCPP_BINARY_MAX_MESSAGE_SIZE = DCCPP_MAX_FRAME_SIZE + 1;
+
+// number of bytes added to each message by the framing.
+static constexpr uint8_t DCCPP_BINARY_FRAMING_SIZE = 5;
+
+enum DCCPP_BINARY_MESSAGE_TYPE : uint8_t {
+  // command: a single DCC++ text command without the < and >.
+  // response: DCC++ text response(s) as sent to text protocol clients.
+  DCCPP_BINARY_TEXT = 0x00,
+  // command: DCCPPBinaryThrottle, same as <t>.
+  // response: DCCPPBinaryThrottleState, same as <T>.
+  DCCPP_BINARY_THROTTLE = 0x01,
+  // command: DCCPPBinaryFunction, same as <f>.
+  DCCPP_BINARY_FUNCTION = 0x02,
+  // command: DCCPPBinaryAccessory, same as <a>.
+  DCCPP_BINARY_ACCESSORY = 0x03,
+  // response: DCCPPBinarySensor, same as <Q ID> and <q ID>.
+  DCCPP_BINARY_SENSOR = 0x04,
+  // command: DCCPPBinaryPower, same as <1> and <0>.
+  // response: DCCPPBinaryPower followed by the motor board name, same as
+  // <p0>, <p1> and <p2>.
+  DCCPP_BINARY_POWER = 0x05
+};
+
+struct __attribute__((packed)) DCCPPBinaryThrottle {
+  uint8_t registerNumber;
+  uint16_t address;
+  // 0-126, -1 for emergency stop
+  int8_t speed;
+  // 1 = forward, 0 = reverse
+  uint8_t direction;
+};
+
+struct __attribute__((packed)) DCCPPBinaryThrottleState {
+  uint8_t registerNumber;
+  int8_t speed;
+  uint8_t direction;
+};
+
+struct __attribute__((packed)) DCCPPBinaryFunction {
+  uint16_t address;
+  uint8_t functionByte;
+  // only used for F13-F28 (functionByte 222 or 223)
+  uint8_t secondaryFunctionByte;
+};
+
+struct __attribute__((packed)) DCCPPBinaryAccessory {
+  uint16_t address;
+  uint8_t index;
+  // 1 = activate, 0 = deactivate
+  uint8_t state;
+};
+
+struct __attribute__((packed)) DCCPPBinarySensor {
+  uint16_t sensorID;
+  // 1 = active, 0 = inactive
+  uint8_t state;
+};
+
+struct __attribute__((packed)) DCCPPBinaryPower {
+  // 0 = off, 1 = on, 2 = overcurrent (response only)
+  uint8_t state;
+};
+
+// binary message encoded from a DCC++ text response, the message is sent as
+// head, body and crc. The body points into the response so a (large) TEXT
+// message is never copied before it reaches the client output buffer.
+struct DCCPPBinaryEncodedMessage {
+  // SYNC, LENGTH, TYPE and the fixed layout payload
+  uint8_t head[4 + sizeof(DCCPPBinaryThrottleState)];
+  uint8_t headLength;
+  // TEXT response or motor board name
+  const uint8_t *body;
+  uint16_t bodyLength;
+  uint8_t crc[2];
+  size_t size() const {
+    return headLength + bodyLength + sizeof(crc);
+  }
+};
+
+// splits the incoming byte stream into binary messages and processes each
+// message as the client it was received from.
+class DCCPPBinaryConsumer {
+public:
+  void feed(uint32_t, const uint8_t *, size_t);
+  // encodes a DCC++ text response as a binary message, the response must
+  // outlive the encoded message.
+  static void encode(const String &, DCCPPBinaryEncodedMessage &);
+  // number of messages discarded due to an invalid LENGTH or CRC.
+  uint32_t getInvalidMessages() {
+    return _invalidMessages;
+  }
+private:
+  bool consume(uint32_t, uint8_t);
+  void rescan(uint32_t);
+  void process(const uint8_t *, uint16_t);
+  enum BINARY_FRAME_STATE : uint8_t {
+    WAIT_FOR_SYNC,
+    LENGTH_LOW,
+    LENGTH_HIGH,
+    MESSAGE
+  };
+  BINARY_FRAME_STATE _state{WAIT_FOR_SYNC};
+  uint16_t _length{0};
+  uint16_t _received{0};
+  // the message includes the trailing CRC
+  uint8_t _message[DCCPP_BINARY_MAX_MESSAGE_SIZE + 2];
+  uint32_t _invalidMessages{0};
+};
@@ -28,6 +28,21 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 // Maximum clients connected to
 #define MAX_DCCPP_CLIENTS 10
 
+// Size of the output buffer for each JMRI (TCP) client, a client which falls
+// further behind than this is disconnected.
+#ifndef DCCPP_CLIENT_OUTPUT_BUFFER_SIZE
+#define DCCPP_CLIENT_OUTPUT_BUFFER_SIZE 4096
+#endif
+
+// The binary protocol (see DCCppBinaryProtocol.h) is disabled by default, when
+// enabled it is served on its own port alongside the JMRI text protocol.
+#ifndef DCCPP_BINARY_PROTOCOL_ENABLED
+#define DCCPP_BINARY_PROTOCOL_ENABLED false
+#endif
+#ifndef DCCPP_BINARY_CLIENT_PORT
+#define DCCPP_BINARY_CLIENT_PORT 2561
+#endif
+
 /////////////////////////////////////////////////////////////////////////////////////
 // S88 Timing values (in microseconds)
 /////////////////////////////////////////////////////////////////////////////////////
@@ -82,16 +97,51 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #define ENERGIZE_OPS_TRACK_ON_STARTUP false
 #endif
 
+#ifndef DCC_SIGNAL_GENERATOR_RMT
+#define DCC_SIGNAL_GENERATOR_RMT false
+#endif
+
+#ifndef RAILCOM_ENABLED
+#define RAILCOM_ENABLED false
+#endif
+
+#ifndef LOCOMOTIVE_SPEED_REFRESH_INTERVAL
+#define LOCOMOTIVE_SPEED_REFRESH_INTERVAL 50
+#endif
+
+#ifndef LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL
+#define LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL 250
+#endif
+
+#ifndef LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL
+#define LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL 2000
+#endif
+
+#ifndef LOCOMOTIVE_STOPPED_REFRESH_INTERVAL
+#define LOCOMOTIVE_STOPPED_REFRESH_INTERVAL 500
+#endif
+
+#ifndef MAX_LOCOMOTIVES
+#define MAX_LOCOMOTIVES 64
+#endif
+
+#ifndef MAX_LOCOMOTIVE_CONSISTS
+#define MAX_LOCOMOTIVE_CONSISTS 16
+#endif
+
+#ifndef MAX_ROSTER_ENTRIES
+#define MAX_ROSTER_ENTRIES 64
+#endif
+
 #include "ConfigurationManager.h"
 #include "WiFiInterface.h"
 #include "InfoScreen.h"
 #include "DCCppProtocol.h"
 #include "DCCSignalGenerator.h"
 #include "DCCSignalGenerator_Timer.h"
-#if 0
 #include "DCCSignalGenerator_RMT.h"
-#endif
 #include "DCCProgrammer.h"
+#include "RailCom.h"
 #include "MotorBoard.h"
 #include "Sensors.h"
 #include "Locomotive.h"
@@ -143,6 +193,39 @@ extern bool otaInProgress;
 #error "Invalid Configuration detected, it is not supported to include both OLED and LCD support."
 #endif
 
+#if RAILCOM_ENABLED
+  #if DCC_SIGNAL_GENERATOR_RMT
+  #error "Invalid Configuration detected, RailCom is only supported by the hardware timer signal generator."
+  #endif
+  #if RAILCOM_BRAKE_PIN == DCC_SIGNAL_PIN_OPERATIONS || RAILCOM_BRAKE_PIN == MOTORBOARD_ENABLE_PIN_OPS
+  #error "Invalid Configuration detected, RAILCOM_BRAKE_PIN must be unique."
+  #endif
+  #if HC12_RADIO_ENABLED
+    #if RAILCOM_UART == HC12_UART_NUM
+    #error "Invalid Configuration detected, RailCom and HC12 can not share the UART interface."
+    #endif
+    #if RAILCOM_UART_RX_PIN == HC12_RX_PIN
+    #error "Invalid Configuration detected, the RAILCOM_UART_RX_PIN and HC12_RX_PIN must be unique."
+    #endif
+  #endif
+  #if NEXTION_ENABLED
+    #if RAILCOM_UART == NEXTION_UART_NUM
+    #error "Invalid Configuration detected, RailCom and the Nextion can not share the UART interface."
+    #endif
+    #if RAILCOM_UART_RX_PIN == NEXTION_RX_PIN
+    #error "Invalid Configuration detected, the RAILCOM_UART_RX_PIN and NEXTION_RX_PIN must be unique."
+    #endif
+  #endif
+  #if LOCONET_ENABLED
+    #if RAILCOM_UART == LOCONET_UART
+    #error "Invalid Configuration detected, RailCom and LocoNet can not share the UART interface."
+    #endif
+    #if RAILCOM_UART_RX_PIN == LOCONET_RX_PIN
+    #error "Invalid Configuration detected, the RAILCOM_UART_RX_PIN and LOCONET_RX_PIN must be unique."
+    #endif
+  #endif
+#endif
+
 #if NEXTION_ENABLED
   #if NEXTION_RX_PIN == NEXTION_TX_PIN
   #error "Invalid Configuration detected, NEXTION_RX_PIN and NEXTION_TX_PIN must be unique."
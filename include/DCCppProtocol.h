@@ -21,31 +21,165 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #include <WString.h>
 #include <Stream.h>
 
+// maximum number of arguments accepted for a single command (excluding the
+// command ID), commands with more arguments are rejected with <X>. This is
+// enough for 16 updates in a <tb> command.
+static constexpr uint8_t DCCPP_MAX_ARGUMENTS = 64;
+
+// number of entries in the command dispatch table, command IDs must start
+// with a 7-bit ASCII character.
+static constexpr uint8_t DCCPP_COMMAND_TABLE_SIZE = 128;
+
+// single command argument, this is a view into the command buffer and is only
+// valid while the command is being processed. Arguments received via the
+// binary protocol are already numeric and have an empty string value.
+class DCCPPProtocolArgument {
+public:
+  DCCPPProtocolArgument(const char *value) : _value(value) {}
+  DCCPPProtocolArgument(int32_t number) : _value(""), _number(number), _numeric(true) {}
+  // parses the argument as a (signed) decimal integer without copying it,
+  // parsing stops at the first non-digit character.
+  int32_t toInt() const {
+    if(_numeric) {
+      return _number;
+    }
+    const char *ch = _value;
+    bool negative = (*ch == '-');
+    if(negative || *ch == '+') {
+      ch++;
+    }
+    int32_t value = 0;
+    while(*ch >= '0' && *ch <= '9') {
+      value = (value * 10) + (*ch++ - '0');
+    }
+    return negative ? -value : value;
+  }
+  const char *c_str() const {
+    return _value;
+  }
+  bool equals(const char *value) const {
+    return !strcmp(_value, value);
+  }
+private:
+  const char *_value;
+  int32_t _number{0};
+  bool _numeric{false};
+};
+
+// arguments for a single command, the arguments are split in place by
+// replacing the separating spaces with null terminators so no copies of the
+// command are made. Each argument is stored as its offset from the start of
+// the arguments which keeps this small enough to live on the stack of the
+// task processing the command.
+class DCCPPProtocolArguments {
+public:
+  DCCPPProtocolArguments() {}
+  DCCPPProtocolArguments(char *);
+  // numeric arguments, the values are not copied.
+  DCCPPProtocolArguments(const int32_t *values, uint8_t count) : _values(values), _count(count) {}
+  size_t size() const {
+    return _count;
+  }
+  bool empty() const {
+    return _count == 0;
+  }
+  // returns true if the command had more than DCCPP_MAX_ARGUMENTS arguments.
+  bool overflow() const {
+    return _overflow;
+  }
+  // out of range arguments are returned as an empty string (zero).
+  DCCPPProtocolArgument operator[](size_t index) const {
+    if(index >= _count) {
+      return DCCPPProtocolArgument("");
+    } else if(_values) {
+      return DCCPPProtocolArgument(_values[index]);
+    }
+    return DCCPPProtocolArgument(_base + _offsets[index]);
+  }
+private:
+  const char *_base{nullptr};
+  uint16_t _offsets[DCCPP_MAX_ARGUMENTS];
+  const int32_t *_values{nullptr};
+  uint8_t _count{0};
+  bool _overflow{false};
+};
+
 // Class definition for a single protocol command
 class DCCPPProtocolCommand {
 public:
   virtual ~DCCPPProtocolCommand() {}
-  virtual void process(const std::vector<String>) = 0;
-  virtual String getID() = 0;
+  virtual void process(const DCCPPProtocolArguments &) = 0;
+  virtual const char *getID() = 0;
 };
 
 // Class definition for the Protocol Interpreter
 class DCCPPProtocolHandler {
 public:
   static void init();
-  static void process(const String &);
+  // processes a single command (without the surrounding < and >), the command
+  // buffer is modified while splitting the arguments.
+  static void process(char *);
   static void registerCommand(DCCPPProtocolCommand *);
-  static DCCPPProtocolCommand *getCommandHandler(const String &);
+  static DCCPPProtocolCommand *getCommandHandler(const char *);
+private:
+  static void buildCommandTable();
 };
 
+// maximum length of a single command (excluding the < and >), longer
+// commands are discarded and counted as oversized.
+static constexpr uint16_t DCCPP_MAX_FRAME_SIZE = 512;
+static_assert(DCCPP_MAX_FRAME_SIZE <= UINT16_MAX, "argument offsets are limited to 16 bits");
+
+// splits the incoming byte stream into <...> frames and passes each frame to
+// DCCPPProtocolHandler. Frames which are fully contained in the data passed to
+// feed() are processed directly from that buffer, only a frame which spans
+// multiple calls is held in the (fixed size) partial frame buffer.
+//
+// Each consumer is a protocol client with its own ID, while a frame is being
+// processed the client is the active client of the calling task and all
+// responses sent via wifiInterface.send/printf are sent only to that client.
 class DCCPPProtocolConsumer {
 public:
   DCCPPProtocolConsumer();
+  virtual ~DCCPPProtocolConsumer();
+  // NOTE: the data is modified while processing frames.
   void feed(uint8_t *, size_t);
-  void update();
+  // queues data to be sent to the client, implementations must not block.
+  virtual void send(const String &) = 0;
+  uint32_t getClientID() {
+    return _clientID;
+  }
+  // number of frames discarded due to a new frame starting before the
+  // previous frame was terminated.
+  uint32_t getDroppedFrames() {
+    return _droppedFrames;
+  }
+  // number of frames discarded due to exceeding DCCPP_MAX_FRAME_SIZE.
+  uint32_t getOversizedFrames() {
+    return _oversizedFrames;
+  }
+  // returns the ID of the client whose command is being processed by the
+  // calling task or zero if the task is not processing a client command.
+  static uint32_t getActiveClientID();
+  static void setActiveClientID(uint32_t);
+  // sends to a single client, returns false if the client has disconnected.
+  static bool sendToClient(uint32_t, const String &);
+  // sends to all clients.
+  static void sendToAll(const String &);
+protected:
+  // stops any further send() calls, once this returns no other task is in
+  // send() for this client. Derived classes must call this first in their
+  // destructor so send() never runs on a partially destroyed client.
+  void unregister();
 private:
-  void processData();
-  std::vector<uint8_t> _buffer;
+  void processFrame(char *, size_t);
+  uint32_t _clientID;
+  bool _registered{true};
+  char _frame[DCCPP_MAX_FRAME_SIZE + 1];
+  uint16_t _frameLength{0};
+  bool _inFrame{false};
+  uint32_t _droppedFrames{0};
+  uint32_t _oversizedFrames{0};
 };
 
 const String COMMAND_FAILED_RESPONSE = "<X>";
@@ -0,0 +1,31 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <esp_heap_caps.h>
+
+// allocates from internal DRAM, data accessed by an ISR must not live in
+// PSRAM as it is not accessible while the flash cache is disabled.
+struct InternalRAMAllocator {
+  static void *allocate(size_t count, size_t size) {
+    return heap_caps_calloc(count, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  static void release(void *ptr) {
+    heap_caps_free(ptr);
+  }
+};
@@ -18,40 +18,111 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #pragma once
 
 #include "DCCppESP32.h"
+#include "AddressIndex.h"
+#include "ObjectPool.h"
 
 #define MAX_LOCOMOTIVE_FUNCTIONS 29
 #define MAX_LOCOMOTIVE_FUNCTION_PACKETS 5
 
+// every locomotive (including consist members) and every consist uses one
+// LocomotiveState slot.
+#define MAX_LOCOMOTIVE_SLOTS (MAX_LOCOMOTIVES + MAX_LOCOMOTIVE_CONSISTS)
+
+static_assert(MAX_LOCOMOTIVE_SLOTS < 256, "MAX_LOCOMOTIVES + MAX_LOCOMOTIVE_CONSISTS must be less than 256");
+
+// bits used in LocomotiveState::flags.
+enum LOCOMOTIVE_STATE_FLAGS : uint8_t {
+  LOCOMOTIVE_STATE_ACTIVE = 0x01,
+  LOCOMOTIVE_STATE_FORWARD = 0x02,
+  LOCOMOTIVE_STATE_REFRESH = 0x04,
+  // the speed has changed due to momentum and needs to be sent.
+  LOCOMOTIVE_STATE_SPEED_DUE = 0x08
+};
+
+// LocomotiveState::flags of the locomotives which are refreshed (and have
+// momentum applied).
+static constexpr uint8_t LOCOMOTIVE_REFRESH_FLAGS = LOCOMOTIVE_STATE_ACTIVE | LOCOMOTIVE_STATE_REFRESH;
+
+// momentum (speed ramping) is applied this often (ms).
+static constexpr uint32_t LOCOMOTIVE_MOMENTUM_INTERVAL = 50;
+// highest speed in 128 speed step mode (S-9.2.1), the acceleration and
+// braking rates are the time needed to ramp between stopped and this speed.
+static constexpr uint8_t LOCOMOTIVE_MAX_SPEED = 126;
+
+// state of every locomotive that is needed to build speed and function
+// packets, this is kept as a structure of arrays indexed by the locomotive
+// slot so the refresh scan only touches the fields it needs.
+struct LocomotiveState {
+  uint16_t address[MAX_LOCOMOTIVE_SLOTS];
+  // current speed, with momentum this ramps towards targetSpeed. The fraction
+  // holds the 1/256th of a speed step not yet applied.
+  int8_t speed[MAX_LOCOMOTIVE_SLOTS];
+  uint8_t speedFraction[MAX_LOCOMOTIVE_SLOTS];
+  int8_t targetSpeed[MAX_LOCOMOTIVE_SLOTS];
+  // time (in tenths of a second) to ramp from stopped to full speed and back,
+  // zero disables momentum.
+  uint8_t acceleration[MAX_LOCOMOTIVE_SLOTS];
+  uint8_t braking[MAX_LOCOMOTIVE_SLOTS];
+  uint8_t flags[MAX_LOCOMOTIVE_SLOTS];
+  // bit per function (F0-F28).
+  uint32_t functions[MAX_LOCOMOTIVE_SLOTS];
+  uint32_t lastUpdate[MAX_LOCOMOTIVE_SLOTS];
+  uint32_t lastFunctionUpdate[MAX_LOCOMOTIVE_FUNCTION_PACKETS][MAX_LOCOMOTIVE_SLOTS];
+};
+
 class Locomotive {
 public:
   Locomotive(uint8_t);
   Locomotive(JsonObject &);
-  virtual ~Locomotive() {}
+  virtual ~Locomotive();
   uint8_t getRegister() {
     return _registerNumber;
   }
-  void setLocoAddress(uint16_t locoAddress) {
-    _locoAddress = locoAddress;
-  }
+  // sets the address and loads the momentum rates from the roster.
+  void setLocoAddress(uint16_t);
   uint16_t getLocoAddress() {
-    return _locoAddress;
+    return _state.address[_slot];
   }
+  // sets the target speed, when momentum is enabled the current speed will
+  // ramp towards it otherwise it is applied immediately. A new speed does not
+  // release an active emergency stop, see LocomotiveManager::clearEmergencyStop.
   void setSpeed(int8_t speed) {
+    // the emergency stop itself uses a negative speed and bypasses momentum.
     if(speed < 0) {
       speed = 0;
-    } else if(speed > 128) {
-      speed = 128;
+      _state.speed[_slot] = 0;
+    } else if(speed > LOCOMOTIVE_MAX_SPEED) {
+      speed = LOCOMOTIVE_MAX_SPEED;
+    }
+    _state.targetSpeed[_slot] = speed;
+    if(!hasMomentum()) {
+      _state.speed[_slot] = speed;
     }
-    _speed = speed;
   }
   int8_t getSpeed() {
-    return _speed;
+    return _state.speed[_slot];
+  }
+  int8_t getTargetSpeed() {
+    return _state.targetSpeed[_slot];
+  }
+  void setMomentum(uint8_t acceleration, uint8_t braking) {
+    _state.acceleration[_slot] = acceleration;
+    _state.braking[_slot] = braking;
+  }
+  uint8_t getAcceleration() {
+    return _state.acceleration[_slot];
+  }
+  uint8_t getBraking() {
+    return _state.braking[_slot];
+  }
+  bool hasMomentum() {
+    return _state.acceleration[_slot] || _state.braking[_slot];
   }
   void setDirection(bool forward) {
-    _direction = forward;
+    setFlag(LOCOMOTIVE_STATE_FORWARD, forward);
   }
   bool isDirectionForward() {
-    return _direction;
+    return _state.flags[_slot] & LOCOMOTIVE_STATE_FORWARD;
   }
   void setOrientationForward(bool forward) {
     _orientation = forward;
@@ -60,32 +131,71 @@ public:
     return _orientation;
   }
   uint32_t getLastUpdate() {
-    return _lastUpdate;
+    return _state.lastUpdate[_slot];
   }
   void setIdle() {
-    setSpeed(0);
+    _state.speed[_slot] = 0;
+    _state.targetSpeed[_slot] = 0;
+  }
+  // when enabled the locomotive is included in the OPS refresh scan.
+  void setRefreshEnabled(bool enabled) {
+    setFlag(LOCOMOTIVE_STATE_REFRESH, enabled);
   }
   void sendLocoUpdate();
+  // builds the speed packet for the current speed and direction, this counts
+  // as a speed update for refresh purposes.
+  void encodeSpeedPacket(Packet &);
   void showStatus();
   void toJson(JsonObject &, bool=true, bool=true);
   void setFunction(uint8_t funcID, bool state=false) {
-    _functionState[funcID] = state;
-    _functionsChanged = true;
+    bitWrite(_state.functions[_slot], funcID, state);
+    bitSet(_changedFunctionPackets, getFunctionPacket(funcID));
   }
   bool isFunctionEnabled(uint8_t funcID) {
-    return _functionState[funcID];
-  }
+    return bitRead(_state.functions[_slot], funcID);
+  }
+  static bool getRefreshPacket(uint8_t, Packet &, uint32_t);
+  // moves the current speed of the locomotive in slot towards its target
+  // speed based on the time elapsed (ms) since the last call.
+  static void updateMomentum(uint8_t, uint32_t);
+  // stops all locomotives immediately, bypassing momentum.
+  static void stopAll();
+
+  // locomotives are allocated from a fixed size pool (MAX_LOCOMOTIVES), new
+  // returns nullptr when the pool is exhausted.
+  static void *operator new(size_t) noexcept;
+  static void operator delete(void *);
+protected:
+  friend class LocomotiveManager;
+  static LocomotiveState _state;
+  const uint8_t _slot;
 private:
-  void createFunctionPackets();
+  void setFlag(uint8_t flag, bool value) {
+    if(value) {
+      _state.flags[_slot] |= flag;
+    } else {
+      _state.flags[_slot] &= ~flag;
+    }
+  }
+  static uint8_t acquireSlot();
+  static uint8_t createSpeedPacket(uint8_t, uint8_t *);
+  static uint8_t createFunctionPacket(uint8_t, uint8_t, uint8_t *);
+  static uint8_t getFunctionPacket(uint8_t funcID) {
+    if(funcID <= 4) {
+      return 0;
+    } else if(funcID <= 8) {
+      return 1;
+    } else if(funcID <= 12) {
+      return 2;
+    } else if(funcID <= 20) {
+      return 3;
+    }
+    return 4;
+  }
   uint8_t _registerNumber;
-  uint16_t _locoAddress;
-  int8_t _speed;
-  bool _direction;
-  bool _orientation;
-  uint32_t _lastUpdate;
-  bool _functionsChanged;
-  bool _functionState[MAX_LOCOMOTIVE_FUNCTIONS];
-  std::vector<uint8_t> _functionPackets[MAX_LOCOMOTIVE_FUNCTION_PACKETS];
+  bool _orientation{true};
+  // bit per function packet that needs to be sent at the next update.
+  uint8_t _changedFunctionPackets{0xFF};
 };
 
 class LocomotiveConsist : public Locomotive {
@@ -93,6 +203,9 @@ public:
   LocomotiveConsist(uint8_t address, bool decoderAssistedConsist=false) :
     Locomotive(-1), _decoderAssisstedConsist(decoderAssistedConsist) {
     setLocoAddress(address);
+    // decoder assisted consists are refreshed using the consist address,
+    // otherwise each locomotive in the consist is refreshed.
+    setRefreshEnabled(decoderAssistedConsist);
   }
   LocomotiveConsist(JsonObject &);
   virtual ~LocomotiveConsist();
@@ -115,19 +228,33 @@ public:
       }
     }
   }
+  // applies the momentum rates of the lead locomotive to the consist and all
+  // locomotives in it.
+  void applyLeadMomentum();
+  // consists are allocated from a fixed size pool (MAX_LOCOMOTIVE_CONSISTS),
+  // new returns nullptr when the pool is exhausted.
+  static void *operator new(size_t) noexcept;
+  static void operator delete(void *);
 private:
   bool _decoderAssisstedConsist;
   std::vector<Locomotive *> _locos;
 };
 
+// maximum length of the RosterEntry description and type.
+static constexpr uint8_t ROSTER_ENTRY_DESCRIPTION_LENGTH = 32;
+static constexpr uint8_t ROSTER_ENTRY_TYPE_LENGTH = 16;
+
 class RosterEntry {
 public:
-  RosterEntry(uint16_t address) : _description(""), _address(address), _type(""),
-    _idleOnStartup(false), _defaultOnThrottles(false) {}
+  RosterEntry(uint16_t address) : _address(address),
+    _idleOnStartup(false), _defaultOnThrottles(false), _acceleration(0), _braking(0) {
+    _description[0] = 0;
+    _type[0] = 0;
+  }
   RosterEntry(const JsonObject &);
   void toJson(JsonObject &);
   void setDescription(String description) {
-    _description = description;
+    strlcpy(_description, description.c_str(), sizeof(_description));
   }
   String getDescription() {
     return _description;
@@ -139,7 +266,7 @@ public:
     return _address;
   }
   void setType(String type) {
-    _type = type;
+    strlcpy(_type, type.c_str(), sizeof(_type));
   }
   String getType() {
     return _type;
@@ -156,30 +283,54 @@ public:
   bool isDefaultOnThrottles() {
     return _defaultOnThrottles;
   }
+  // see LocomotiveState::acceleration and LocomotiveState::braking.
+  void setAcceleration(uint8_t value) {
+    _acceleration = value;
+  }
+  uint8_t getAcceleration() {
+    return _acceleration;
+  }
+  void setBraking(uint8_t value) {
+    _braking = value;
+  }
+  uint8_t getBraking() {
+    return _braking;
+  }
 
+  // roster entries are allocated from a fixed size pool (MAX_ROSTER_ENTRIES),
+  // new returns nullptr when the pool is exhausted.
+  static void *operator new(size_t) noexcept;
+  static void operator delete(void *);
 private:
-  String _description;
+  char _description[ROSTER_ENTRY_DESCRIPTION_LENGTH + 1];
+  char _type[ROSTER_ENTRY_TYPE_LENGTH + 1];
   uint16_t _address;
-  String _type;
   bool _idleOnStartup;
   bool _defaultOnThrottles;
+  uint8_t _acceleration;
+  uint8_t _braking;
 };
 
 class LocomotiveManager {
 public:
-  // gets or creates a new locomotive to be managed
-  static Locomotive *getLocomotive(const uint16_t, const bool=true);
+  // gets the locomotive for an address, when it is not yet managed a new
+  // locomotive will be created (and managed) unless create is false.
+  static Locomotive *getLocomotive(const uint16_t, const bool create=true);
   static Locomotive *getLocomotiveByRegister(const uint8_t);
   // removes a locomotive from management, sends speed zero before removal
   static void removeLocomotive(const uint16_t);
   static bool removeLocomotiveConsist(const uint16_t);
-  static void processThrottle(const std::vector<String>);
-  static void processFunction(const std::vector<String>);
-  static void processConsistThrottle(const std::vector<String>);
+  static void processThrottle(const DCCPPProtocolArguments &);
+  static void processThrottleBatch(const DCCPPProtocolArguments &);
+  static void processFunction(const DCCPPProtocolArguments &);
+  static void processConsistThrottle(const DCCPPProtocolArguments &);
   static void showStatus();
   static void showConsistStatus();
-  static void updateTask(void *param);
+  static bool getRefreshPacket(Packet &);
   static void emergencyStop();
+  // releases an active emergency stop, until this is called (or the track
+  // power is cycled) no packets other than eStop are sent.
+  static void clearEmergencyStop();
   static uint8_t getActiveLocoCount() {
     return _locos.length();
   }
@@ -197,12 +348,43 @@ public:
   static LocomotiveConsist *createLocomotiveConsist(int8_t);
   static RosterEntry *getRosterEntry(uint16_t, bool=true);
   static void removeRosterEntry(uint16_t);
+  // used by LocomotiveConsist to keep the consist member index up to date.
+  static void addConsistMember(uint16_t, LocomotiveConsist *);
+  static void removeConsistMember(uint16_t, LocomotiveConsist *);
 private:
+  static Locomotive *getThrottleLocomotive(const uint8_t, const uint16_t);
+  static bool indexLocomotive(Locomotive *);
+  static void unindexLocomotiveAddress(Locomotive *);
+  static void unindexLocomotiveRegister(Locomotive *);
+  static bool indexConsist(LocomotiveConsist *);
+  static void unindexConsist(LocomotiveConsist *);
   static LinkedList<RosterEntry *> _roster;
   static LinkedList<Locomotive *> _locos;
   static LinkedList<LocomotiveConsist *> _consists;
-  static TaskHandle_t _taskHandle;
+  // lookup tables for the lists above, these are updated whenever a
+  // locomotive or consist is added, removed or readdressed. When more than one
+  // entry shares a key the index follows the previous linear search results,
+  // the last locomotive by address, the first locomotive by register and the
+  // first consist by address or member address.
+  static AddressIndex<Locomotive> _locoIndex;
+  static AddressIndex<Locomotive> _registerIndex;
+  static AddressIndex<LocomotiveConsist> _consistIndex;
+  static AddressIndex<LocomotiveConsist> _consistMemberIndex;
   static xSemaphoreHandle _lock;
+  // last LocomotiveState slot a refresh packet was taken from.
+  static uint8_t _refreshSlot;
+  // applies momentum every LOCOMOTIVE_MOMENTUM_INTERVAL.
+  static void momentumTask(void *param);
+  static TaskHandle_t _momentumTask;
+};
+
+// adapter which allows the OPS signal generator to pull refresh packets from
+// the LocomotiveManager.
+class LocomotiveRefreshSource : public DCCPacketSource {
+public:
+  bool getRefreshPacket(Packet &packet) override {
+    return LocomotiveManager::getRefreshPacket(packet);
+  }
 };
 
 // <t {REGISTER} {LOCO} {SPEED} {DIRECTION}> command handler, this command
@@ -210,26 +392,60 @@ private:
 // locomotive control packet.
 class ThrottleCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     LocomotiveManager::processThrottle(arguments);
   }
-  String getID() {
+  const char *getID() {
     return "t";
   }
 };
 
+// <tb {REGISTER} {LOCO} {SPEED} {DIRECTION} [...]> command handler, this
+// command carries up to 16 <t> updates (four values each, DCCPP_MAX_ARGUMENTS)
+// in a single command. The updates are applied together and the speed packets
+// are queued as a single batch. returns: <tb {UPDATED} {FAILED}> instead of a
+// <T> for each locomotive, or <X> if the arguments are not a multiple of four
+// or there are too many updates.
+class ThrottleBatchCommandAdapter : public DCCPPProtocolCommand {
+public:
+  void process(const DCCPPProtocolArguments &arguments) {
+    LocomotiveManager::processThrottleBatch(arguments);
+  }
+  const char *getID() {
+    return "tb";
+  }
+};
+
 // <f {LOCO} {BYTE} [{BYTE2}]> command handler, this command converts a
 // locomotive function update into a compatible DCC function control packet.
 class FunctionCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     LocomotiveManager::processFunction(arguments);
   }
-  String getID() {
+  const char *getID() {
     return "f";
   }
 };
 
+// <!> command handler, stops all locomotives immediately and sends eStop
+// packets until the emergency stop is released by <! 0> (or the track power
+// is cycled). returns: <O>
+class EmergencyStopCommandAdapter : public DCCPPProtocolCommand {
+public:
+  void process(const DCCPPProtocolArguments &arguments) {
+    if(arguments.size() && arguments[0].toInt() == 0) {
+      LocomotiveManager::clearEmergencyStop();
+    } else {
+      LocomotiveManager::emergencyStop();
+    }
+    wifiInterface.send(COMMAND_SUCCESSFUL_RESPONSE);
+  }
+  const char *getID() {
+    return "!";
+  }
+};
+
 // wrapper to handle the following command structures:
 // CREATE: <C {ID} {LEAD LOCO} {TRAIL LOCO}  [{OTHER LOCO}]>
 // DELETE: <C {ID} {LOCO}>
@@ -238,8 +454,8 @@ public:
 // SHOW  : <C>
 class ConsistCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String>);
-  String getID() {
+  void process(const DCCPPProtocolArguments &);
+  const char *getID() {
     return "C";
   }
 };
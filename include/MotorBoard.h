@@ -26,6 +26,17 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 
 enum MOTOR_BOARD_TYPE { ARDUINO_SHIELD, POLOLU, BTS7960B_5A, BTS7960B_10A };
 
+// an additional OPS track district (booster), each district is driven from
+// the OPS packet stream on its own signal pin and has its own enable pin,
+// current sense and overcurrent handling.
+struct MotorBoardDistrict {
+	const char *name;
+	adc1_channel_t senseChannel;
+	uint8_t enablePin;
+	uint8_t signalPin;
+	MOTOR_BOARD_TYPE type;
+};
+
 class GenericMotorBoard {
 public:
 	GenericMotorBoard(adc1_channel_t, uint8_t, uint16_t, uint32_t, String, bool);
@@ -76,6 +87,7 @@ private:
 class MotorBoardManager {
 public:
 	static void registerBoard(adc1_channel_t, uint8_t, MOTOR_BOARD_TYPE, String, bool=false);
+	static void registerBoard(const std::vector<MotorBoardDistrict>);
 	static GenericMotorBoard *getBoardByName(String);
 	static std::vector<String> getBoardNames();
 	static uint8_t getMotorBoardCount();
@@ -92,24 +104,24 @@ public:
 
 class CurrentDrawCommand : public DCCPPProtocolCommand {
 public:
-	void process(const std::vector<String>);
-	String getID() {
+	void process(const DCCPPProtocolArguments &);
+	const char *getID() {
     return "c";
   }
 };
 
 class PowerOnCommand : public DCCPPProtocolCommand {
 public:
-	void process(const std::vector<String>);
-	String getID() {
+	void process(const DCCPPProtocolArguments &);
+	const char *getID() {
     return "1";
   }
 };
 
 class PowerOffCommand : public DCCPPProtocolCommand {
 public:
-	void process(const std::vector<String>);
-	String getID() {
+	void process(const DCCPPProtocolArguments &);
+	const char *getID() {
     return "0";
   }
 };
@@ -0,0 +1,67 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+#include <freertos/FreeRTOS.h>
+
+// Fixed capacity pool of equally sized objects.
+//
+// The storage is reserved statically so objects allocated from the pool are
+// packed together in DRAM without any per-allocation heap overhead, released
+// slots are kept on a free stack and reused by the next allocation. This is
+// intended to back a class specific operator new/delete, allocate() returns
+// nullptr when the pool is exhausted. allocate() and release() may be called
+// from multiple tasks.
+template<typename T, uint16_t N>
+class ObjectPool {
+public:
+  ObjectPool() {
+    for(uint16_t index = 0; index < N; index++) {
+      _free[index] = N - index - 1;
+    }
+  }
+  void *allocate() {
+    void *ptr = nullptr;
+    portENTER_CRITICAL(&_mux);
+    if(_freeCount) {
+      ptr = &_storage[_free[--_freeCount]];
+    }
+    portEXIT_CRITICAL(&_mux);
+    return ptr;
+  }
+  void release(void *ptr) {
+    if(ptr != nullptr) {
+      portENTER_CRITICAL(&_mux);
+      _free[_freeCount++] = static_cast<Storage *>(ptr) - _storage;
+      portEXIT_CRITICAL(&_mux);
+    }
+  }
+  uint16_t used() const {
+    return N - _freeCount;
+  }
+  static constexpr uint16_t capacity() {
+    return N;
+  }
+private:
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+  Storage _storage[N];
+  uint16_t _free[N];
+  uint16_t _freeCount{N};
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
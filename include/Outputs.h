@@ -86,8 +86,8 @@ class OutputManager {
 
 class OutputCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments);
-  String getID() {
+  void process(const DCCPPProtocolArguments &arguments);
+  const char *getID() {
     return "Z";
   }
 };
@@ -0,0 +1,68 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include "RailComDecoder.h"
+#include "RingBuffer.h"
+#include "InternalRAMAllocator.h"
+#include "DCCPacket.h"
+
+// RailCom cutout timing (RCN-217), all times are measured from the end of the
+// packet end bit (after both of its 58us halves). The cutout starts this many
+// microseconds after the end bit (T_CS, 26-32us).
+static constexpr uint32_t RAILCOM_CUTOUT_START_DELAY = 29;
+// duration of the channel 1 portion of the cutout, this ends at the start of
+// channel 2 (193us after the end bit).
+static constexpr uint32_t RAILCOM_CHANNEL1_DURATION = 193 - RAILCOM_CUTOUT_START_DELAY;
+// duration of the channel 2 portion of the cutout, the cutout ends 454us after
+// the end bit.
+static constexpr uint32_t RAILCOM_CHANNEL2_DURATION = 454 - 193;
+
+// RailCom bit rate
+static constexpr uint32_t RAILCOM_BAUD_RATE = 250000;
+
+// number of cutouts which can be waiting to be decoded.
+static constexpr uint8_t RAILCOM_CUTOUT_QUEUE_SIZE = 16;
+
+// identical POM read-back values received within this many milliseconds are
+// only reported once, decoders reply to every repeat of the POM packet.
+static constexpr uint32_t RAILCOM_POM_REPORT_INTERVAL = 250;
+
+class RailComManager {
+public:
+  static void init();
+  // these are called from the OPS signal generator ISR at the start of the
+  // cutout, the start of channel 2 and the end of the cutout.
+  static void startCutout(const Packet *);
+  static void endChannel1();
+  static void endCutout();
+  static uint16_t getDetectedAddress() {
+    return _detectedAddress;
+  }
+private:
+  static void railComTask(void *);
+  static void publish(const RailComCutout &, const RailComFeedback &);
+  static SPSCRingBuffer<RailComCutout, InternalRAMAllocator> *_cutouts;
+  static RailComCutout *_activeCutout;
+  static TaskHandle_t _taskHandle;
+  static RailComDecoder _decoder;
+  static uint16_t _detectedAddress;
+  static uint16_t _pomAddress;
+  static uint8_t _pomValue;
+  static uint32_t _pomTimestamp;
+  static volatile uint32_t _overflows;
+};
@@ -0,0 +1,99 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// NOTE: this file (and RailComDecoder.cpp) intentionally only depends on the
+// standard integer types so the decoder can be built and fed recorded cutout
+// byte streams off-target.
+#include <stdint.h>
+
+// maximum number of bytes received in each RailCom channel (RCN-217).
+static constexpr uint8_t RAILCOM_CHANNEL1_BYTES = 2;
+static constexpr uint8_t RAILCOM_CHANNEL2_BYTES = 6;
+
+// values returned by RailComDecoder::decode() for received bytes that do not
+// carry six data bits, these match the values used by OpenMRN (dcc::RailcomDefs).
+enum RAILCOM_CODE : uint8_t {
+  RAILCOM_CODE_INVALID = 0xFF,
+  RAILCOM_CODE_ACK = 0xFE,
+  RAILCOM_CODE_NACK = 0xFD,
+  RAILCOM_CODE_BUSY = 0xFC,
+  RAILCOM_CODE_RESERVED = 0xFA
+};
+
+// datagram identifiers sent by mobile decoders (RCN-217).
+enum RAILCOM_DATAGRAM_ID : uint8_t {
+  RAILCOM_DATAGRAM_POM = 0,
+  RAILCOM_DATAGRAM_ADR_HIGH = 1,
+  RAILCOM_DATAGRAM_ADR_LOW = 2,
+  RAILCOM_DATAGRAM_EXT = 3,
+  RAILCOM_DATAGRAM_DYN = 7
+};
+
+// bytes received during a single RailCom cutout.
+struct RailComCutout {
+  // time (in microseconds) when the cutout started.
+  uint32_t timestamp;
+  // encoded bytes 2-5 of the DCC packet preceding the cutout, these hold the
+  // first two payload bytes which identify the addressed decoder.
+  uint8_t packet[4];
+  uint8_t channel1[RAILCOM_CHANNEL1_BYTES];
+  uint8_t channel1Size;
+  uint8_t channel2[RAILCOM_CHANNEL2_BYTES];
+  uint8_t channel2Size;
+};
+
+// feedback decoded from a single cutout.
+struct RailComFeedback {
+  // address of the decoder the preceding DCC packet was sent to, zero for
+  // broadcast, idle and accessory packets.
+  uint16_t packetAddress;
+  // address broadcast by a decoder in channel 1, zero if not yet complete.
+  uint16_t detectedAddress;
+  // true when the addressed decoder sent a POM datagram in channel 2.
+  bool pomValid;
+  uint8_t pomValue;
+  uint8_t acks;
+  uint8_t nacks;
+  uint8_t busy;
+  uint8_t invalid;
+};
+
+class RailComDecoder {
+public:
+  // converts a received 4/8 encoded byte into six data bits or one of the
+  // RAILCOM_CODE values.
+  static uint8_t decode(uint8_t value) {
+    return _decodeTable[value];
+  }
+  // returns the decoder address the encoded packet was sent to.
+  static uint16_t getPacketAddress(const uint8_t *);
+  // decodes both channels of a cutout, the channel 1 address broadcast is
+  // split across two cutouts (ADR_HIGH and ADR_LOW) so the decoder keeps the
+  // most recent half between calls.
+  void process(const RailComCutout &, RailComFeedback &);
+  void reset() {
+    _addressHigh = -1;
+    _addressLow = -1;
+  }
+private:
+  bool parseDatagram(const uint8_t *, uint8_t, uint8_t &, RailComFeedback &);
+  void processDatagram(uint8_t, uint8_t, RailComFeedback &);
+  static const uint8_t _decodeTable[256];
+  int16_t _addressHigh{-1};
+  int16_t _addressLow{-1};
+};
@@ -60,8 +60,8 @@ public:
 
 class RemoteSensorsCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String>);
-  String getID() {
+  void process(const DCCPPProtocolArguments &);
+  const char *getID() {
     return "RS";
   }
 };
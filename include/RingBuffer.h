@@ -0,0 +1,177 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <stdint.h>
+#include <stdlib.h>
+
+// size of a cache line on the ESP32, the producer and consumer indexes are
+// kept on separate lines so the two sides do not contend for the same line.
+#define RING_BUFFER_CACHE_LINE_SIZE 32
+
+// the methods which may be used from an ISR are forced inline so that when
+// they are used from an IRAM_ATTR ISR no out-of-line copy is placed in flash.
+#define RING_BUFFER_ISR_INLINE __attribute__((always_inline))
+
+// default allocator for the ring buffer entries, see InternalRAMAllocator.h
+// for the allocator used by rings which are accessed from an ISR.
+struct RingBufferHeapAllocator {
+  static void *allocate(size_t count, size_t size) {
+    return calloc(count, size);
+  }
+  static void release(void *ptr) {
+    free(ptr);
+  }
+};
+
+// Fixed capacity single-producer / single-consumer ring buffer.
+//
+// The producer side (reserve/commit/requestDrain) must only be used by one
+// context at a time, callers with multiple producer tasks are expected to
+// serialize access themselves. Both reserve/commit and peek/pop are wait-free
+// and can be called from an ISR.
+//
+// Entries are stored by value and the consumer works directly on the slot
+// returned by peek() until it calls pop(), the producer will not reuse a
+// slot until the consumer has released it.
+//
+// The entries (zero filled) and rings created with new are allocated via
+// Allocator, rings which are consumed by an ISR must use InternalRAMAllocator
+// so the consumer can safely access them while the flash cache is disabled.
+template<typename T, typename Allocator = RingBufferHeapAllocator>
+class SPSCRingBuffer {
+  static_assert(std::is_trivially_destructible<T>::value,
+    "SPSCRingBuffer entries must be trivially destructible");
+public:
+  SPSCRingBuffer(uint32_t capacity) : _mask(roundUpToPowerOfTwo(capacity) - 1),
+    _buffer(static_cast<T *>(Allocator::allocate(_mask + 1, sizeof(T)))) {
+  }
+  ~SPSCRingBuffer() {
+    Allocator::release(_buffer);
+  }
+  // new does not honour the cache line alignment of the indexes before C++17
+  // so the instance is aligned here, the block returned by Allocator is kept
+  // just before the instance so it can be released.
+  static void *operator new(size_t size) {
+    void *block = Allocator::allocate(1, size + sizeof(void *) + RING_BUFFER_CACHE_LINE_SIZE - 1);
+    if(block == nullptr) {
+      // same outcome as the default operator new running out of memory.
+      abort();
+    }
+    const uintptr_t instance = (reinterpret_cast<uintptr_t>(block) + sizeof(void *) +
+      RING_BUFFER_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(RING_BUFFER_CACHE_LINE_SIZE - 1);
+    reinterpret_cast<void **>(instance)[-1] = block;
+    return reinterpret_cast<void *>(instance);
+  }
+  static void operator delete(void *ptr) {
+    if(ptr) {
+      Allocator::release(static_cast<void **>(ptr)[-1]);
+    }
+  }
+  uint32_t capacity() const {
+    return _mask + 1;
+  }
+  RING_BUFFER_ISR_INLINE uint32_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+  RING_BUFFER_ISR_INLINE bool empty() const {
+    return size() == 0;
+  }
+
+  // PRODUCER: returns the next free slot or nullptr if the ring is full. The
+  // slot is not visible to the consumer until commit() is called.
+  RING_BUFFER_ISR_INLINE T *reserve() {
+    const uint32_t head = _head.load(std::memory_order_relaxed);
+    if(head - _cachedTail > _mask) {
+      _cachedTail = _tail.load(std::memory_order_acquire);
+      if(head - _cachedTail > _mask) {
+        return nullptr;
+      }
+    }
+    return &_buffer[head & _mask];
+  }
+
+  // PRODUCER: publishes the slot returned by reserve() to the consumer.
+  RING_BUFFER_ISR_INLINE void commit() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // PRODUCER: asks the consumer to discard every entry committed so far, the
+  // entry currently held by the consumer (if any) is not interrupted.
+  void requestDrain() {
+    _drainTo.store(_head.load(std::memory_order_relaxed), std::memory_order_release);
+  }
+
+  // CONSUMER: returns the oldest committed entry or nullptr if the ring is
+  // empty. The entry remains owned by the consumer until pop() is called.
+  RING_BUFFER_ISR_INLINE T *peek() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    const uint32_t drainTo = _drainTo.load(std::memory_order_acquire);
+    if((int32_t)(drainTo - tail) > 0) {
+      tail = drainTo;
+      _tail.store(tail, std::memory_order_release);
+    }
+    if((int32_t)(_cachedHead - tail) <= 0) {
+      _cachedHead = _head.load(std::memory_order_acquire);
+      if((int32_t)(_cachedHead - tail) <= 0) {
+        return nullptr;
+      }
+    }
+    return &_buffer[tail & _mask];
+  }
+
+  // CONSUMER: releases the entry returned by peek() back to the producer.
+  RING_BUFFER_ISR_INLINE void pop() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // returns the committed entry at the given offset from the oldest entry,
+  // this is only safe when the producer and consumer are the same context.
+  T *at(uint32_t offset) {
+    return &_buffer[(_tail.load(std::memory_order_relaxed) + offset) & _mask];
+  }
+
+  // discards all entries, this is only safe when the consumer is not running.
+  void clear() {
+    const uint32_t head = _head.load(std::memory_order_acquire);
+    _drainTo.store(head, std::memory_order_relaxed);
+    _tail.store(head, std::memory_order_release);
+    _cachedHead = head;
+    _cachedTail = head;
+  }
+private:
+  static uint32_t roundUpToPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while(result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+  const uint32_t _mask;
+  T * const _buffer;
+
+  // producer owned
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _drainTo{0};
+  uint32_t _cachedTail{0};
+
+  // consumer owned
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail{0};
+  uint32_t _cachedHead{0};
+};
@@ -94,8 +94,8 @@ private:
 
 class S88BusCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String>);
-  String getID() {
+  void process(const DCCPPProtocolArguments &);
+  const char *getID() {
     return "S88";
   }
 };
@@ -51,9 +51,9 @@ protected:
       _lastState = state;
       log_i("Sensor: %d :: %s", _sensorID, _lastState ? "ACTIVE" : "INACTIVE");
       if(state) {
-        wifiInterface.printf(F("<Q %d>"), _sensorID);
+        wifiInterface.broadcastf(F("<Q %d>"), _sensorID);
       } else {
-        wifiInterface.printf(F("<q %d>"), _sensorID);
+        wifiInterface.broadcastf(F("<q %d>"), _sensorID);
       }
     }
   }
@@ -85,8 +85,8 @@ private:
 
 class SensorCommandAdapter : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String>);
-  String getID() {
+  void process(const DCCPPProtocolArguments &);
+  const char *getID() {
     return "S";
   }
 };
@@ -31,11 +31,9 @@ public:
     InfoScreen::replaceLine(INFO_SCREEN_WS_CLIENTS_LINE, F("WS Clients: 0"));
 #endif
   }
-  void broadcastToWS(const String &buf) {
-    webSocket.textAll(buf);
-  }
 private:
   AsyncWebSocket webSocket;
+  void queueProgrammerJob(AsyncWebServerRequest *, std::function<int(JsonObject &)>);
   void handleESPInfo(AsyncWebServerRequest *);
   void handleProgrammer(AsyncWebServerRequest *);
   void handlePower(AsyncWebServerRequest *);
@@ -26,8 +26,13 @@ public:
 	void update();
 	void showConfiguration();
 	void showInitInfo();
+	// sends a response to the client whose command is being processed by the
+	// calling task, or to all clients if there is none.
 	void send(const String &);
 	void printf(const __FlashStringHelper *fmt, ...);
+	// sends a state change event to all clients.
+	void broadcast(const String &);
+	void broadcastf(const __FlashStringHelper *fmt, ...);
 };
 
 extern WiFiInterface wifiInterface;
@@ -37,6 +37,9 @@ String JSON_IDLE_NODE PROGMEM = "idle";
 
 String JSON_IDLE_ON_STARTUP_NODE PROGMEM = "idleOnStartup";
 String JSON_DEFAULT_ON_THROTTLE_NODE PROGMEM = "defaultOnThrottles";
+String JSON_ACCELERATION_NODE PROGMEM = "acceleration";
+String JSON_BRAKING_NODE PROGMEM = "braking";
+String JSON_TARGET_SPEED_NODE PROGMEM = "targetSpeed";
 
 String JSON_FUNCTIONS_NODE PROGMEM = "functions";
 String JSON_LOCOS_NODE PROGMEM = "locos";
@@ -125,41 +128,22 @@ void ConfigurationManager::clear() {
 
 JsonObject &ConfigurationManager::load(const String &name) {
   log_i("Loading /DCCppESP32/%s", name.c_str());
-  bool restartDCC = false;
-  if(isDCCSignalEnabled()) {
-    stopDCCSignalGenerators();
-    restartDCC = true;
-  }
   File configFile = SPIFFS.open("/DCCppESP32/" + name, FILE_READ);
   jsonConfigBuffer.clear();
   JsonObject &root = jsonConfigBuffer.parseObject(configFile);
   configFile.close();
-  if(restartDCC) {
-    startDCCSignalGenerators();
-  }
   return root;
 }
 
 void ConfigurationManager::store(const String &name, const JsonObject &json) {
   log_i("Storing /DCCppESP32/%s", name.c_str());
-  bool restartDCC = false;
-  if(isDCCSignalEnabled()) {
-    stopDCCSignalGenerators();
-    restartDCC = true;
-  }
   File configFile = SPIFFS.open("/DCCppESP32/" + name, FILE_WRITE);
   if(!configFile) {
     log_e("Failed to open /DCCppESP32/%s", name.c_str());
-    if(restartDCC) {
-      startDCCSignalGenerators();
-    }
     return;
   }
   json.printTo(configFile);
   configFile.close();
-  if(restartDCC) {
-    startDCCSignalGenerators();
-  }
 }
 
 JsonObject &ConfigurationManager::createRootNode(bool clearBuffer) {
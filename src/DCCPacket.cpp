@@ -0,0 +1,80 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "DCCPacket.h"
+
+bool encodeDCCPacket(Packet &packet, const uint8_t *data, uint8_t length, uint8_t repeats) {
+  if(length == 0 || length > MAX_DCC_PAYLOAD_BYTES) {
+    return false;
+  }
+  // the first two bytes of the preamble are all ones, the remaining six
+  // preamble bits are shifted in ahead of the first payload byte.
+  packet.buffer[0] = 0xFF;
+  packet.buffer[1] = 0xFF;
+  uint32_t bits = 0x3F;
+  uint8_t pendingBits = DCC_PREAMBLE_BITS - 16;
+  uint8_t index = 2;
+  uint8_t checksum = 0;
+  for(uint8_t payloadIndex = 0; payloadIndex <= length; payloadIndex++) {
+    uint8_t value = checksum;
+    if(payloadIndex < length) {
+      value = data[payloadIndex];
+      checksum ^= value;
+    }
+    // zero bit followed by the eight data bits
+    bits = (bits << 9) | value;
+    pendingBits += 9;
+    while(pendingBits >= 8) {
+      pendingBits -= 8;
+      packet.buffer[index++] = bits >> pendingBits;
+    }
+  }
+  if(pendingBits) {
+    packet.buffer[index++] = bits << (8 - pendingBits);
+  }
+  while(index < MAX_BYTES_IN_PACKET) {
+    packet.buffer[index++] = 0;
+  }
+  packet.numberOfBits = dccPacketBits(length);
+  packet.numberOfRepeats = repeats;
+  packet.currentBit = 0;
+  packet.queuedAt = 0;
+  packet.supersedeKey = 0;
+  packet.completionTask = nullptr;
+  return true;
+}
+
+uint16_t getDCCPacketAddressKey(const Packet &packet) {
+  // the first payload byte starts at bit 23 of the encoded packet and the
+  // second payload byte occupies all of buffer[4].
+  const uint8_t first = (packet.buffer[2] << 7) | (packet.buffer[3] >> 1);
+  const uint8_t second = packet.buffer[4];
+  if(first == 0x00 || first == 0xFF) {
+    // broadcast or idle packet
+    return 0;
+  } else if(first < 0x80) {
+    // short address
+    return first;
+  } else if(first < 0xC0) {
+    // accessory decoder, the upper address bits are in the second byte
+    return (first << 8) | (second & 0x70);
+  } else if(first < 0xE8) {
+    // long address
+    return (first << 8) | second;
+  }
+  return first << 8;
+}
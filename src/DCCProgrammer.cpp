@@ -27,6 +27,51 @@ static constexpr uint8_t PROG_TRACK_CV_ATTEMPTS = 3;
 // flag for when programming track is actively being used
 bool progTrackBusy = false;
 
+QueueHandle_t ProgTrackManager::_jobQueue;
+SemaphoreHandle_t ProgTrackManager::_freeSlots;
+TaskHandle_t ProgTrackManager::_taskHandle;
+
+void ProgTrackManager::init() {
+  _jobQueue = xQueueCreate(PROG_TRACK_JOB_QUEUE_SIZE, sizeof(ProgTrackJob *));
+  _freeSlots = xSemaphoreCreateCounting(PROG_TRACK_JOB_QUEUE_SIZE, PROG_TRACK_JOB_QUEUE_SIZE);
+  xTaskCreate(progTrackTask, "ProgTrack", PROG_TRACK_TASK_STACK_SIZE, NULL, DEFAULT_THREAD_PRIO, &_taskHandle);
+}
+
+bool ProgTrackManager::queue(ProgTrackJob job, std::function<void()> accepted) {
+  if(xSemaphoreTake(_freeSlots, 0) != pdTRUE) {
+    log_w("[PROG] job queue is full, rejecting request");
+    return false;
+  }
+  // the job runs as the client which queued it so any responses it sends via
+  // wifiInterface are routed back to that client.
+  const uint32_t clientID = DCCPPProtocolConsumer::getActiveClientID();
+  auto queuedJob = new ProgTrackJob([clientID, job](bool energized) {
+    DCCPPProtocolConsumer::setActiveClientID(clientID);
+    job(energized);
+    DCCPPProtocolConsumer::setActiveClientID(0);
+  });
+  if(accepted) {
+    accepted();
+  }
+  // the reserved slot guarantees there is room in the queue
+  xQueueSend(_jobQueue, &queuedJob, portMAX_DELAY);
+  log_v("[PROG] %d job(s) waiting", uxQueueMessagesWaiting(_jobQueue));
+  return true;
+}
+
+void ProgTrackManager::progTrackTask(void *param) {
+  ProgTrackJob *job;
+  while(true) {
+    if(xQueueReceive(_jobQueue, &job, portMAX_DELAY) == pdTRUE) {
+      xSemaphoreGive(_freeSlots);
+      const bool energized = enterProgrammingMode();
+      (*job)(energized);
+      leaveProgrammingMode();
+      delete job;
+    }
+  }
+}
+
 bool enterProgrammingMode() {
   const auto motorBoard = MotorBoardManager::getBoardByName(MOTORBOARD_NAME_PROG);
   const uint16_t milliAmpStartupLimit = (4096 * 100 / motorBoard->getMaxMilliAmps());
@@ -84,8 +129,10 @@ int16_t readCV(const uint16_t cv) {
     log_i("[PROG %d/%d] Attempting to read CV %d", attempt+1, PROG_TRACK_CV_ATTEMPTS, cv);
     if(attempt) {
       log_v("[PROG] Resetting DCC Decoder");
-      signalGenerator->loadBytePacket(resetPacket, 2, 25);
-      signalGenerator->waitForQueueEmpty();
+      if(!signalGenerator->loadPacketAndWait(encodedResetPacket, 25)) {
+        log_w("[PROG] DCC Decoder reset packets were not sent");
+        continue;
+      }
     }
 
     // reset cvValue to all bits OFF
@@ -93,9 +140,13 @@ int16_t readCV(const uint16_t cv) {
     for(uint8_t bit = 0; bit < 8; bit++) {
       log_v("[PROG] CV %d, bit [%d/7]", cv, bit);
       readCVBitPacket[2] = 0xE8 + bit;
-      signalGenerator->loadBytePacket(resetPacket, 2, 3);
-      signalGenerator->loadBytePacket(readCVBitPacket, 3, 5);
-      signalGenerator->waitForQueueEmpty();
+      signalGenerator->loadPacket(encodedResetPacket, 3);
+      if(!signalGenerator->loadBytePacketAndWait(readCVBitPacket, 3, 5)) {
+        // the bit was never requested so there is no ACK to sample
+        log_w("[PROG] CV %d, bit [%d/7] packet was not sent", cv, bit);
+        cvValue = -1;
+        break;
+      }
       if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
         log_v("[PROG] CV %d, bit [%d/7] ON", cv, bit);
         bitWrite(cvValue, bit, 1);
@@ -103,14 +154,16 @@ int16_t readCV(const uint16_t cv) {
         log_v("[PROG] CV %d, bit [%d/7] OFF", cv, bit);
       }
     }
+    if(cvValue == -1) {
+      continue;
+    }
 
     // verify the byte we received
     verifyCVPacket[2] = cvValue & 0xFF;
     log_i("[PROG %d/%d] Attempting to verify read of CV %d as %d", attempt+1, PROG_TRACK_CV_ATTEMPTS, cv, cvValue);
-    signalGenerator->loadBytePacket(resetPacket, 2, 3);
-    signalGenerator->loadBytePacket(verifyCVPacket, 3, 5);
-    signalGenerator->waitForQueueEmpty();
-    if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
+    signalGenerator->loadPacket(encodedResetPacket, 3);
+    if(signalGenerator->loadBytePacketAndWait(verifyCVPacket, 3, 5) &&
+       motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
       log_i("[PROG] CV %d, verified as %d", cv, cvValue);
     } else {
       log_w("[PROG] CV %d, could not be verified", cv);
@@ -133,18 +186,17 @@ bool writeProgCVByte(const uint16_t cv, const uint8_t cvValue) {
     log_i("[PROG %d/%d] Attempting to write CV %d as %d", attempt, PROG_TRACK_CV_ATTEMPTS, cv, cvValue);
     if(attempt) {
       log_v("[PROG] Resetting DCC Decoder");
-      signalGenerator->loadBytePacket(resetPacket, 2, 25);
+      signalGenerator->loadPacket(encodedResetPacket, 25);
     }
-    signalGenerator->loadBytePacket(resetPacket, 2, 3);
-    signalGenerator->loadBytePacket(writeCVBytePacket, 3, 4);
-    signalGenerator->waitForQueueEmpty();
-
-    // verify that the decoder received the write byte packet and sent an ACK
-    if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
-      signalGenerator->loadBytePacket(verifyCVBytePacket, 3, 5);
-      signalGenerator->waitForQueueEmpty();
+    signalGenerator->loadPacket(encodedResetPacket, 3);
+
+    // verify that the decoder received the write byte packet and sent an ACK,
+    // packets which were not sent count as a failed attempt.
+    if(signalGenerator->loadBytePacketAndWait(writeCVBytePacket, 3, 4) &&
+       motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
       // check that decoder sends an ACK for the verify operation
-      if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
+      if(signalGenerator->loadBytePacketAndWait(verifyCVBytePacket, 3, 5) &&
+         motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
         writeVerified = true;
         log_i("[PROG] CV %d write value %d verified.", cv, cvValue);
       }
@@ -167,18 +219,17 @@ bool writeProgCVBit(const uint16_t cv, const uint8_t bit, const bool value) {
     log_d("[PROG %d/%d] Attempting to write CV %d bit %d as %d", attempt, PROG_TRACK_CV_ATTEMPTS, cv, bit, value);
     if(attempt) {
       log_v("[PROG] Resetting DCC Decoder");
-      signalGenerator->loadBytePacket(resetPacket, 2, 3);
+      signalGenerator->loadPacket(encodedResetPacket, 3);
     }
-    signalGenerator->loadBytePacket(writeCVBitPacket, 3, 4);
-    signalGenerator->waitForQueueEmpty();
-
-    // verify that the decoder received the write byte packet and sent an ACK
-    if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
-      signalGenerator->loadBytePacket(resetPacket, 2, 3);
-      signalGenerator->loadBytePacket(verifyCVBitPacket, 3, 5);
-      signalGenerator->waitForQueueEmpty();
+
+    // verify that the decoder received the write byte packet and sent an ACK,
+    // packets which were not sent count as a failed attempt.
+    if(signalGenerator->loadBytePacketAndWait(writeCVBitPacket, 3, 4) &&
+       motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
+      signalGenerator->loadPacket(encodedResetPacket, 3);
       // check that decoder sends an ACK for the verify operation
-      if(motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
+      if(signalGenerator->loadBytePacketAndWait(verifyCVBitPacket, 3, 5) &&
+         motorBoard->captureSample(CVSampleCount) > milliAmpAck) {
         writeVerified = true;
         log_i("[PROG %d/%d] CV %d write bit %d verified.", attempt, PROG_TRACK_CV_ATTEMPTS, cv, bit);
       }
@@ -50,87 +50,415 @@ bool isDCCSignalEnabled() {
 void sendDCCEmergencyStop() {
   for(auto generator : dccSignal) {
     if(generator->isEnabled()) {
-      generator->loadBytePacket(eStopPacket, 2, 0, true);
+      generator->startEmergencyStop();
     }
   }
 }
 
-void SignalGenerator::loadBytePacket(const uint8_t *data, uint8_t length, uint8_t repeatCount, bool drainToSendQueue) {
-  std::vector<uint8_t> packet;
-  for(int i = 0; i < length; i++) {
-    packet.push_back(data[i]);
+void clearDCCEmergencyStop() {
+  for(auto generator : dccSignal) {
+    if(generator->isEmergencyStopActive()) {
+      generator->clearEmergencyStop();
+    }
+  }
+}
+
+void SignalGenerator::loadBytePacket(const uint8_t *data, uint8_t length, uint8_t repeatCount, bool drainToSendQueue, DCC_PACKET_PRIORITY priority) {
+  Packet packet;
+  if(!encodeDCCPacket(packet, data, length, repeatCount)) {
+    log_e("[%s] Unable to encode packet with %d bytes", _name.c_str(), length);
+    return;
+  }
+  // service mode packets on the programming track do not carry a decoder
+  // address and must never be replaced.
+  if(_signalID == DCC_SIGNAL_OPERATIONS) {
+    packet.supersedeKey = getSupersedeKey(data, length);
   }
-  loadPacket(packet, repeatCount, drainToSendQueue);
+  loadPacket(packet, repeatCount, drainToSendQueue, priority);
 }
 
-void SignalGenerator::loadPacket(std::vector<uint8_t> data, int numberOfRepeats, bool drainToSendQueue) {
+bool SignalGenerator::loadBytePacketAndWait(const uint8_t *data, uint8_t length, uint8_t repeatCount) {
+  Packet packet;
+  if(!encodeDCCPacket(packet, data, length, repeatCount)) {
+    log_e("[%s] Unable to encode packet with %d bytes", _name.c_str(), length);
+    return false;
+  }
+  return loadPacketAndWait(packet, repeatCount);
+}
+
+// queues the packet and blocks the calling task until the ISR has sent the
+// final repeat of the packet. Returns false if the packet was not sent within
+// DCC_PACKET_COMPLETION_TIMEOUT_MS (ie: it was discarded by drainQueue).
+// NOTE: with the RMT signal generator the notification is raised when the
+// final bit is copied to the RMT memory which is up to two halves of the RMT
+// memory ahead of the bit currently on the rails.
+bool SignalGenerator::loadPacketAndWait(const Packet &encodedPacket, uint8_t numberOfRepeats) {
+  Packet packet = encodedPacket;
+  packet.completionTask = xTaskGetCurrentTaskHandle();
+  // clear any stale notification before queueing the packet
+  ulTaskNotifyTake(pdTRUE, 0);
+  loadPacket(packet, numberOfRepeats);
+  if(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DCC_PACKET_COMPLETION_TIMEOUT_MS)) == 0) {
+    log_w("[%s] Timeout waiting for packet to be sent", _name.c_str());
+    return false;
+  }
+  return true;
+}
+
+void SignalGenerator::loadPacket(const Packet &encodedPacket, uint8_t numberOfRepeats, bool drainToSendQueue, DCC_PACKET_PRIORITY priority) {
+  if(_emergencyStop) {
+    // the ISR is sending eStop packets and is not consuming the queue
+    log_v("[%s] Discarding packet, emergency stop is active", _name.c_str());
+    return;
+  }
   if(drainToSendQueue) {
     drainQueue();
   }
-  log_v("[%s] queue: %d / %d", _name.c_str(), _toSend.size(), _availablePackets.size());
-  while(_availablePackets.empty()) {
+  MUTEX_LOCK(_producerLock);
+  if(enqueuePacket(encodedPacket, numberOfRepeats, priority)) {
+    // hand the packet to the ISR right away if there is room for it
+    fillWireQueue();
+  }
+  MUTEX_UNLOCK(_producerLock);
+}
+
+// queues all of the packets without any other producer packets in between,
+// when the queue does not have room for the whole batch this waits for the
+// feeder task to make room before queueing any of them.
+void SignalGenerator::loadPacketBatch(const Packet *encodedPackets, uint8_t count, DCC_PACKET_PRIORITY priority) {
+  if(_emergencyStop) {
+    log_v("[%s] Discarding %d packets, emergency stop is active", _name.c_str(), count);
+    return;
+  }
+  MUTEX_LOCK(_producerLock);
+  auto queue = _queues[priority];
+  const uint32_t required = std::min<uint32_t>(count, queue->capacity());
+  bool queueFull = false;
+  while(queue->capacity() - queue->size() < required) {
+    if(!queueFull) {
+      _telemetry.queueFull++;
+      queueFull = true;
+    }
+    MUTEX_UNLOCK(_producerLock);
     delay(2);
+    MUTEX_LOCK(_producerLock);
   }
-  Packet *packet = _availablePackets.front();
-  _availablePackets.pop();
+  bool queued = false;
+  for(uint8_t index = 0; index < count; index++) {
+    queued |= enqueuePacket(encodedPackets[index], encodedPackets[index].numberOfRepeats, priority);
+  }
+  if(queued) {
+    fillWireQueue();
+  }
+  MUTEX_UNLOCK(_producerLock);
+}
 
+// adds the packet to the priority queue (or replaces a superseded packet), the
+// caller must hold _producerLock. Returns true if a new entry was queued.
+bool SignalGenerator::enqueuePacket(const Packet &encodedPacket, uint8_t numberOfRepeats, DCC_PACKET_PRIORITY priority) {
+  auto queue = _queues[priority];
+  log_v("[%s] queue(%d): %d / %d", _name.c_str(), priority, queue->size(), queue->capacity());
+  // if an older packet for the same address and instruction is still queued
+  // in this (or a higher) priority class it is updated in place.
+  Packet *packet = findSupersededPacket(encodedPacket.supersedeKey, priority);
+  const bool replaced = packet != nullptr;
+  bool queueFull = false;
+  while(packet == nullptr) {
+    packet = queue->reserve();
+    if(packet == nullptr) {
+      if(!queueFull) {
+        _telemetry.queueFull++;
+        queueFull = true;
+      }
+      // the feeder task needs the lock to make room in the queue
+      MUTEX_UNLOCK(_producerLock);
+      delay(2);
+      MUTEX_LOCK(_producerLock);
+    }
+  }
+
+  if(replaced) {
+    // the packet keeps its original position (and queued time) in the queue
+    const uint32_t queuedAt = packet->queuedAt;
+    *packet = encodedPacket;
+    packet->queuedAt = queuedAt;
+  } else {
+    *packet = encodedPacket;
+    packet->queuedAt = esp_timer_get_time();
+  }
   packet->numberOfRepeats = numberOfRepeats;
   packet->currentBit = 0;
+  if(!replaced) {
+    queue->commit();
+    _queuedPackets++;
+    if(_queuedPackets > _telemetry.queuedHighWater) {
+      _telemetry.queuedHighWater = _queuedPackets;
+    }
+    if(queue->size() > _queueStatus[priority].maxDepth) {
+      _queueStatus[priority].maxDepth = queue->size();
+    }
+  }
+  return !replaced;
+}
 
-  // calculate checksum (XOR)
-  // add first byte as checksum byte
-  uint8_t checksum = data[0];
-  for(int i = 1; i < data.size(); i++) {
-    checksum ^= data[i];
-  }
-  data.push_back(checksum);
-
-  // standard DCC preamble
-  packet->buffer[0] = 0xFF;
-  packet->buffer[1] = 0xFF;
-  // first bit of actual data at the end of the preamble
-  packet->buffer[2] = 0xFC + bitRead(data[0], 7);
-  packet->buffer[3] = data[0] << 1;
-  packet->buffer[4] = data[1];
-  packet->buffer[5] = data[2] >> 1;
-  packet->buffer[6] = data[2] << 7;
-
-  if(data.size() == 3) {
-    packet->numberOfBits = 49;
-  } else{
-    packet->buffer[6] += data[3] >> 2;
-    packet->buffer[7] = data[3] << 6;
-    if(data.size() == 4) {
-      packet->numberOfBits = 58;
-    } else{
-      packet->buffer[7] += data[4] >> 3;
-      packet->buffer[8] = data[4] << 5;
-      if(data.size() == 5) {
-        packet->numberOfBits = 67;
-      } else{
-        packet->buffer[8] += data[5] >> 4;
-        packet->buffer[9] = data[5] << 4;
-        packet->numberOfBits = 76;
-      } // >5 bytes
-    } // >4 bytes
-  } // >3 bytes
-
-  lockSendQueue();
-  _toSend.push(packet);
-  unlockSendQueue();
-}
-
-SignalGenerator::SignalGenerator(String name, uint16_t maxPackets, uint8_t signalID, uint8_t signalPin) : _name(name), _signalID(signalID) {
-  log_i("[%s] Configuring signal pin %d", _name.c_str(), signalPin);
-  pinMode(signalPin, INPUT);
-  digitalWrite(signalPin, LOW);
-  pinMode(signalPin, OUTPUT);
-
-  // create packets for this signal generator up front, they will be reused until
-  // the command station is shutdown
-  for(int index = 0; index < maxPackets; index++) {
-    _availablePackets.push(new Packet());
+// returns a key identifying the decoder address and instruction type of a
+// multi-function decoder speed or function packet, all other packets return
+// zero as they must always be sent.
+uint32_t SignalGenerator::getSupersedeKey(const uint8_t *data, uint8_t length) {
+  uint16_t address;
+  uint8_t instructionIndex;
+  if(data[0] >= 1 && data[0] <= 127) {
+    // short address
+    address = data[0];
+    instructionIndex = 1;
+  } else if(data[0] >= 0xC0 && data[0] <= 0xE7) {
+    // long address
+    address = ((data[0] & 0x3F) << 8) | data[1];
+    instructionIndex = 2;
+  } else {
+    // broadcast, accessory or idle packet
+    return 0;
+  }
+  if(length <= instructionIndex) {
+    return 0;
+  }
+  uint8_t instruction = data[instructionIndex];
+  uint8_t instructionType;
+  if(instruction == 0x3F) {
+    // 128 speed step control
+    instructionType = 0x3F;
+  } else if((instruction & 0xC0) == 0x40) {
+    // 14/28 speed step control (both directions share the same key)
+    instructionType = 0x40;
+  } else if((instruction & 0xE0) == 0x80 || (instruction & 0xF0) == 0xB0 ||
+            (instruction & 0xF0) == 0xA0) {
+    // function group one (F0-F4) and two (F5-F8, F9-F12)
+    instructionType = (instruction & 0xE0) == 0x80 ? 0x80 : instruction & 0xF0;
+  } else if(instruction == 0xDE || instruction == 0xDF) {
+    // feature expansion (F13-F20, F21-F28)
+    instructionType = instruction;
+  } else {
+    // CV access, consist control, etc
+    return 0;
+  }
+  // bit 31 is set so a key is never zero
+  return 0x80000000 | (address << 8) | instructionType;
+}
+
+// searches the priority queues for a queued packet with the same key. A match
+// in the same or a higher priority class is returned so it can be updated in
+// place, a match in a lower priority class is dropped as the new packet will
+// be sent first. _producerLock must be held.
+Packet *SignalGenerator::findSupersededPacket(uint32_t supersedeKey, DCC_PACKET_PRIORITY priority) {
+  if(supersedeKey == 0) {
+    return nullptr;
+  }
+  for(uint8_t queuePriority = 0; queuePriority < MAX_DCC_PACKET_PRIORITY; queuePriority++) {
+    auto queue = _queues[queuePriority];
+    for(uint32_t index = 0; index < queue->size(); index++) {
+      Packet *packet = queue->at(index);
+      if(packet->supersedeKey == supersedeKey) {
+        _queueStatus[queuePriority].replaced++;
+        if(queuePriority <= priority) {
+          return packet;
+        }
+        // mark the packet as dropped, it will be discarded by fillWireQueue
+        packet->supersedeKey = 0;
+        packet->numberOfBits = 0;
+      }
+    }
   }
+  return nullptr;
+}
+
+// moves packets from the priority queues to the ISR until it has
+// DCC_WIRE_QUEUE_DEPTH packets pending, _producerLock must be held.
+void SignalGenerator::fillWireQueue() {
+  // service mode packets on the PROG track must be repeated back to back, on
+  // the OPS track each repeat of a packet addressed to a decoder (speed,
+  // function, accessory or CV access) is sent as a separate packet after the
+  // packets already queued in the same class. Reset, idle and broadcast
+  // packets have no decoder address and are repeated back to back so the
+  // power-on sequence is sent as S-9.2.4 requires.
+  const bool interleaveRepeats = _signalID == DCC_SIGNAL_OPERATIONS;
+  while(_queuedPackets) {
+    WirePacket *slot = _toSend.reserve();
+    if(slot == nullptr) {
+      return;
+    }
+    DCC_PACKET_PRIORITY priority = nextPriority();
+    if(_queues[priority]->peek()->numberOfBits == 0) {
+      // the packet was replaced by a newer packet in a higher priority class
+      _queues[priority]->pop();
+      _queuedPackets--;
+      continue;
+    }
+    if(interleaveRepeats) {
+      priority = spacePackets(priority);
+      if(_lastAddressKey && priority != DCC_PACKET_PRIORITY_EMERGENCY && !_toSend.empty() &&
+         getDCCPacketAddressKey(*_queues[priority]->peek()) == _lastAddressKey) {
+        // only the decoder which received the previous packet has packets
+        // queued, they stay queued until the ISR has sent that packet so
+        // packets for other decoders queued meanwhile (or an idle packet) go
+        // in between. Refresh packets are not pulled as they may be for the
+        // same decoder.
+        return;
+      }
+    }
+    auto queue = _queues[priority];
+    Packet *packet = queue->peek();
+    static_cast<Packet &>(*slot) = *packet;
+    const uint32_t now = esp_timer_get_time();
+    const uint32_t wait = now - slot->queuedAt;
+    if(wait > _queueStatus[priority].maxWait) {
+      _queueStatus[priority].maxWait = wait;
+    }
+    if(interleaveRepeats && packet->numberOfRepeats && getDCCPacketAddressKey(*packet)) {
+      // move the packet to the back of its queue with one less repeat, only
+      // the final copy notifies the completion task.
+      Packet repeat = *packet;
+      repeat.numberOfRepeats--;
+      repeat.queuedAt = now;
+      slot->numberOfRepeats = 0;
+      slot->completionTask = nullptr;
+      queue->pop();
+      *queue->reserve() = repeat;
+      queue->commit();
+    } else {
+      queue->pop();
+      _queuedPackets--;
+      _queueStatus[priority].sent++;
+    }
+    _lastAddressKey = getDCCPacketAddressKey(*slot);
+    renderHalfBitDurations(*slot);
+    // publish the packet to the ISR
+    _toSend.commit();
+  }
+  // nothing else is queued, top up the wire queue from the refresh source
+  // instead of letting the ISR fall back to idle packets.
+  if(_refreshSource != nullptr && !_emergencyStop && _toSend.size() < DCC_REFRESH_PULL_DEPTH) {
+    WirePacket *slot = _toSend.reserve();
+    if(slot != nullptr && _refreshSource->getRefreshPacket(*slot)) {
+      slot->numberOfRepeats = 0;
+      slot->currentBit = 0;
+      slot->queuedAt = esp_timer_get_time();
+      slot->completionTask = nullptr;
+      _lastAddressKey = getDCCPacketAddressKey(*slot);
+      renderHalfBitDurations(*slot);
+      _toSend.commit();
+    }
+  }
+}
+
+// S-9.2.4 recommends at least 5ms between packets to the same decoder, as
+// even the shortest packet takes longer than that to send it is enough to
+// avoid sending two packets to the same decoder back to back. When the next
+// packet of the selected class is for the same decoder as the previous packet
+// the next packet of another class (for a different decoder) is used instead.
+// If no other class has such a packet the selected class is returned and
+// fillWireQueue holds the packet back until the previous one has been sent.
+// Emergency packets are never delayed.
+DCC_PACKET_PRIORITY SignalGenerator::spacePackets(DCC_PACKET_PRIORITY priority) {
+  if(priority == DCC_PACKET_PRIORITY_EMERGENCY || _lastAddressKey == 0 ||
+     getDCCPacketAddressKey(*_queues[priority]->peek()) != _lastAddressKey) {
+    return priority;
+  }
+  for(uint8_t index = DCC_PACKET_PRIORITY_INTERACTIVE; index < MAX_DCC_PACKET_PRIORITY; index++) {
+    if(index == priority || _queues[index]->empty()) {
+      continue;
+    }
+    Packet *packet = _queues[index]->peek();
+    if(packet->numberOfBits && getDCCPacketAddressKey(*packet) != _lastAddressKey) {
+      return (DCC_PACKET_PRIORITY)index;
+    }
+  }
+  return priority;
+}
+
+// selects the queue to send the next packet from, there must be at least one
+// queued packet when this is called.
+DCC_PACKET_PRIORITY SignalGenerator::nextPriority() {
+  if(!_queues[DCC_PACKET_PRIORITY_EMERGENCY]->empty()) {
+    return DCC_PACKET_PRIORITY_EMERGENCY;
+  } else if(!_queues[DCC_PACKET_PRIORITY_INTERACTIVE]->empty()) {
+    return DCC_PACKET_PRIORITY_INTERACTIVE;
+  }
+  // weighted round robin between accessory and refresh packets, when the
+  // current class has no credit left (or no packets) switch to the other.
+  if(_weightedCredit == 0 || _queues[_weightedPriority]->empty()) {
+    DCC_PACKET_PRIORITY other = _weightedPriority == DCC_PACKET_PRIORITY_ACCESSORY ?
+      DCC_PACKET_PRIORITY_REFRESH : DCC_PACKET_PRIORITY_ACCESSORY;
+    // when the other class has nothing to send stay with the original class,
+    // either way the credit is reset to the weight of the selected class.
+    if(!_queues[other]->empty()) {
+      _weightedPriority = other;
+    }
+    _weightedCredit = _weightedPriority == DCC_PACKET_PRIORITY_ACCESSORY ?
+      DCC_ACCESSORY_PACKET_WEIGHT : DCC_REFRESH_PACKET_WEIGHT;
+  }
+  _weightedCredit--;
+  return _weightedPriority;
+}
+
+void SignalGenerator::feederTask(void *param) {
+  SignalGenerator *generator = static_cast<SignalGenerator *>(param);
+  while(true) {
+    // the ISR will wake us up when it is running low on packets
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    MUTEX_LOCK(generator->_producerLock);
+    generator->fillWireQueue();
+    MUTEX_UNLOCK(generator->_producerLock);
+  }
+}
+
+PacketQueueStatus SignalGenerator::getQueueStatus(DCC_PACKET_PRIORITY priority) {
+  MUTEX_LOCK(_producerLock);
+  PacketQueueStatus status = _queueStatus[priority];
+  status.depth = _queues[priority]->size();
+  status.capacity = _queues[priority]->capacity();
+  MUTEX_UNLOCK(_producerLock);
+  return status;
+}
+
+SignalGenerator::SignalGenerator(String name, uint16_t maxPackets, uint8_t signalID, uint8_t signalPin) :
+  _name(name), _signalID(signalID), _toSend(DCC_WIRE_QUEUE_DEPTH), _producerLock(xSemaphoreCreateMutex()) {
+  configureOutputPin(signalPin);
+  // emergency packets always drain the queues first so only a few are needed,
+  // the refresh queue gets half of the requested capacity and the remainder is
+  // split between interactive and accessory packets.
+  const uint16_t capacity[MAX_DCC_PACKET_PRIORITY] = {
+    4, // DCC_PACKET_PRIORITY_EMERGENCY
+    std::max<uint16_t>(maxPackets / 4, 4), // DCC_PACKET_PRIORITY_INTERACTIVE
+    std::max<uint16_t>(maxPackets / 4, 4), // DCC_PACKET_PRIORITY_ACCESSORY
+    std::max<uint16_t>(maxPackets / 2, 4) // DCC_PACKET_PRIORITY_REFRESH
+  };
+  for(uint8_t priority = 0; priority < MAX_DCC_PACKET_PRIORITY; priority++) {
+    _queues[priority] = new SPSCRingBuffer<Packet, InternalRAMAllocator>(capacity[priority]);
+    _queueStatus[priority] = {0, 0, 0, 0, 0, 0};
+    log_i("[%s] Packet queue(%d) capacity: %d", _name.c_str(), priority, _queues[priority]->capacity());
+  }
+  memset(&_telemetry, 0, sizeof(SignalGeneratorTelemetry));
+  static_cast<Packet &>(_idlePacket) = encodedIdlePacket;
+  renderHalfBitDurations(_idlePacket);
+  static_cast<Packet &>(_eStopPacket) = encodedEStopPacket;
+  renderHalfBitDurations(_eStopPacket);
+  xTaskCreate(feederTask, "DCCFeeder", DEFAULT_THREAD_STACKSIZE, this, DEFAULT_THREAD_PRIO + 1, &_feederTask);
+}
+
+void SignalGenerator::configureOutputPin(uint8_t pin) {
+  log_i("[%s] Configuring signal pin %d", _name.c_str(), pin);
+  pinMode(pin, INPUT);
+  digitalWrite(pin, LOW);
+  pinMode(pin, OUTPUT);
+  _outputPins.push_back(pin);
+}
+
+void SignalGenerator::addOutputPin(uint8_t pin) {
+  if(std::find(_outputPins.begin(), _outputPins.end(), pin) != _outputPins.end()) {
+    return;
+  }
+  configureOutputPin(pin);
+  attachOutputPin(pin);
 }
 
 void SignalGenerator::startSignal(bool sendIdlePackets) {
@@ -149,10 +477,10 @@ void SignalGenerator::startSignal(bool sendIdlePackets) {
   // at least 20 reset packets and 10 idle packets must be sent upon initialization
   // of the command station to force decoders to exit service mode.
   log_i("[%s] Adding reset packet (25 repeats) to packet queue", _name.c_str());
-  loadBytePacket(resetPacket, 2, 25);
+  loadPacket(encodedResetPacket, 25);
   if(sendIdlePackets) {
     log_i("[%s] Adding idle packet to packet queue", _name.c_str());
-    loadBytePacket(idlePacket, 2, 10);
+    loadPacket(encodedIdlePacket, 10);
   }
   enable();
   _enabled = true;
@@ -160,21 +488,13 @@ void SignalGenerator::startSignal(bool sendIdlePackets) {
 
 void SignalGenerator::stopSignal() {
   disable();
+  _enabled = false;
+  _emergencyStop = false;
 
-  // if we have a current packet being processed move it to the available
-  // queue if it is not the pre-canned idle packet.
-  if(_currentPacket != nullptr && _currentPacket != &_idlePacket) {
-    // make sure the packet is zeroed before pushing it back to the queue
-    memset(_currentPacket, 0, sizeof(Packet));
-    _availablePackets.push(_currentPacket);
-    _currentPacket = nullptr;
-  }
-
-  // drain any remaining packets that were not sent back into the available
-  // to use packets.
+  // the ISR is no longer running so any packet it was processing (which still
+  // lives in the queue) can be discarded along with all pending packets.
+  _currentPacket = nullptr;
   drainQueue();
-
-  _enabled = false;
 }
 
 void SignalGenerator::waitForQueueEmpty() {
@@ -184,7 +504,7 @@ void SignalGenerator::waitForQueueEmpty() {
 }
 
 bool SignalGenerator::isQueueEmpty() {
-  return _toSend.empty();
+  return _queuedPackets == 0 && _toSend.empty();
 }
 
 bool SignalGenerator::isEnabled() {
@@ -192,47 +512,142 @@ bool SignalGenerator::isEnabled() {
 }
 
 void SignalGenerator::drainQueue() {
-  // drain any pending packets before we start the signal so we start with an empty queue
   if(!isQueueEmpty()) {
-    // lock the queue so we can drain it
-    lockSendQueue();
+    MUTEX_LOCK(_producerLock);
     log_i("[%s] Draining packet queue", _name.c_str());
-    while(!isQueueEmpty()) {
-      _currentPacket = _toSend.front();
-      _toSend.pop();
-      // make sure the packet is zeroed before pushing it back to the queue
-      memset(_currentPacket, 0, sizeof(Packet));
-      _availablePackets.push(_currentPacket);
+    for(auto queue : _queues) {
+      queue->clear();
     }
-    // unlock the queue
-    unlockSendQueue();
+    _queuedPackets = 0;
+    if(_enabled) {
+      // the ISR owns the consumer side of the queue, ask it to discard all
+      // pending packets at the next packet boundary.
+      _toSend.requestDrain();
+    } else {
+      _toSend.clear();
+    }
+    MUTEX_UNLOCK(_producerLock);
+  }
+}
+
+void SignalGenerator::renderHalfBitDurations(WirePacket &packet) {
+  for(uint8_t index = 0; index < packet.numberOfBits; index++) {
+    packet.halfBitDurations[index] = (packet.buffer[index / 8] & DCC_PACKET_BIT_MASK[index % 8]) ?
+      DCC_ONE_BIT_PULSE_DURATION : DCC_ZERO_BIT_PULSE_DURATION;
   }
 }
 
-Packet *SignalGenerator::getPacket() {
+WirePacket IRAM_ATTR *SignalGenerator::getPacket() {
   if(_currentPacket != nullptr) {
     if(_currentPacket->currentBit >= _currentPacket->numberOfBits) {
-      if(_currentPacket->numberOfRepeats > 0) {
+      _telemetry.packets++;
+      _telemetry.bits += _currentPacket->numberOfBits;
+      if(_currentPacket == &_idlePacket) {
+        _telemetry.idlePackets++;
+        _telemetry.idleBits += _currentPacket->numberOfBits;
+      }
+      if(_currentPacket->numberOfRepeats > 0 && !_emergencyStop) {
         _currentPacket->numberOfRepeats--;
         _currentPacket->currentBit = 0;
       } else {
-        if(_currentPacket != &_idlePacket) {
-          _availablePackets.push(_currentPacket);
+        // the packet has been fully sent (or an emergency stop has cut short
+        // the remaining repeats), release it back to the queue
+        if(_currentPacket != &_idlePacket && _currentPacket != &_eStopPacket) {
+          TaskHandle_t completionTask = static_cast<TaskHandle_t>(_currentPacket->completionTask);
+          _toSend.pop();
+          if(completionTask != nullptr) {
+            BaseType_t higherPriorityTaskWoken = pdFALSE;
+            vTaskNotifyGiveFromISR(completionTask, &higherPriorityTaskWoken);
+            if(higherPriorityTaskWoken) {
+              portYIELD_FROM_ISR();
+            }
+          }
         }
         _currentPacket = nullptr;
       }
     }
   }
-  if(_currentPacket == nullptr) {
-    lockSendQueueISR();
-    if(isQueueEmpty()) {
+  if(_currentPacket == nullptr && _emergencyStop) {
+    if(_eStopRequestedAt) {
+      _telemetry.eStopLatency = esp_timer_get_time() - _eStopRequestedAt;
+      _eStopRequestedAt = 0;
+    }
+    _currentPacket = &_eStopPacket;
+    _currentPacket->currentBit = 0;
+  } else if(_currentPacket == nullptr) {
+    _currentPacket = _toSend.peek();
+    if((_queuedPackets || _refreshSource != nullptr) && _toSend.size() <= DCC_WIRE_QUEUE_LOW_WATER) {
+      // wake up the feeder task to move more packets from the priority queues
+      // (or pull a refresh packet)
+      BaseType_t higherPriorityTaskWoken = pdFALSE;
+      vTaskNotifyGiveFromISR(_feederTask, &higherPriorityTaskWoken);
+      if(higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+      }
+    }
+    if(_currentPacket == nullptr) {
       _currentPacket = &_idlePacket;
       _currentPacket->currentBit = 0;
     } else {
-      _currentPacket = _toSend.front();
-      _toSend.pop();
+      // record the time from the packet being queued to the first bit
+      const uint32_t latency = esp_timer_get_time() - _currentPacket->queuedAt;
+      uint8_t bucket = 0;
+      while(latency > DCC_LATENCY_HISTOGRAM_LIMITS[bucket]) {
+        bucket++;
+      }
+      _telemetry.latency[bucket]++;
     }
-    unlockSendQueueISR();
   }
   return _currentPacket;
 }
+
+void SignalGenerator::startEmergencyStop() {
+  log_i("[%s] Starting emergency stop", _name.c_str());
+  _eStopRequestedAt = esp_timer_get_time();
+  // set the flag before draining so no new packets are queued
+  _emergencyStop = true;
+  drainQueue();
+}
+
+void SignalGenerator::clearEmergencyStop() {
+  log_i("[%s] Clearing emergency stop", _name.c_str());
+  // discard anything that was queued while the emergency stop was starting
+  drainQueue();
+  _emergencyStop = false;
+}
+
+void SignalGenerator::toJson(JsonObject &json) {
+  SignalGeneratorTelemetry telemetry = getTelemetry();
+  json[JSON_NAME_NODE] = _name;
+  json[F("enabled")] = _enabled;
+  json[F("packets")] = telemetry.packets;
+  json[F("idlePackets")] = telemetry.idlePackets;
+  // ArduinoJson does not support 64 bit integers on the ESP32
+  json[F("bits")] = (double)telemetry.bits;
+  json[F("idleBits")] = (double)telemetry.idleBits;
+  json[F("queuedHighWater")] = telemetry.queuedHighWater;
+  json[F("queueFull")] = telemetry.queueFull;
+  json[F("eStopActive")] = isEmergencyStopActive();
+  json[F("eStopLatency")] = telemetry.eStopLatency;
+  json[F("isrCalls")] = telemetry.isrCalls;
+  json[F("isrCycles")] = (double)telemetry.isrCycles;
+  json[F("isrMaxCycles")] = telemetry.isrMaxCycles;
+  JsonArray &latency = json.createNestedArray(F("latency"));
+  for(uint8_t bucket = 0; bucket < DCC_LATENCY_HISTOGRAM_BUCKETS; bucket++) {
+    JsonObject &node = latency.createNestedObject();
+    node[F("limit")] = DCC_LATENCY_HISTOGRAM_LIMITS[bucket];
+    node[JSON_COUNT_NODE] = telemetry.latency[bucket];
+  }
+  JsonArray &queues = json.createNestedArray(F("queues"));
+  for(uint8_t priority = 0; priority < MAX_DCC_PACKET_PRIORITY; priority++) {
+    auto status = getQueueStatus((DCC_PACKET_PRIORITY)priority);
+    JsonObject &node = queues.createNestedObject();
+    node[F("priority")] = priority;
+    node[F("depth")] = status.depth;
+    node[F("capacity")] = status.capacity;
+    node[F("maxDepth")] = status.maxDepth;
+    node[F("maxWait")] = status.maxWait;
+    node[F("sent")] = status.sent;
+    node[F("replaced")] = status.replaced;
+  }
+}
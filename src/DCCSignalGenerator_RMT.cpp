@@ -0,0 +1,134 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "DCCppESP32.h"
+#include <driver/rmt.h>
+#include <soc/rmt_struct.h>
+#include <xtensa/core-macros.h>
+#include <driver/gpio.h>
+#include <rom/gpio.h>
+#include <soc/gpio_sig_map.h>
+
+// interrupt status bit raised when a channel has sent the configured number
+// of items (DCC_RMT_ITEMS_PER_HALF).
+#define RMT_TX_THRESHOLD_BIT(channel) (1 << (24 + channel))
+
+// the RMT peripheral has a single interrupt shared by all channels, it is
+// registered when the first signal generator is enabled.
+static rmt_isr_handle_t rmtISRHandle = nullptr;
+
+static void IRAM_ATTR signalGeneratorRMTISR(void *arg) {
+  const uint32_t status = RMT.int_st.val;
+  RMT.int_clr.val = status;
+  for(auto generator : dccSignal) {
+    auto rmtGenerator = reinterpret_cast<SignalGenerator_RMT *>(generator);
+    if(status & RMT_TX_THRESHOLD_BIT(rmtGenerator->_channel)) {
+      const uint32_t start = xthal_get_ccount();
+      // the half of the RMT memory that was just sent is refilled while the
+      // RMT peripheral sends the other half.
+      rmtGenerator->fillItems(rmtGenerator->_refillOffset, DCC_RMT_ITEMS_PER_HALF);
+      rmtGenerator->_refillOffset ^= DCC_RMT_ITEMS_PER_HALF;
+      rmtGenerator->recordISRCycles(xthal_get_ccount() - start);
+    }
+  }
+}
+
+SignalGenerator_RMT::SignalGenerator_RMT(String name, uint16_t maxPackets, uint8_t signalID, uint8_t signalPin) :
+    SignalGenerator(name, maxPackets, signalID, signalPin),
+    // each channel uses DCC_RMT_MEMORY_BLOCKS memory blocks which are taken
+    // from the following channel(s) so the channels are spaced accordingly.
+    _channel((rmt_channel_t)(signalID * DCC_RMT_MEMORY_BLOCKS)), _pin(signalPin) {
+}
+
+void IRAM_ATTR SignalGenerator_RMT::fillItems(uint16_t offset, uint16_t count) {
+  const uint16_t end = offset + count;
+  uint16_t index = offset;
+  while(index < end) {
+    // getPacket() is only called at packet boundaries (or once per refill when
+    // a packet spans the refill), the bits of the packet are written directly.
+    auto pkt = getPacket();
+    uint8_t position = pkt->currentBit;
+    while(position < pkt->numberOfBits && index < end) {
+      if(pkt->buffer[position / 8] & DCC_PACKET_BIT_MASK[position % 8]) {
+        RMTMEM.chan[_channel].data32[index].val = DCC_RMT_ONE_BIT;
+      } else {
+        RMTMEM.chan[_channel].data32[index].val = DCC_RMT_ZERO_BIT;
+      }
+      position++;
+      index++;
+    }
+    pkt->currentBit = position;
+  }
+}
+
+void SignalGenerator_RMT::enable() {
+  log_i("[%s] Configuring RMT(%d) for generating DCC Signal", _name.c_str(), _channel);
+  rmt_config_t config;
+  config.rmt_mode = RMT_MODE_TX;
+  config.channel = _channel;
+  config.gpio_num = (gpio_num_t)_pin;
+  config.mem_block_num = DCC_RMT_MEMORY_BLOCKS;
+  config.clk_div = DCC_RMT_CLOCK_DIVIDER;
+  config.tx_config.loop_en = false;
+  config.tx_config.carrier_en = false;
+  config.tx_config.carrier_freq_hz = 0;
+  config.tx_config.carrier_duty_percent = 0;
+  config.tx_config.carrier_level = RMT_CARRIER_LEVEL_LOW;
+  config.tx_config.idle_output_en = true;
+  config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+  ESP_ERROR_CHECK(rmt_config(&config));
+  // any additional output pins are connected to the same RMT channel output
+  for(auto pin : _outputPins) {
+    if(pin != _pin) {
+      attachOutputPin(pin);
+    }
+  }
+
+  if(rmtISRHandle == nullptr) {
+    log_i("[%s] Attaching interrupt handler to RMT", _name.c_str());
+    ESP_ERROR_CHECK(rmt_isr_register(signalGeneratorRMTISR, nullptr, ESP_INTR_FLAG_IRAM, &rmtISRHandle));
+  }
+
+  // the channel memory is used as a circular buffer, when the end of the
+  // memory is reached the RMT peripheral wraps back to the start.
+  RMT.apb_conf.mem_tx_wrap_en = 1;
+
+  // prime both halves of the channel memory before starting, after this the
+  // ISR refills one half every DCC_RMT_ITEMS_PER_HALF bits.
+  _refillOffset = 0;
+  fillItems(0, DCC_RMT_ITEMS_PER_HALF * 2);
+
+  log_i("[%s] Enabling RMT(%d) threshold interrupt every %d bits", _name.c_str(), _channel, DCC_RMT_ITEMS_PER_HALF);
+  ESP_ERROR_CHECK(rmt_set_tx_thr_intr_en(_channel, true, DCC_RMT_ITEMS_PER_HALF));
+  ESP_ERROR_CHECK(rmt_tx_start(_channel, true));
+}
+
+void SignalGenerator_RMT::attachOutputPin(uint8_t pin) {
+  log_i("[%s] Routing RMT(%d) to pin %d", _name.c_str(), _channel, pin);
+  PIN_FUNC_SELECT(GPIO_PIN_MUX_REG[pin], PIN_FUNC_GPIO);
+  gpio_set_direction((gpio_num_t)pin, GPIO_MODE_OUTPUT);
+  gpio_matrix_out(pin, RMT_SIG_OUT0_IDX + _channel, false, false);
+}
+
+void SignalGenerator_RMT::disable() {
+  log_i("[%s] Shutting down RMT(%d)", _name.c_str(), _channel);
+  rmt_set_tx_thr_intr_en(_channel, false, DCC_RMT_ITEMS_PER_HALF);
+  rmt_tx_stop(_channel);
+
+  // give enough time for any RMT ISR calls to complete before proceeding
+  delay(250);
+}
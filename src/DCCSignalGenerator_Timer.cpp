@@ -19,39 +19,136 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #include <esp32-hal-timer.h>
 #include <driver/adc.h>
 #include <esp_adc_cal.h>
+#include <soc/timer_group_struct.h>
+#include <soc/gpio_struct.h>
+#include <xtensa/core-macros.h>
 
-#define DCC_SIGNAL_ISR_IMPL(G, S) \
+// The esp32-hal-timer functions are not guaranteed to be in IRAM, the ISR
+// instead programs the timer registers directly so that the signal keeps
+// running while the flash cache is disabled (ie: during SPIFFS writes). The
+// timer is configured for auto-reload so only the alarm value needs to be
+// updated and the alarm re-armed.
+#define DCC_TIMER_REGS(num) (&((num < 2 ? TIMERG0 : TIMERG1).hw_timer[num % 2]))
+
+// Writing the GPIO set/clear registers directly avoids the overhead of
+// digitalWrite in the ISR, the signal pins of a generator are all updated at
+// once via the masks built by attachOutputPin.
+#define DCC_GPIO_HIGH(pin) \
+  if(pin < 32) { GPIO.out_w1ts = (1UL << (pin & 31)); } else { GPIO.out1_w1ts.val = (1UL << (pin & 31)); }
+#define DCC_GPIO_LOW(pin) \
+  if(pin < 32) { GPIO.out_w1tc = (1UL << (pin & 31)); } else { GPIO.out1_w1tc.val = (1UL << (pin & 31)); }
+#define DCC_SIGNAL_PINS_HIGH(G) \
+  GPIO.out_w1ts = G->_pinMask; \
+  GPIO.out1_w1ts.val = G->_pinMaskHigh;
+#define DCC_SIGNAL_PINS_LOW(G) \
+  GPIO.out_w1tc = G->_pinMask; \
+  GPIO.out1_w1tc.val = G->_pinMaskHigh;
+
+// getPacket() is only called once the current packet has been fully sent,
+// all bits are sent from the durations rendered by the feeder task.
+#define DCC_SIGNAL_ISR_IMPL(G) \
   if(G->_topOfWave) { \
-    auto pkt = G->getPacket(); \
-    digitalWrite(S, HIGH); \
-    if(pkt->buffer[pkt->currentBit / 8] & DCC_PACKET_BIT_MASK[pkt->currentBit % 8]) { \
-      timerAlarmWrite(G->_timer, DCC_ONE_BIT_PULSE_DURATION, false); \
-    } else { \
-      timerAlarmWrite(G->_timer, DCC_ZERO_BIT_PULSE_DURATION, false); \
+    auto pkt = G->_packet; \
+    if(pkt == nullptr || pkt->currentBit >= pkt->numberOfBits) { \
+      pkt = G->getPacket(); \
+      G->_packet = pkt; \
     } \
-    pkt->currentBit++; \
+    DCC_SIGNAL_PINS_HIGH(G) \
+    DCC_TIMER_REGS(G->_timerNum)->alarm_low = pkt->halfBitDurations[pkt->currentBit++]; \
   } else { \
-    digitalWrite(S, LOW); \
+    DCC_SIGNAL_PINS_LOW(G) \
   } \
   G->_topOfWave = !G->_topOfWave; \
-  timerWrite(G->_timer, 0); \
-  timerAlarmEnable(G->_timer);
+  DCC_TIMER_REGS(G->_timerNum)->config.alarm_en = 1;
+
+#if RAILCOM_ENABLED
+// Sends the packet end bit followed by the RailCom cutout once the last bit
+// of a packet has been sent. Returns true when the timer has been programmed
+// for the next step of the cutout, when the cutout ends this returns false so
+// the ISR continues with the first bit of the next packet.
+static inline __attribute__((always_inline)) bool railComCutout(SignalGenerator_HardwareTimer *generator) {
+  uint32_t duration;
+  switch(generator->_cutoutState) {
+    case RAILCOM_CUTOUT_IDLE:
+      if(!generator->_topOfWave || generator->getCompletedPacket() == nullptr) {
+        return false;
+      }
+      DCC_SIGNAL_PINS_HIGH(generator)
+      duration = DCC_ONE_BIT_PULSE_DURATION;
+      generator->_cutoutState = RAILCOM_CUTOUT_END_BIT;
+      break;
+    case RAILCOM_CUTOUT_END_BIT:
+      DCC_SIGNAL_PINS_LOW(generator)
+      duration = DCC_ONE_BIT_PULSE_DURATION;
+      generator->_cutoutState = RAILCOM_CUTOUT_END_BIT_LOW;
+      break;
+    case RAILCOM_CUTOUT_END_BIT_LOW:
+      // the outputs stay LOW from the end of the end bit until the cutout
+      // starts, the channel timing is relative to the end of the end bit.
+      duration = RAILCOM_CUTOUT_START_DELAY;
+      generator->_cutoutState = RAILCOM_CUTOUT_START;
+      break;
+    case RAILCOM_CUTOUT_START:
+      DCC_GPIO_HIGH(RAILCOM_BRAKE_PIN)
+      RailComManager::startCutout(generator->getCompletedPacket());
+      duration = RAILCOM_CHANNEL1_DURATION;
+      generator->_cutoutState = RAILCOM_CUTOUT_CHANNEL1;
+      break;
+    case RAILCOM_CUTOUT_CHANNEL1:
+      RailComManager::endChannel1();
+      duration = RAILCOM_CHANNEL2_DURATION;
+      generator->_cutoutState = RAILCOM_CUTOUT_CHANNEL2;
+      break;
+    default:
+      DCC_GPIO_LOW(RAILCOM_BRAKE_PIN)
+      RailComManager::endCutout();
+      generator->_cutoutState = RAILCOM_CUTOUT_IDLE;
+      return false;
+  }
+  DCC_TIMER_REGS(generator->_timerNum)->alarm_low = duration;
+  DCC_TIMER_REGS(generator->_timerNum)->config.alarm_en = 1;
+  return true;
+}
+#else
+static inline __attribute__((always_inline)) bool railComCutout(SignalGenerator_HardwareTimer *generator) {
+  return false;
+}
+#endif
 
 void IRAM_ATTR signalGeneratorTimerISR_OPS(void)
 {
-  DCC_SIGNAL_ISR_IMPL(reinterpret_cast<SignalGenerator_HardwareTimer *>(dccSignal[DCC_SIGNAL_OPERATIONS]), DCC_SIGNAL_PIN_OPERATIONS)
+  const uint32_t start = xthal_get_ccount();
+  auto generator = reinterpret_cast<SignalGenerator_HardwareTimer *>(dccSignal[DCC_SIGNAL_OPERATIONS]);
+  if(!railComCutout(generator)) {
+    DCC_SIGNAL_ISR_IMPL(generator)
+  }
+  generator->recordISRCycles(xthal_get_ccount() - start);
 }
 
 void IRAM_ATTR signalGeneratorTimerISR_PROG(void)
 {
-  DCC_SIGNAL_ISR_IMPL(reinterpret_cast<SignalGenerator_HardwareTimer *>(dccSignal[DCC_SIGNAL_PROGRAMMING]), DCC_SIGNAL_PIN_PROGRAMMING)
+  const uint32_t start = xthal_get_ccount();
+  auto generator = reinterpret_cast<SignalGenerator_HardwareTimer *>(dccSignal[DCC_SIGNAL_PROGRAMMING]);
+  DCC_SIGNAL_ISR_IMPL(generator)
+  generator->recordISRCycles(xthal_get_ccount() - start);
 }
 
 SignalGenerator_HardwareTimer::SignalGenerator_HardwareTimer(String name, uint16_t maxPackets, uint8_t signalID, uint8_t signalPin) :
-    SignalGenerator(name, maxPackets, signalID, signalPin) {
+    SignalGenerator(name, maxPackets, signalID, signalPin), _timerNum(signalID + 1) {
+  attachOutputPin(signalPin);
+}
+
+void SignalGenerator_HardwareTimer::attachOutputPin(uint8_t pin) {
+  if(pin < 32) {
+    _pinMask |= (1UL << pin);
+  } else {
+    _pinMaskHigh |= (1UL << (pin - 32));
+  }
 }
 
 void SignalGenerator_HardwareTimer::enable() {
+  // force the ISR to fetch (and render) the current packet
+  _packet = nullptr;
   log_i("[%s] Configuring Timer(%d) for generating DCC Signal", _name.c_str(), _signalID + 1);
   _timer = timerBegin(_signalID + 1, DCC_TIMER_PRESCALE, true);
   log_i("[%s] Attaching interrupt handler to Timer(%d)", _name.c_str(), _signalID + 1);
@@ -76,15 +173,14 @@ void SignalGenerator_HardwareTimer::disable() {
   timerDetachInterrupt(_timer);
   timerEnd(_timer);
   _timer = nullptr;
+#if RAILCOM_ENABLED
+  if(_signalID == DCC_SIGNAL_OPERATIONS) {
+    // make sure the track outputs are not left shorted from a partial cutout
+    digitalWrite(RAILCOM_BRAKE_PIN, LOW);
+    _cutoutState = RAILCOM_CUTOUT_IDLE;
+  }
+#endif
 
   // give enough time for any timer ISR calls to complete before proceeding
   delay(250);
 }
-
-void SignalGenerator_HardwareTimer::lockSendQueueISR() {
-  portENTER_CRITICAL_ISR(&_sendQueueMUX);
-}
-
-void SignalGenerator_HardwareTimer::unlockSendQueueISR() {
-  portEXIT_CRITICAL_ISR(&_sendQueueMUX);
-}
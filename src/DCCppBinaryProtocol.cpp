@@ -0,0 +1,259 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "DCCppESP32.h"
+#include "DCCppBinaryProtocol.h"
+
+static uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+  for(size_t index = 0; index < len; index++) {
+    crc ^= (uint16_t)data[index] << 8;
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// passes the numeric arguments to the text protocol command handler.
+static void processCommand(const char *id, const int32_t *values, uint8_t count) {
+  DCCPPProtocolCommand *handler = DCCPPProtocolHandler::getCommandHandler(id);
+  if(handler) {
+    handler->process(DCCPPProtocolArguments(values, count));
+  } else {
+    wifiInterface.send(COMMAND_FAILED_RESPONSE);
+  }
+}
+
+void DCCPPBinaryConsumer::feed(uint32_t clientID, const uint8_t *data, size_t len) {
+  for(size_t index = 0; index < len; index++) {
+    if(!consume(clientID, data[index])) {
+      rescan(clientID);
+    }
+  }
+}
+
+// processes the next byte of the stream, returns false when the message being
+// received has been discarded. The LENGTH of a discarded message is left in
+// _length and the first _received bytes of _message hold what followed it.
+bool DCCPPBinaryConsumer::consume(uint32_t clientID, uint8_t value) {
+  switch(_state) {
+    case WAIT_FOR_SYNC:
+      if(value == DCCPP_BINARY_SYNC) {
+        _state = LENGTH_LOW;
+      }
+      break;
+    case LENGTH_LOW:
+      _length = value;
+      _state = LENGTH_HIGH;
+      break;
+    case LENGTH_HIGH:
+      _length |= (uint16_t)value << 8;
+      _received = 0;
+      if(_length == 0 || _length > DCCPP_BINARY_MAX_MESSAGE_SIZE) {
+        log_w("[BIN] Discarding message with invalid length %d", _length);
+        _invalidMessages++;
+        _state = WAIT_FOR_SYNC;
+        return false;
+      }
+      _state = MESSAGE;
+      break;
+    case MESSAGE:
+      _message[_received++] = value;
+      if(_received == _length + 2) {
+        _state = WAIT_FOR_SYNC;
+        const uint8_t length[2] = {(uint8_t)(_length & 0xFF), (uint8_t)(_length >> 8)};
+        const uint16_t crc = _message[_length] | (_message[_length + 1] << 8);
+        if(crc16(_message, _length, crc16(length, 2)) != crc) {
+          log_w("[BIN] Discarding message with invalid CRC");
+          _invalidMessages++;
+          return false;
+        }
+        DCCPPProtocolConsumer::setActiveClientID(clientID);
+        process(_message, _length);
+        DCCPPProtocolConsumer::setActiveClientID(0);
+      }
+      break;
+  }
+  return true;
+}
+
+// scans the bytes which followed the SYNC byte of a discarded message again,
+// the SYNC byte may have been a data byte and a real message may start in
+// what was taken as the LENGTH or message. The bytes still to be scanned are
+// kept at the end of _message, the message being received is written from the
+// start of _message and never overtakes the next byte to be scanned. When
+// another message is discarded during the scan its bytes are moved in front of
+// the remaining ones and the scan starts over.
+void DCCPPBinaryConsumer::rescan(uint32_t clientID) {
+  uint8_t length[2] = {(uint8_t)(_length & 0xFF), (uint8_t)(_length >> 8)};
+  uint8_t lengthIndex = 0;
+  uint16_t next = 0;
+  uint16_t pending = _received;
+  while(lengthIndex < sizeof(length) || next < pending) {
+    const uint8_t value = lengthIndex < sizeof(length) ? length[lengthIndex++] : _message[next++];
+    if(!consume(clientID, value)) {
+      memmove(&_message[_received], &_message[next], pending - next);
+      pending = _received + pending - next;
+      next = 0;
+      length[0] = _length & 0xFF;
+      length[1] = _length >> 8;
+      lengthIndex = 0;
+    }
+  }
+}
+
+void DCCPPBinaryConsumer::process(const uint8_t *message, uint16_t len) {
+  const uint8_t *payload = &message[1];
+  const uint16_t payloadLength = len - 1;
+  switch(message[0]) {
+    case DCCPP_BINARY_TEXT:
+      {
+        // the command is null terminated in place, this overwrites the first
+        // byte of the CRC which has already been checked.
+        char *command = reinterpret_cast<char *>(const_cast<uint8_t *>(payload));
+        command[payloadLength] = 0;
+        DCCPPProtocolHandler::process(command);
+      }
+      return;
+    case DCCPP_BINARY_THROTTLE:
+      if(payloadLength == sizeof(DCCPPBinaryThrottle)) {
+        auto throttle = reinterpret_cast<const DCCPPBinaryThrottle *>(payload);
+        const int32_t values[] = {throttle->registerNumber, throttle->address, throttle->speed, throttle->direction};
+        processCommand("t", values, 4);
+        return;
+      }
+      break;
+    case DCCPP_BINARY_FUNCTION:
+      if(payloadLength == sizeof(DCCPPBinaryFunction)) {
+        auto function = reinterpret_cast<const DCCPPBinaryFunction *>(payload);
+        const int32_t values[] = {function->address, function->functionByte, function->secondaryFunctionByte};
+        // the secondary byte is only sent for F13-F28
+        processCommand("f", values, (function->functionByte == 222 || function->functionByte == 223) ? 3 : 2);
+        return;
+      }
+      break;
+    case DCCPP_BINARY_ACCESSORY:
+      if(payloadLength == sizeof(DCCPPBinaryAccessory)) {
+        auto accessory = reinterpret_cast<const DCCPPBinaryAccessory *>(payload);
+        const int32_t values[] = {accessory->address, accessory->index, accessory->state};
+        processCommand("a", values, 3);
+        return;
+      }
+      break;
+    case DCCPP_BINARY_POWER:
+      if(payloadLength == sizeof(DCCPPBinaryPower)) {
+        auto power = reinterpret_cast<const DCCPPBinaryPower *>(payload);
+        processCommand(power->state ? "1" : "0", nullptr, 0);
+        return;
+      }
+      break;
+  }
+  log_w("[BIN] Unsupported message type %d (%d bytes)", message[0], payloadLength);
+  wifiInterface.send(COMMAND_FAILED_RESPONSE);
+}
+
+// parses the space separated decimal values of a response up to the closing
+// '>', returns the number of values or -1 if there are more than maxCount
+// values or anything other than a decimal value is found.
+static int8_t scanValues(const char *text, int32_t *values, uint8_t maxCount) {
+  uint8_t count = 0;
+  while(true) {
+    while(*text == ' ') {
+      text++;
+    }
+    if(*text == '>') {
+      return count;
+    }
+    if(count == maxCount) {
+      return -1;
+    }
+    const bool negative = (*text == '-');
+    if(negative) {
+      text++;
+    }
+    if(*text < '0' || *text > '9') {
+      return -1;
+    }
+    int32_t value = 0;
+    while(*text >= '0' && *text <= '9') {
+      value = (value * 10) + (*text++ - '0');
+    }
+    if(*text != ' ' && *text != '>') {
+      return -1;
+    }
+    values[count++] = negative ? -value : value;
+  }
+}
+
+static_assert(sizeof(DCCPPBinarySensor) <= sizeof(DCCPPBinaryThrottleState) &&
+  sizeof(DCCPPBinaryPower) <= sizeof(DCCPPBinaryThrottleState),
+  "DCCPPBinaryEncodedMessage::head must hold the largest fixed layout response");
+
+void DCCPPBinaryConsumer::encode(const String &response, DCCPPBinaryEncodedMessage &encoded) {
+  uint8_t *message = &encoded.head[3];
+  const char *text = response.c_str();
+  uint16_t len = 0;
+  encoded.body = nullptr;
+  encoded.bodyLength = 0;
+  // responses with a binary layout are a single <...> frame
+  if(response.length() > 2 && text[0] == '<' && response.indexOf('>') == (int)response.length() - 1) {
+    int32_t values[3];
+    if(text[1] == 'T' && text[2] == ' ' && scanValues(&text[2], values, 3) == 3) {
+      message[0] = DCCPP_BINARY_THROTTLE;
+      auto throttle = reinterpret_cast<DCCPPBinaryThrottleState *>(&message[1]);
+      throttle->registerNumber = values[0];
+      throttle->speed = values[1];
+      throttle->direction = values[2];
+      len = 1 + sizeof(DCCPPBinaryThrottleState);
+    } else if((text[1] == 'Q' || text[1] == 'q') && text[2] == ' ' && scanValues(&text[2], values, 1) == 1) {
+      message[0] = DCCPP_BINARY_SENSOR;
+      auto sensor = reinterpret_cast<DCCPPBinarySensor *>(&message[1]);
+      sensor->sensorID = values[0];
+      sensor->state = (text[1] == 'Q');
+      len = 1 + sizeof(DCCPPBinarySensor);
+    } else if(text[1] == 'p' && text[2] >= '0' && text[2] <= '2' && (text[3] == '>' || text[3] == ' ')) {
+      // the motor board name (if any) must be a single argument
+      const char *name = &text[3];
+      while(*name == ' ') {
+        name++;
+      }
+      const char *end = strchr(name, '>');
+      if(memchr(name, ' ', end - name) == nullptr) {
+        message[0] = DCCPP_BINARY_POWER;
+        auto power = reinterpret_cast<DCCPPBinaryPower *>(&message[1]);
+        power->state = text[2] - '0';
+        len = 1 + sizeof(DCCPPBinaryPower);
+        encoded.body = reinterpret_cast<const uint8_t *>(name);
+        encoded.bodyLength = end - name;
+      }
+    }
+  }
+  if(len == 0) {
+    message[0] = DCCPP_BINARY_TEXT;
+    len = 1;
+    encoded.body = reinterpret_cast<const uint8_t *>(text);
+    encoded.bodyLength = std::min<size_t>(response.length(), DCCPP_BINARY_MAX_MESSAGE_SIZE - 1);
+  }
+  encoded.headLength = 3 + len;
+  len += encoded.bodyLength;
+  encoded.head[0] = DCCPP_BINARY_SYNC;
+  encoded.head[1] = len & 0xFF;
+  encoded.head[2] = len >> 8;
+  const uint16_t crc = crc16(encoded.body, encoded.bodyLength, crc16(&encoded.head[1], encoded.headLength - 1));
+  encoded.crc[0] = crc & 0xFF;
+  encoded.crc[1] = crc >> 8;
+}
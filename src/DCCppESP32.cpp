@@ -212,12 +212,15 @@ void setup() {
   nextionInterfaceInit();
 #endif
   configStore.init();
-#if 1
-  dccSignal[DCC_SIGNAL_OPERATIONS] = new SignalGenerator_HardwareTimer("OPS", 512, DCC_SIGNAL_OPERATIONS, DCC_SIGNAL_PIN_OPERATIONS);
-  dccSignal[DCC_SIGNAL_PROGRAMMING] = new SignalGenerator_HardwareTimer("PROG", 10, DCC_SIGNAL_PROGRAMMING, DCC_SIGNAL_PIN_PROGRAMMING);
-#else
+#if RAILCOM_ENABLED
+  RailComManager::init();
+#endif
+#if DCC_SIGNAL_GENERATOR_RMT
   dccSignal[DCC_SIGNAL_OPERATIONS] = new SignalGenerator_RMT("OPS", 512, DCC_SIGNAL_OPERATIONS, DCC_SIGNAL_PIN_OPERATIONS);
   dccSignal[DCC_SIGNAL_PROGRAMMING] = new SignalGenerator_RMT("PROG", 10, DCC_SIGNAL_PROGRAMMING, DCC_SIGNAL_PIN_PROGRAMMING);
+#else
+  dccSignal[DCC_SIGNAL_OPERATIONS] = new SignalGenerator_HardwareTimer("OPS", 512, DCC_SIGNAL_OPERATIONS, DCC_SIGNAL_PIN_OPERATIONS);
+  dccSignal[DCC_SIGNAL_PROGRAMMING] = new SignalGenerator_HardwareTimer("PROG", 10, DCC_SIGNAL_PROGRAMMING, DCC_SIGNAL_PIN_PROGRAMMING);
 #endif
 #if LCC_ENABLED
   lccInterface.init();
@@ -227,10 +230,14 @@ void setup() {
 		MOTORBOARD_ENABLE_PIN_OPS, MOTORBOARD_TYPE_OPS, MOTORBOARD_NAME_OPS);
   MotorBoardManager::registerBoard(MOTORBOARD_CURRENT_SENSE_PROG,
 		MOTORBOARD_ENABLE_PIN_PROG, MOTORBOARD_TYPE_PROG, MOTORBOARD_NAME_PROG, true);
+#ifdef MOTORBOARD_OPS_DISTRICTS
+  MotorBoardManager::registerBoard({MOTORBOARD_OPS_DISTRICTS});
+#endif
 #if INFO_SCREEN_TRACK_POWER_LINE >= 0
 	InfoScreen::replaceLine(INFO_SCREEN_TRACK_POWER_LINE, F("TRACK POWER: OFF"));
 #endif
 	DCCPPProtocolHandler::init();
+  ProgTrackManager::init();
 	OutputManager::init();
 	TurnoutManager::init();
 	SensorManager::init();
@@ -246,6 +253,8 @@ void setup() {
   InfoScreen::replaceLine(INFO_SCREEN_ROTATING_STATUS_LINE, F("LocoNet Init"));
   locoNet.begin();
   locoNet.onPacket(OPC_GPON, [](lnMsg *msg) {
+    // LocoNet throttles resume from OPC_IDLE (emergency stop) with OPC_GPON
+    LocomotiveManager::clearEmergencyStop();
     MotorBoardManager::powerOnAll();
   });
   locoNet.onPacket(OPC_GPOFF, [](lnMsg *msg) {
@@ -257,6 +266,10 @@ void setup() {
   locoNet.onPacket(OPC_LOCO_ADR, [](lnMsg *msg) {
     lnMsg response = {0};
     auto loco = LocomotiveManager::getLocomotive(msg->la.adr_lo + (msg->la.adr_hi << 7));
+    if(loco == nullptr) {
+      locoNet.send(OPC_LONG_ACK, OPC_LOCO_ADR, 0);
+      return;
+    }
     response.sd.command = OPC_SL_RD_DATA;
     response.sd.mesg_size = 0x0E;
     response.sd.slot = loco->getRegister();
@@ -309,46 +322,50 @@ void setup() {
     if(msg->pt.slot == PRG_SLOT) {
       if(msg->pt.command == 0x00) {
         // Cancel / abort request, currently ignored
-      } else if (progTrackBusy) {
-        locoNet.send(OPC_LONG_ACK, OPC_MASK, 0);
       } else {
         uint16_t cv = PROG_CV_NUM(msg->pt);
         uint8_t value = PROG_DATA(msg->pt);
         if((msg->pt.command & DIR_BYTE_ON_SRVC_TRK) == 0 &&
           (msg->pt.command & PCMD_RW) == 1) { // CV Write on PROG
-          if(enterProgrammingMode()) {
-            locoNet.send(OPC_LONG_ACK, OPC_MASK, 1);
-            msg->pt.command = OPC_SL_RD_DATA;
-            if(!writeProgCVByte(cv, value)) {
-              msg->pt.pstat = PSTAT_WRITE_FAIL;
+          // the response is sent by the programming track worker task
+          lnMsg response = *msg;
+          response.pt.command = OPC_SL_RD_DATA;
+          if(!ProgTrackManager::queue([response, cv, value](bool energized) mutable {
+            if(!energized || !writeProgCVByte(cv, value)) {
+              response.pt.pstat = PSTAT_WRITE_FAIL;
             } else {
-              msg->pt.data7 = value;
+              response.pt.data7 = value;
               if(value & 0x80) {
-                msg->pt.cvh |= CVH_D7;
+                response.pt.cvh |= CVH_D7;
               }
             }
-            leaveProgrammingMode();
-            locoNet.send(msg);
-          } else {
+            locoNet.send(&response);
+          }, []() {
+            // the LACK must reach LocoNet before the job's response
+            locoNet.send(OPC_LONG_ACK, OPC_MASK, 1);
+          })) {
             locoNet.send(OPC_LONG_ACK, OPC_MASK, 0);
           }
         } else if((msg->pt.command & DIR_BYTE_ON_SRVC_TRK) == 0 &&
           (msg->pt.command & PCMD_RW) == 0) { // CV Read on PROG
-          if(enterProgrammingMode()) {
-            locoNet.send(OPC_LONG_ACK, OPC_MASK, 1);
-            msg->pt.command = OPC_SL_RD_DATA;
-            int16_t value = readCV(cv);
+          // the response is sent by the programming track worker task
+          lnMsg response = *msg;
+          response.pt.command = OPC_SL_RD_DATA;
+          if(!ProgTrackManager::queue([response, cv](bool energized) mutable {
+            int16_t value = energized ? readCV(cv) : -1;
             if(value == -1) {
-              msg->pt.pstat = PSTAT_READ_FAIL;
+              response.pt.pstat = PSTAT_READ_FAIL;
             } else {
-              msg->pt.data7 = value & 0x7F;
+              response.pt.data7 = value & 0x7F;
               if(value & 0x80) {
-                msg->pt.cvh |= CVH_D7;
+                response.pt.cvh |= CVH_D7;
               }
             }
-            leaveProgrammingMode();
-            locoNet.send(msg);
-          } else {
+            locoNet.send(&response);
+          }, []() {
+            // the LACK must reach LocoNet before the job's response
+            locoNet.send(OPC_LONG_ACK, OPC_MASK, 1);
+          })) {
             locoNet.send(OPC_LONG_ACK, OPC_MASK, 0);
           }
         } else if ((msg->pt.command & OPS_BYTE_NO_FEEDBACK) == 0) {
@@ -29,13 +29,30 @@ and has been adapter for use in DCC++ESP32.
 
 LinkedList<DCCPPProtocolCommand *> registeredCommands([](DCCPPProtocolCommand *command) {delete command; });
 
+// command dispatch table, entries are grouped by the first character of the
+// command ID and commandTableIndex holds the first entry of each group.
+struct DCCPPProtocolCommandEntry {
+  const char *id;
+  DCCPPProtocolCommand *command;
+};
+static std::vector<DCCPPProtocolCommandEntry> commandTable;
+static uint8_t commandTableIndex[DCCPP_COMMAND_TABLE_SIZE + 1] = {0};
+
+// all connected protocol clients.
+static LinkedList<DCCPPProtocolConsumer *> protocolClients(nullptr);
+static xSemaphoreHandle protocolClientsLock = xSemaphoreCreateMutex();
+static uint32_t nextClientID = 1;
+
+// client whose command is being processed by the current task, see
+// DCCPPProtocolConsumer::getActiveClientID.
+static thread_local uint32_t activeClientID = 0;
+
 // <e> command handler, this command will clear all stored configuration data
 // on the ESP32. All Turnouts, Outputs, Sensors and S88 Sensors (if enabled)
 // will need to be reconfigured after sending this command.
 class ConfigErase : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
-    bool reEnable = stopDCCSignalGenerators();
+  void process(const DCCPPProtocolArguments &arguments) {
     configStore.clear();
     TurnoutManager::clear();
     SensorManager::clear();
@@ -45,11 +62,8 @@ public:
     OutputManager::clear();
     LocomotiveManager::clear();
     wifiInterface.send(COMMAND_SUCCESSFUL_RESPONSE);
-    if(reEnable) {
-      startDCCSignalGenerators();
-    }
   }
-  String getID() {
+  const char *getID() {
     return "e";
   }
 };
@@ -59,8 +73,7 @@ public:
 // subsequent startups.
 class ConfigStore : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
-    bool reEnable = stopDCCSignalGenerators();
+  void process(const DCCPPProtocolArguments &arguments) {
 #if S88_ENABLED
     wifiInterface.printf(F("<e %d %d %d %d %d>"),
       TurnoutManager::store(),
@@ -75,11 +88,8 @@ public:
       OutputManager::store(),
       LocomotiveManager::store());
 #endif
-    if(reEnable) {
-      startDCCSignalGenerators();
-    }
   }
-  String getID() {
+  const char *getID() {
     return "E";
   }
 };
@@ -87,23 +97,23 @@ public:
 // <R {CV} {CALLBACK} {CALLBACK-SUB}> command handler, this command attempts
 // to read a CV value from the PROGRAMMING track. The returned value will be
 // the actual CV value or -1 when there is a failure reading or verifying the CV.
+// The read is queued for the programming track worker task and the response is
+// sent when it completes.
 class ReadCVCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
-    int cvNumber = arguments[0].toInt();
-    int16_t cvValue = -1;
-    if(enterProgrammingMode()) {
-      cvValue = readCV(cvNumber);
-      leaveProgrammingMode();
+  void process(const DCCPPProtocolArguments &arguments) {
+    const uint16_t cvNumber = arguments[0].toInt();
+    const int callback = arguments[1].toInt();
+    const int callbackSub = arguments[2].toInt();
+    if(!ProgTrackManager::queue([cvNumber, callback, callbackSub](bool energized) {
+      int16_t cvValue = energized ? readCV(cvNumber) : -1;
+      wifiInterface.printf(F("<r%d|%d|%d %d>"), callback, callbackSub, cvNumber, cvValue);
+    })) {
+      wifiInterface.printf(F("<r%d|%d|%d %d>"), callback, callbackSub, cvNumber, -1);
     }
-    wifiInterface.printf(F("<r%d|%d|%d %d>"),
-      arguments[1].toInt(),
-      arguments[2].toInt(),
-      cvNumber,
-      cvValue);
   }
 
-  String getID() {
+  const char *getID() {
     return "R";
   }
 };
@@ -111,59 +121,51 @@ public:
 // <W {CV} {VALUE} {CALLBACK} {CALLBACK-SUB}> command handler, this command
 // attempts to write a CV value on the PROGRAMMING track. The returned value
 // is either the actual CV value written or -1 if there is a failure writing or
-// verifying the CV value.
+// verifying the CV value. The write is queued for the programming track worker
+// task and the response is sent when it completes.
 class WriteCVByteProgCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
-    int cvNumber = arguments[0].toInt();
-    int16_t cvValue = arguments[1].toInt();
-    if(enterProgrammingMode()) {
-      if(!writeProgCVByte(cvNumber, cvValue)) {
-        cvValue = -1;
-      }
-      leaveProgrammingMode();
-    } else {
-      cvValue = -1;
+  void process(const DCCPPProtocolArguments &arguments) {
+    const uint16_t cvNumber = arguments[0].toInt();
+    const uint8_t cvValue = arguments[1].toInt();
+    const int callback = arguments[2].toInt();
+    const int callbackSub = arguments[3].toInt();
+    if(!ProgTrackManager::queue([cvNumber, cvValue, callback, callbackSub](bool energized) {
+      wifiInterface.printf(F("<r%d|%d|%d %d>"), callback, callbackSub, cvNumber,
+        energized && writeProgCVByte(cvNumber, cvValue) ? cvValue : -1);
+    })) {
+      wifiInterface.printf(F("<r%d|%d|%d %d>"), callback, callbackSub, cvNumber, -1);
     }
-    wifiInterface.printf(F("<r%d|%d|%d %d>"),
-      arguments[2].toInt(),
-      arguments[3].toInt(),
-      cvNumber,
-      cvValue);
   }
 
-  String getID() {
+  const char *getID() {
     return "W";
   }
 };
 
-// <W {CV} {BIT} {VALUE} {CALLBACK} {CALLBACK-SUB}> command handler, this
+// <B {CV} {BIT} {VALUE} {CALLBACK} {CALLBACK-SUB}> command handler, this
 // command attempts to write a single bit value for a CV on the PROGRAMMING
 // track. The returned value is either the actual bit value of the CV or -1 if
-// there is a failure writing or verifying the CV value.
+// there is a failure writing or verifying the CV value. The write is queued
+// for the programming track worker task and the response is sent when it
+// completes.
 class WriteCVBitProgCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
-    int cvNumber = arguments[0].toInt();
-    uint8_t bit = arguments[1].toInt();
-    int8_t bitValue = arguments[1].toInt();
-    if(enterProgrammingMode()) {
-      if(!writeProgCVBit(cvNumber, bit, bitValue == 1)) {
-        bitValue = -1;
-      }
-      leaveProgrammingMode();
-    } else {
-      bitValue = -1;
+  void process(const DCCPPProtocolArguments &arguments) {
+    const uint16_t cvNumber = arguments[0].toInt();
+    const uint8_t bit = arguments[1].toInt();
+    const uint8_t bitValue = arguments[2].toInt();
+    const int callback = arguments[3].toInt();
+    const int callbackSub = arguments[4].toInt();
+    if(!ProgTrackManager::queue([cvNumber, bit, bitValue, callback, callbackSub](bool energized) {
+      wifiInterface.printf(F("<r%d|%d|%d %d %d>"), callback, callbackSub, cvNumber, bit,
+        energized && writeProgCVBit(cvNumber, bit, bitValue == 1) ? bitValue : -1);
+    })) {
+      wifiInterface.printf(F("<r%d|%d|%d %d %d>"), callback, callbackSub, cvNumber, bit, -1);
     }
-    wifiInterface.printf(F("<r%d|%d|%d %d %d>"),
-      arguments[2].toInt(),
-      arguments[3].toInt(),
-      cvNumber,
-      bit,
-      bitValue);
   }
 
-  String getID() {
+  const char *getID() {
     return "B";
   }
 };
@@ -172,13 +174,13 @@ public:
 // on the MAIN OPERATIONS track for a given LOCO. No verification is attempted.
 class WriteCVByteOpsCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     writeOpsCVByte(arguments[0].toInt(),
       arguments[1].toInt(),
       arguments[2].toInt());
   }
 
-  String getID() {
+  const char *getID() {
     return "w";
   }
 };
@@ -188,14 +190,14 @@ public:
 // is attempted.
 class WriteCVBitOpsCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     writeOpsCVBit(arguments[0].toInt(),
       arguments[1].toInt(),
       arguments[2].toInt(),
       arguments[3].toInt() == 1);
   }
 
-  String getID() {
+  const char *getID() {
     return "b";
   }
 };
@@ -205,7 +207,7 @@ public:
 // command.
 class StatusCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     wifiInterface.printf(F("<iDCC++ COMMAND STATION FOR ESP32: V-%s / %s %s>"),
       VERSION, __DATE__, __TIME__);
     MotorBoardManager::showStatus();
@@ -215,7 +217,7 @@ public:
     wifiInterface.showInitInfo();
   }
 
-  String getID() {
+  const char *getID() {
     return "s";
   }
 };
@@ -223,19 +225,58 @@ public:
 // <F> command handler, this command sends the current free heap space as response.
 class FreeHeapCommand : public DCCPPProtocolCommand {
 public:
-  void process(const std::vector<String> arguments) {
+  void process(const DCCPPProtocolArguments &arguments) {
     wifiInterface.printf(F("<f %d>"), ESP.getFreeHeap());
   }
 
-  String getID() {
+  const char *getID() {
     return "F";
   }
 };
 
+// <D> command handler, this command reports the state of the packet queues
+// for each signal generator as <D {generator} {priority} {depth} {capacity}
+// {max depth} {max wait (us)} {sent} {replaced}> followed by the signal
+// generator telemetry as <d {generator} {packets} {idle packets} {bits}
+// {idle bits} {queued high water} {queue full} {eStop latency (us)}
+// {ISR calls} {average ISR cycles} {max ISR cycles} {latency histogram...}>.
+class PacketQueueStatusCommand : public DCCPPProtocolCommand {
+public:
+  void process(const DCCPPProtocolArguments &arguments) {
+    for(auto generator : dccSignal) {
+      for(uint8_t priority = 0; priority < MAX_DCC_PACKET_PRIORITY; priority++) {
+        auto status = generator->getQueueStatus((DCC_PACKET_PRIORITY)priority);
+        wifiInterface.printf(F("<D %s %d %d %d %d %d %d %d>"), generator->getName().c_str(),
+          priority, status.depth, status.capacity, status.maxDepth, status.maxWait, status.sent,
+          status.replaced);
+      }
+      auto telemetry = generator->getTelemetry();
+      String latency = "";
+      for(uint8_t bucket = 0; bucket < DCC_LATENCY_HISTOGRAM_BUCKETS; bucket++) {
+        latency += " " + String(telemetry.latency[bucket]);
+      }
+      uint32_t isrAverageCycles = 0;
+      if(telemetry.isrCalls) {
+        isrAverageCycles = telemetry.isrCycles / telemetry.isrCalls;
+      }
+      wifiInterface.printf(F("<d %s %u %u %llu %llu %u %u %u %u %u %u%s>"), generator->getName().c_str(),
+        telemetry.packets, telemetry.idlePackets, telemetry.bits, telemetry.idleBits,
+        telemetry.queuedHighWater, telemetry.queueFull, telemetry.eStopLatency, telemetry.isrCalls,
+        isrAverageCycles, telemetry.isrMaxCycles, latency.c_str());
+    }
+  }
+
+  const char *getID() {
+    return "D";
+  }
+};
+
 void DCCPPProtocolHandler::init() {
   registerCommand(new ThrottleCommandAdapter());
+  registerCommand(new ThrottleBatchCommandAdapter());
   registerCommand(new FunctionCommandAdapter());
   registerCommand(new ConsistCommandAdapter());
+  registerCommand(new EmergencyStopCommandAdapter());
   registerCommand(new AccessoryCommand());
   registerCommand(new PowerOnCommand());
   registerCommand(new PowerOffCommand());
@@ -256,89 +297,211 @@ void DCCPPProtocolHandler::init() {
 #endif
   registerCommand(new RemoteSensorsCommandAdapter());
   registerCommand(new FreeHeapCommand());
+  registerCommand(new PacketQueueStatusCommand());
 }
 
-void DCCPPProtocolHandler::process(const String &commandString) {
-  std::vector<String> parts;
-  if(commandString.indexOf(' ') > 0) {
-    int index = 0;
-    while(index < commandString.length()) {
-      int previousIndex = index;
-      index = commandString.indexOf(' ', previousIndex);
-      if(index < 0) {
-        index = commandString.length();
-      }
-      parts.push_back(commandString.substring(previousIndex, index));
-      // move past the space
-      index++;
+DCCPPProtocolArguments::DCCPPProtocolArguments(char *arguments) : _base(arguments) {
+  char *ch = arguments;
+  while(*ch) {
+    // skip any separators before the next argument
+    while(*ch == ' ') {
+      *ch++ = 0;
     }
-  } else {
-    parts.push_back(commandString);
-  }
-  String commandID = parts.front();
-  parts.erase(parts.begin());
-  //log_i("Command: %s, argument count: %d", commandID.c_str(), parts.size());
-  bool processed = false;
-  for (const auto& command : registeredCommands) {
-    if(commandID == command->getID()) {
-      command->process(parts);
-      processed = true;
+    if(!*ch) {
+      break;
     }
+    if(_count == DCCPP_MAX_ARGUMENTS) {
+      _overflow = true;
+      break;
+    }
+    _offsets[_count++] = ch - arguments;
+    while(*ch && *ch != ' ') {
+      ch++;
+    }
+  }
+}
+
+void DCCPPProtocolHandler::process(char *command) {
+  // split the command ID from the arguments
+  char *arguments = command;
+  while(*arguments && *arguments != ' ') {
+    arguments++;
+  }
+  if(*arguments) {
+    *arguments++ = 0;
+  }
+  DCCPPProtocolCommand *handler = getCommandHandler(command);
+  if(handler == nullptr) {
+    log_e("No command handler for [%s]", command);
+    wifiInterface.send(COMMAND_FAILED_RESPONSE);
+    return;
   }
-  if(!processed) {
-    log_e("No command handler for [%s]", commandID.c_str());
+  DCCPPProtocolArguments parts(arguments);
+  if(parts.overflow()) {
+    log_e("Too many arguments for [%s]", command);
     wifiInterface.send(COMMAND_FAILED_RESPONSE);
+    return;
   }
+  //log_i("Command: %s, argument count: %d", command, parts.size());
+  handler->process(parts);
 }
 
 void DCCPPProtocolHandler::registerCommand(DCCPPProtocolCommand *cmd) {
-  for (const auto& command : registeredCommands) {
-		if(command->getID() == cmd->getID()) {
-      log_e("Ignoring attempt to register second command with ID: %s",
-        cmd->getID().c_str());
-      return;
-    }
-	}
-  log_v("Registering interface command %s", cmd->getID().c_str());
+  if(getCommandHandler(cmd->getID()) != nullptr) {
+    log_e("Ignoring attempt to register second command with ID: %s", cmd->getID());
+    delete cmd;
+    return;
+  }
+  if((uint8_t)cmd->getID()[0] >= DCCPP_COMMAND_TABLE_SIZE) {
+    log_e("Ignoring attempt to register command with invalid ID: %s", cmd->getID());
+    delete cmd;
+    return;
+  }
+  log_v("Registering interface command %s", cmd->getID());
   registeredCommands.add(cmd);
+  buildCommandTable();
 }
 
-DCCPPProtocolCommand *DCCPPProtocolHandler::getCommandHandler(const String &id) {
-  for (const auto& command : registeredCommands) {
-    if(command->getID() == id) {
-      return command;
+DCCPPProtocolCommand *DCCPPProtocolHandler::getCommandHandler(const char *id) {
+  const uint8_t bucket = id[0];
+  if(bucket >= DCCPP_COMMAND_TABLE_SIZE) {
+    return nullptr;
+  }
+  for(uint8_t index = commandTableIndex[bucket]; index < commandTableIndex[bucket + 1]; index++) {
+    if(!strcmp(commandTable[index].id, id)) {
+      return commandTable[index].command;
     }
   }
   return nullptr;
 }
 
+// rebuilds the dispatch table from the registered commands, the commands are
+// grouped by the first character of their ID so a lookup only compares the
+// IDs sharing the same first character. This is only called from init() as
+// commands are registered.
+void DCCPPProtocolHandler::buildCommandTable() {
+  commandTable.clear();
+  commandTable.reserve(registeredCommands.length());
+  for(uint8_t bucket = 0; bucket < DCCPP_COMMAND_TABLE_SIZE; bucket++) {
+    commandTableIndex[bucket] = commandTable.size();
+    for (const auto& command : registeredCommands) {
+      const char *id = command->getID();
+      if((uint8_t)id[0] == bucket) {
+        commandTable.push_back({id, command});
+      }
+    }
+  }
+  commandTableIndex[DCCPP_COMMAND_TABLE_SIZE] = commandTable.size();
+}
+
 DCCPPProtocolConsumer::DCCPPProtocolConsumer() {
-  _buffer.reserve(256);
+  MUTEX_LOCK(protocolClientsLock);
+  _clientID = nextClientID++;
+  protocolClients.add(this);
+  MUTEX_UNLOCK(protocolClientsLock);
 }
 
-void DCCPPProtocolConsumer::feed(uint8_t *data, size_t len) {
-  for(int i = 0; i < len; i++) {
-    _buffer.emplace_back(data[i]);
+DCCPPProtocolConsumer::~DCCPPProtocolConsumer() {
+  unregister();
+}
+
+void DCCPPProtocolConsumer::unregister() {
+  MUTEX_LOCK(protocolClientsLock);
+  if(_registered) {
+    protocolClients.remove(this);
+    _registered = false;
   }
-  processData();
+  MUTEX_UNLOCK(protocolClientsLock);
+}
+
+uint32_t DCCPPProtocolConsumer::getActiveClientID() {
+  return activeClientID;
+}
+
+void DCCPPProtocolConsumer::setActiveClientID(uint32_t clientID) {
+  activeClientID = clientID;
 }
 
-void DCCPPProtocolConsumer::processData() {
-  auto s = _buffer.begin();
-  auto consumed = _buffer.begin();
-  for(; s != _buffer.end();) {
-    s = std::find(s, _buffer.end(), '<');
-    auto e = std::find(s, _buffer.end(), '>');
-    if(s != _buffer.end() && e != _buffer.end()) {
-      // discard the <
-      s++;
-      // discard the >
-      *e = 0;
-      String str(reinterpret_cast<char*>(&*s));
-      DCCPPProtocolHandler::process(std::move(str));
-      consumed = e;
+bool DCCPPProtocolConsumer::sendToClient(uint32_t clientID, const String &buf) {
+  bool sent = false;
+  MUTEX_LOCK(protocolClientsLock);
+  for (const auto& client : protocolClients) {
+    if(client->_clientID == clientID) {
+      client->send(buf);
+      sent = true;
+      break;
     }
-    s = e;
   }
-  _buffer.erase(_buffer.begin(), consumed); // drop everything we used from the buffer.
+  MUTEX_UNLOCK(protocolClientsLock);
+  return sent;
+}
+
+void DCCPPProtocolConsumer::sendToAll(const String &buf) {
+  MUTEX_LOCK(protocolClientsLock);
+  for (const auto& client : protocolClients) {
+    client->send(buf);
+  }
+  MUTEX_UNLOCK(protocolClientsLock);
+}
+
+void DCCPPProtocolConsumer::feed(uint8_t *data, size_t len) {
+  char *ch = reinterpret_cast<char *>(data);
+  char *end = ch + len;
+  while(ch < end) {
+    if(!_inFrame) {
+      // discard everything up to the start of the next frame
+      ch = static_cast<char *>(memchr(ch, '<', end - ch));
+      if(ch == nullptr) {
+        return;
+      }
+      ch++;
+      _inFrame = true;
+      _frameLength = 0;
+    }
+    char *start = ch;
+    while(ch < end && *ch != '>' && *ch != '<') {
+      ch++;
+    }
+    if(ch == end) {
+      // the frame continues in the next block of data, hold on to what has
+      // been received so far.
+      if(_frameLength + (ch - start) > DCCPP_MAX_FRAME_SIZE) {
+        log_w("Discarding oversized frame");
+        _oversizedFrames++;
+        _inFrame = false;
+      } else {
+        memcpy(&_frame[_frameLength], start, ch - start);
+        _frameLength += ch - start;
+      }
+    } else if(*ch == '<') {
+      // resync on the start of the new frame
+      log_w("Discarding unterminated frame");
+      _droppedFrames++;
+      _frameLength = 0;
+      ch++;
+    } else {
+      *ch++ = 0;
+      if(_frameLength == 0) {
+        processFrame(start, ch - start - 1);
+      } else if(_frameLength + (ch - start - 1) > DCCPP_MAX_FRAME_SIZE) {
+        log_w("Discarding oversized frame");
+        _oversizedFrames++;
+      } else {
+        memcpy(&_frame[_frameLength], start, ch - start);
+        processFrame(_frame, _frameLength + (ch - start - 1));
+      }
+      _inFrame = false;
+    }
+  }
+}
+
+void DCCPPProtocolConsumer::processFrame(char *frame, size_t len) {
+  if(len > DCCPP_MAX_FRAME_SIZE) {
+    log_w("Discarding oversized frame");
+    _oversizedFrames++;
+    return;
+  }
+  activeClientID = _clientID;
+  DCCPPProtocolHandler::process(frame);
+  activeClientID = 0;
 }
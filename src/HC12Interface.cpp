@@ -32,7 +32,16 @@ COPYRIGHT (c) 2018-2019 Mike Dunston
 #endif
 
 HardwareSerial hc12Serial(HC12_UART_NUM);
-DCCPPProtocolConsumer hc12Consumer;
+
+class HC12Consumer : public DCCPPProtocolConsumer {
+public:
+  virtual ~HC12Consumer() {
+    unregister();
+  }
+  void send(const String &buf) {
+    HC12Interface::send(buf);
+  }
+};
 
 TaskHandle_t HC12Interface::_taskHandle;
 
@@ -42,6 +51,7 @@ void HC12Interface::init() {
 
 void HC12Interface::hc12Task(void *param) {
   hc12Serial.begin(HC12_RADIO_BAUD, SERIAL_8N1, HC12_RX_PIN, HC12_TX_PIN);
+  HC12Consumer hc12Consumer;
   uint8_t buf[128];
   while(1) {
     while (hc12Serial.available()) {
@@ -53,6 +63,12 @@ void HC12Interface::hc12Task(void *param) {
   }
 }
 
+// the UART TX FIFO is used as the output buffer for the radio, when there is
+// not enough room the message is dropped rather than waiting for the radio.
 void HC12Interface::send(const String &buf) {
+  if(hc12Serial.availableForWrite() < buf.length()) {
+    log_w("[HC12] TX buffer is full, dropping %d bytes", buf.length());
+    return;
+  }
   hc12Serial.print(buf);
 }
@@ -112,6 +112,13 @@ SimpleEventCallbackHandler emergencyStopHandler(openlcb::Defs::EMERGENCY_STOP_EV
         LocomotiveManager::emergencyStop();
     }, nullptr);
 
+SimpleEventCallbackHandler emergencyStopClearHandler(openlcb::Defs::CLEAR_EMERGENCY_STOP_EVENT,
+    openlcb::CallbackEventHandler::RegistryEntryBits::IS_CONSUMER,
+    openmrn.stack()->node(),
+    [](const openlcb::EventRegistryEntry &registry_entry, openlcb::EventReport *report, BarrierNotifiable *done) {
+        clearDCCEmergencyStop();
+    }, nullptr);
+
 class DccPacketQueueInjector : public dcc::PacketFlowInterface {
     public:
         void send(Buffer<dcc::Packet> *b, unsigned prio)
@@ -17,61 +17,204 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 
 #include "DCCppESP32.h"
 
-Locomotive::Locomotive(uint8_t registerNumber) :
-  _registerNumber(registerNumber), _locoAddress(0), _speed(0), _direction(true),
-  _lastUpdate(0), _functionsChanged(true) {
-  for(uint8_t funcID = 0; funcID < MAX_LOCOMOTIVE_FUNCTIONS; funcID++) {
-    _functionState[funcID] = false;
+LocomotiveState Locomotive::_state;
+
+static ObjectPool<Locomotive, MAX_LOCOMOTIVES> locomotivePool;
+static portMUX_TYPE locomotiveSlotMux = portMUX_INITIALIZER_UNLOCKED;
+
+void *Locomotive::operator new(size_t size) noexcept {
+  void *ptr = locomotivePool.allocate();
+  if(ptr == nullptr) {
+    log_w("Unable to allocate Locomotive, all %d are in use", MAX_LOCOMOTIVES);
   }
+  return ptr;
+}
+
+void Locomotive::operator delete(void *ptr) {
+  locomotivePool.release(ptr);
 }
 
-Locomotive::Locomotive(JsonObject &json) : _registerNumber(-1), _lastUpdate(0), _functionsChanged(true) {
-  for(uint8_t funcID = 0; funcID < MAX_LOCOMOTIVE_FUNCTIONS; funcID++) {
-    _functionState[funcID] = false;
+// finds and claims a free LocomotiveState slot, there are always enough slots
+// as each locomotive and consist pool entry has a matching slot.
+uint8_t Locomotive::acquireSlot() {
+  uint8_t slot = 0;
+  portENTER_CRITICAL(&locomotiveSlotMux);
+  while(slot < MAX_LOCOMOTIVE_SLOTS - 1 && (_state.flags[slot] & LOCOMOTIVE_STATE_ACTIVE)) {
+    slot++;
   }
-  _locoAddress = json[JSON_ADDRESS_NODE];
-  _speed = json[JSON_SPEED_NODE];
-  _direction = json[JSON_DIRECTION_NODE] == JSON_VALUE_FORWARD;
+  _state.flags[slot] = LOCOMOTIVE_STATE_ACTIVE | LOCOMOTIVE_STATE_FORWARD;
+  portEXIT_CRITICAL(&locomotiveSlotMux);
+  _state.address[slot] = 0;
+  _state.speed[slot] = 0;
+  _state.speedFraction[slot] = 0;
+  _state.targetSpeed[slot] = 0;
+  _state.acceleration[slot] = 0;
+  _state.braking[slot] = 0;
+  _state.functions[slot] = 0;
+  _state.lastUpdate[slot] = 0;
+  for(uint8_t functionPacket = 0; functionPacket < MAX_LOCOMOTIVE_FUNCTION_PACKETS; functionPacket++) {
+    _state.lastFunctionUpdate[functionPacket][slot] = 0;
+  }
+  return slot;
+}
+
+Locomotive::Locomotive(uint8_t registerNumber) : _slot(acquireSlot()),
+  _registerNumber(registerNumber) {
+}
+
+Locomotive::Locomotive(JsonObject &json) : _slot(acquireSlot()), _registerNumber(-1) {
+  setLocoAddress(json[JSON_ADDRESS_NODE]);
+  _state.speed[_slot] = json[JSON_SPEED_NODE];
+  _state.targetSpeed[_slot] = _state.speed[_slot];
+  setDirection(json[JSON_DIRECTION_NODE] == JSON_VALUE_FORWARD);
   _orientation = json[JSON_ORIENTATION_NODE] == JSON_VALUE_FORWARD;
 }
 
-void Locomotive::sendLocoUpdate() {
-  std::vector<uint8_t> packetBuffer;
-  if(_locoAddress > 127) {
-    packetBuffer.push_back((uint8_t)(0xC0 | highByte(_locoAddress)));
+Locomotive::~Locomotive() {
+  _state.flags[_slot] = 0;
+}
+
+void Locomotive::setLocoAddress(uint16_t locoAddress) {
+  _state.address[_slot] = locoAddress;
+  auto entry = LocomotiveManager::getRosterEntry(locoAddress, false);
+  if(entry != nullptr) {
+    setMomentum(entry->getAcceleration(), entry->getBraking());
+  } else {
+    setMomentum(0, 0);
   }
-  packetBuffer.push_back(lowByte(_locoAddress));
-  // S-9.2.1 Advanced Operations instruction
-  // using 128 speed steps
-  packetBuffer.push_back(0x3F);
-  if(_speed < 0) {
-    _speed = 0;
-    packetBuffer.push_back(1);
+}
+
+void Locomotive::updateMomentum(uint8_t slot, uint32_t elapsed) {
+  const int8_t target = _state.targetSpeed[slot];
+  const int8_t speed = _state.speed[slot];
+  if(speed == target) {
+    _state.speedFraction[slot] = 0;
+    return;
+  }
+  // speeds are handled as 8.8 fixed point values, the rate is the number of
+  // tenths of a second to cover LOCOMOTIVE_MAX_SPEED speed steps.
+  const uint8_t rate = target > speed ? _state.acceleration[slot] : _state.braking[slot];
+  int32_t current = (speed << 8) | _state.speedFraction[slot];
+  const int32_t goal = target << 8;
+  const int32_t step = rate ? (std::min<uint32_t>(elapsed, 1000) * (LOCOMOTIVE_MAX_SPEED << 8)) / (rate * 100) : INT16_MAX;
+  if(current < goal) {
+    current = std::min(current + step, goal);
   } else {
-    packetBuffer.push_back((uint8_t)(_speed + (_speed > 0) + _direction * 128));
+    current = std::max(current - step, goal);
+  }
+  _state.speed[slot] = current >> 8;
+  _state.speedFraction[slot] = current & 0xFF;
+  if(_state.speed[slot] != speed) {
+    _state.flags[slot] |= LOCOMOTIVE_STATE_SPEED_DUE;
+  }
+}
+
+void Locomotive::stopAll() {
+  for(uint8_t slot = 0; slot < MAX_LOCOMOTIVE_SLOTS; slot++) {
+    _state.speed[slot] = 0;
+    _state.speedFraction[slot] = 0;
+    _state.targetSpeed[slot] = 0;
+  }
+}
+
+// refresh interval (ms) for each of the function packets.
+static constexpr uint32_t functionRefreshInterval[MAX_LOCOMOTIVE_FUNCTION_PACKETS] = {
+  LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL, // F0-F4
+  LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL, // F5-F8
+  LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL, // F9-F12
+  LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL, // F13-F20
+  LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL // F21-F28
+};
+
+// Sends the speed packet and any function packets that have changed, these
+// are sent ahead of any refresh packets.
+void Locomotive::sendLocoUpdate() {
+  uint8_t packetBuffer[4];
+  uint8_t packetLength = createSpeedPacket(_slot, packetBuffer);
+  dccSignal[DCC_SIGNAL_OPERATIONS]->loadBytePacket(packetBuffer, packetLength, 0, false, DCC_PACKET_PRIORITY_INTERACTIVE);
+  const uint32_t now = millis();
+  _state.lastUpdate[_slot] = now;
+  _state.flags[_slot] &= ~LOCOMOTIVE_STATE_SPEED_DUE;
+  for(uint8_t functionPacket = 0; functionPacket < MAX_LOCOMOTIVE_FUNCTION_PACKETS; functionPacket++) {
+    if(bitRead(_changedFunctionPackets, functionPacket)) {
+      packetLength = createFunctionPacket(_slot, functionPacket, packetBuffer);
+      dccSignal[DCC_SIGNAL_OPERATIONS]->loadBytePacket(packetBuffer, packetLength, 0, false, DCC_PACKET_PRIORITY_INTERACTIVE);
+      bitClear(_changedFunctionPackets, functionPacket);
+      _state.lastFunctionUpdate[functionPacket][_slot] = now;
+    }
   }
-  dccSignal[DCC_SIGNAL_OPERATIONS]->loadPacket(packetBuffer, 0);
-  if(_functionsChanged) {
-    _functionsChanged = false;
-    createFunctionPackets();
+}
+
+void Locomotive::encodeSpeedPacket(Packet &packet) {
+  uint8_t packetBuffer[4];
+  const uint8_t packetLength = createSpeedPacket(_slot, packetBuffer);
+  encodeDCCPacket(packet, packetBuffer, packetLength);
+  packet.supersedeKey = SignalGenerator::getSupersedeKey(packetBuffer, packetLength);
+  _state.lastUpdate[_slot] = millis();
+  _state.flags[_slot] &= ~LOCOMOTIVE_STATE_SPEED_DUE;
+}
+
+// Fills packet with the next packet for the locomotive in slot which is due
+// for a refresh based on the LOCOMOTIVE_*_REFRESH_INTERVAL settings, the speed
+// packet is checked first. Returns false if there is nothing to send.
+bool Locomotive::getRefreshPacket(uint8_t slot, Packet &packet, uint32_t now) {
+  uint8_t packetBuffer[4];
+  // stopped locomotives are refreshed less often
+  const uint32_t minimumInterval = _state.speed[slot] > 0 ? 0 : LOCOMOTIVE_STOPPED_REFRESH_INTERVAL;
+  if((_state.flags[slot] & LOCOMOTIVE_STATE_SPEED_DUE) ||
+     now - _state.lastUpdate[slot] >= std::max<uint32_t>(LOCOMOTIVE_SPEED_REFRESH_INTERVAL, minimumInterval)) {
+    encodeDCCPacket(packet, packetBuffer, createSpeedPacket(slot, packetBuffer));
+    _state.lastUpdate[slot] = now;
+    _state.flags[slot] &= ~LOCOMOTIVE_STATE_SPEED_DUE;
+    return true;
   }
   for(uint8_t functionPacket = 0; functionPacket < MAX_LOCOMOTIVE_FUNCTION_PACKETS; functionPacket++) {
-    dccSignal[DCC_SIGNAL_OPERATIONS]->loadPacket(_functionPackets[functionPacket], 0);
+    if(now - _state.lastFunctionUpdate[functionPacket][slot] >=
+      std::max(functionRefreshInterval[functionPacket], minimumInterval)) {
+      encodeDCCPacket(packet, packetBuffer, createFunctionPacket(slot, functionPacket, packetBuffer));
+      _state.lastFunctionUpdate[functionPacket][slot] = now;
+      return true;
+    }
+  }
+  return false;
+}
+
+// builds the S-9.2.1 128 speed step packet, returns the packet length.
+uint8_t Locomotive::createSpeedPacket(uint8_t slot, uint8_t *packetBuffer) {
+  const uint16_t locoAddress = _state.address[slot];
+  uint8_t packetLength = 0;
+  if(locoAddress > 127) {
+    packetBuffer[packetLength++] = (uint8_t)(0xC0 | highByte(locoAddress));
+  }
+  packetBuffer[packetLength++] = lowByte(locoAddress);
+  // S-9.2.1 Advanced Operations instruction
+  // using 128 speed steps
+  packetBuffer[packetLength++] = 0x3F;
+  const int8_t speed = _state.speed[slot];
+  if(speed < 0) {
+    _state.speed[slot] = 0;
+    packetBuffer[packetLength++] = 1;
+  } else {
+    const bool forward = _state.flags[slot] & LOCOMOTIVE_STATE_FORWARD;
+    packetBuffer[packetLength++] = (uint8_t)(speed + (speed > 0) + forward * 128);
   }
-  _lastUpdate = millis();
+  return packetLength;
 }
 
 void Locomotive::showStatus() {
   log_i("Loco(%d) locoNumber: %d, speed: %d, direction: %s",
-    _registerNumber, _locoAddress, _speed, _direction ? JSON_VALUE_FORWARD.c_str() : JSON_VALUE_REVERSE.c_str());
-  wifiInterface.printf(F("<T %d %d %d>"), _registerNumber, _speed, _direction);
+    _registerNumber, getLocoAddress(), getSpeed(), isDirectionForward() ? JSON_VALUE_FORWARD.c_str() : JSON_VALUE_REVERSE.c_str());
+  // the target speed is reported so the response matches the throttle request
+  // even while momentum is being applied.
+  wifiInterface.printf(F("<T %d %d %d>"), _registerNumber, getTargetSpeed(), isDirectionForward());
 }
 
 void Locomotive::toJson(JsonObject &jsonObject, bool includeSpeedDir, bool includeFunctions) {
-  jsonObject[JSON_ADDRESS_NODE] = _locoAddress;
+  jsonObject[JSON_ADDRESS_NODE] = getLocoAddress();
   if(includeSpeedDir) {
-    jsonObject[JSON_SPEED_NODE] = _speed;
-    jsonObject[JSON_DIRECTION_NODE] = _direction ? JSON_VALUE_FORWARD : JSON_VALUE_REVERSE;
+    jsonObject[JSON_SPEED_NODE] = getSpeed();
+    jsonObject[JSON_TARGET_SPEED_NODE] = getTargetSpeed();
+    jsonObject[JSON_DIRECTION_NODE] = isDirectionForward() ? JSON_VALUE_FORWARD : JSON_VALUE_REVERSE;
   }
   jsonObject[JSON_ORIENTATION_NODE] = _orientation ? JSON_VALUE_FORWARD : JSON_VALUE_REVERSE;
   if(includeFunctions) {
@@ -79,80 +222,41 @@ void Locomotive::toJson(JsonObject &jsonObject, bool includeSpeedDir, bool inclu
     for(uint8_t funcID = 0; funcID < MAX_LOCOMOTIVE_FUNCTIONS; funcID++) {
       JsonObject &node = functions.createNestedObject();
       node[JSON_ID_NODE] = funcID;
-      node[JSON_STATE_NODE] = _functionState[funcID];
+      node[JSON_STATE_NODE] = isFunctionEnabled(funcID);
     }
   }
 }
 
-void Locomotive::createFunctionPackets() {
-  // seed functions packets with locomotive numbers
-  for(uint8_t functionPacket = 0; functionPacket < MAX_LOCOMOTIVE_FUNCTION_PACKETS; functionPacket++) {
-    _functionPackets[functionPacket].clear();
-    if(_locoAddress > 127) {
-      // convert train number into a two-byte address
-      _functionPackets[functionPacket].push_back((uint8_t)(0xC0 | highByte(_locoAddress)));
-    }
-    _functionPackets[functionPacket].push_back(lowByte(_locoAddress));
-  }
-
-  uint8_t packetByte[2] = {0x80, 0x00};
-  // convert functions 0 - 4
-  for(uint8_t funcID = 0; funcID <= 4; funcID++) {
-    if(funcID && _functionState[funcID]) {
-      bitSet(packetByte[0], funcID-1);
-    } else if(funcID) {
-      bitClear(packetByte[0], funcID-1);
-    } else if(_functionState[funcID]) {
-      bitSet(packetByte[0], 4);
-    } else {
-      bitClear(packetByte[0], 4);
-    }
-  }
-  _functionPackets[0].push_back((packetByte[0] | 0x80) & 0xBF);
-
-  // convert functions 5 - 8
-  packetByte[0] = 0xB0;
-  for(uint8_t funcID = 5; funcID <= 8; funcID++) {
-    if(_functionState[funcID]) {
-      bitSet(packetByte[0], funcID-5);
-    } else {
-      bitClear(packetByte[0], funcID-5);
-    }
-  }
-  _functionPackets[1].push_back((packetByte[0] | 0x80) & 0xBF);
-
-  // convert functions 9 - 12
-  packetByte[0] = 0xA0;
-  for(uint8_t funcID = 9; funcID <= 12; funcID++) {
-    if(_functionState[funcID]) {
-      bitSet(packetByte[0], funcID-9);
-    } else {
-      bitClear(packetByte[0], funcID-9);
-    }
+// builds one of the function group packets (F0-F4, F5-F8, F9-F12, F13-F20 or
+// F21-F28) from the function states, returns the packet length.
+uint8_t Locomotive::createFunctionPacket(uint8_t slot, uint8_t functionPacket, uint8_t *packetBuffer) {
+  const uint16_t locoAddress = _state.address[slot];
+  const uint32_t functions = _state.functions[slot];
+  uint8_t packetLength = 0;
+  if(locoAddress > 127) {
+    // convert train number into a two-byte address
+    packetBuffer[packetLength++] = (uint8_t)(0xC0 | highByte(locoAddress));
   }
-  _functionPackets[2].push_back((packetByte[0] | 0x80) & 0xBF);
-
-  // convert functions 13 - 20
-  packetByte[0] = 0xDE;
-  for(uint8_t funcID = 13; funcID <= 20; funcID++) {
-    if(_functionState[funcID]) {
-      bitSet(packetByte[1], funcID-13);
-    } else {
-      bitClear(packetByte[1], funcID-13);
-    }
-  }
-  _functionPackets[3].push_back((packetByte[0] | 0xDE) & 0xDF);
-  _functionPackets[3].push_back(packetByte[1]);
-
-  // convert functions 21 - 28
-  packetByte[0] = 0xDF;
-  for(uint8_t funcID = 21; funcID <= 28; funcID++) {
-    if(_functionState[funcID]) {
-      bitSet(packetByte[1], funcID-21);
-    } else {
-      bitClear(packetByte[1], funcID-21);
-    }
+  packetBuffer[packetLength++] = lowByte(locoAddress);
+  switch(functionPacket) {
+    case 0:
+      // FL is sent in bit 4, F1-F4 in bits 0-3
+      packetBuffer[packetLength++] = 0x80 | (bitRead(functions, 0) << 4) | ((functions >> 1) & 0x0F);
+      break;
+    case 1:
+      packetBuffer[packetLength++] = 0xB0 | ((functions >> 5) & 0x0F);
+      break;
+    case 2:
+      packetBuffer[packetLength++] = 0xA0 | ((functions >> 9) & 0x0F);
+      break;
+    case 3:
+      packetBuffer[packetLength++] = 0xDE;
+      packetBuffer[packetLength++] = (functions >> 13) & 0xFF;
+      break;
+    default:
+      packetBuffer[packetLength++] = 0xDF;
+      packetBuffer[packetLength++] = (functions >> 21) & 0xFF;
+      break;
   }
-  _functionPackets[4].push_back((packetByte[0] | 0xDE) & 0xDF);
-  _functionPackets[4].push_back(packetByte[1]);
+  return packetLength;
 }
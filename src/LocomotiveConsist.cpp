@@ -76,11 +76,32 @@ NO CV changes, when consist is addressed (either by LEAD or TRAIL loco), all
 locomotives in consist will be updated concurrently via multiple packet queuing.
 **********************************************************************/
 
+static ObjectPool<LocomotiveConsist, MAX_LOCOMOTIVE_CONSISTS> consistPool;
+
+void *LocomotiveConsist::operator new(size_t size) noexcept {
+  void *ptr = consistPool.allocate();
+  if(ptr == nullptr) {
+    log_w("Unable to allocate LocomotiveConsist, all %d are in use", MAX_LOCOMOTIVE_CONSISTS);
+  }
+  return ptr;
+}
+
+void LocomotiveConsist::operator delete(void *ptr) {
+  consistPool.release(ptr);
+}
+
 LocomotiveConsist::LocomotiveConsist(JsonObject &json) : Locomotive(json) {
   _decoderAssisstedConsist = json[JSON_DECODER_ASSISTED_NODE] == JSON_VALUE_TRUE;
-  for(auto loco : json.get<JsonArray>(JSON_LOCOS_NODE)) {
-    _locos.push_back(new Locomotive(loco.as<JsonObject &>()));
+  setRefreshEnabled(_decoderAssisstedConsist);
+  for(auto entry : json.get<JsonArray>(JSON_LOCOS_NODE)) {
+    auto loco = new Locomotive(entry.as<JsonObject &>());
+    if(loco != nullptr) {
+      loco->setRefreshEnabled(!_decoderAssisstedConsist);
+      _locos.push_back(loco);
+      LocomotiveManager::addConsistMember(loco->getLocoAddress(), this);
+    }
   }
+  applyLeadMomentum();
 }
 
 LocomotiveConsist::~LocomotiveConsist() {
@@ -128,7 +149,7 @@ bool LocomotiveConsist::isAddressInConsist(uint16_t locoAddress) {
 void LocomotiveConsist::updateThrottle(uint16_t locoAddress, int8_t speed, bool forward) {
   // only if the speed or direction is different than the last update should
   // we process any further
-  if (speed != getSpeed() || forward != isDirectionForward()) {
+  if (speed != getTargetSpeed() || forward != isDirectionForward()) {
     if (!_decoderAssisstedConsist) {
       // if it is a basic consist then sending a throttle request to any
       // locomotive in the consist will cause all locomotives to update
@@ -151,9 +172,18 @@ void LocomotiveConsist::updateThrottle(uint16_t locoAddress, int8_t speed, bool
 
 void LocomotiveConsist::addLocomotive(uint16_t locoAddress, bool forward,
   uint8_t position) {
-  Locomotive *loco = LocomotiveManager::getLocomotive(locoAddress, false);
+  // the consist owns its locomotives, these are separate from any locomotive
+  // managed by the LocomotiveManager for the same address.
+  Locomotive *loco = new Locomotive(-1);
+  if(loco == nullptr) {
+    return;
+  }
+  loco->setLocoAddress(locoAddress);
   loco->setOrientationForward(forward);
+  loco->setRefreshEnabled(!_decoderAssisstedConsist);
   _locos.push_back(loco);
+  LocomotiveManager::addConsistMember(locoAddress, this);
+  applyLeadMomentum();
   if(_decoderAssisstedConsist) {
     // write the loco consist address
     if(forward) {
@@ -168,11 +198,11 @@ void LocomotiveConsist::addLocomotive(uint16_t locoAddress, bool forward,
     // toggle FL/FR based on position, if it is the lead or trail locomotive
     // enable the function.
     if(position <= 1) {
-      _locos[position]->setFunction(0, true);
+      loco->setFunction(0, true);
       writeOpsCVBit(locoAddress, CV_NAMES::CONSIST_FUNCTION_CONTROL_FL_F9_F12,
         CONSIST_FUNCTION_CONTROL_FL_F9_F12_BITS::FL_BIT, false);
     } else {
-      _locos[position]->setFunction(0, false);
+      loco->setFunction(0, false);
       writeOpsCVBit(locoAddress, CV_NAMES::CONSIST_FUNCTION_CONTROL_FL_F9_F12,
         CONSIST_FUNCTION_CONTROL_FL_F9_F12_BITS::FL_BIT, true);
     }
@@ -193,14 +223,17 @@ void LocomotiveConsist::addLocomotive(uint16_t locoAddress, bool forward,
 bool LocomotiveConsist::removeLocomotive(uint16_t locoAddress) {
   uint8_t index = 0;
   bool locoFound = false;
-  for(uint8_t index = 0; index < _locos.size(); index++) {
+  for(; index < _locos.size(); index++) {
     if(_locos[index]->getLocoAddress() == locoAddress) {
       locoFound = true;
       break;
     }
   }
   if(locoFound) {
+    delete _locos[index];
     _locos.erase(_locos.begin() + index);
+    LocomotiveManager::removeConsistMember(locoAddress, this);
+    applyLeadMomentum();
     if(_decoderAssisstedConsist) {
       // if we are in an advanced consist, send a progtramming packet to clear
       // the consist address from the decoder
@@ -211,14 +244,27 @@ bool LocomotiveConsist::removeLocomotive(uint16_t locoAddress) {
   return locoFound;
 }
 
+void LocomotiveConsist::applyLeadMomentum() {
+  if(_locos.empty()) {
+    return;
+  }
+  const uint8_t acceleration = _locos[0]->getAcceleration();
+  const uint8_t braking = _locos[0]->getBraking();
+  setMomentum(acceleration, braking);
+  for (const auto& loco : _locos) {
+    loco->setMomentum(acceleration, braking);
+  }
+}
+
 void LocomotiveConsist::releaseLocomotives() {
   for(uint8_t index = 0; index < _locos.size(); index++) {
+    LocomotiveManager::removeConsistMember(_locos[index]->getLocoAddress(), this);
     delete _locos[index];
   }
   _locos.clear();
 }
 
-void ConsistCommandAdapter::process(const std::vector<String> arguments) {
+void ConsistCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if (arguments.empty()) {
     LocomotiveManager::showConsistStatus();
   } else if (arguments.size() == 1 &&
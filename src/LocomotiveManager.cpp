@@ -21,41 +21,111 @@ LinkedList<RosterEntry *> LocomotiveManager::_roster([](RosterEntry *entry) {del
 LinkedList<Locomotive *> LocomotiveManager::_locos([](Locomotive *loco) {delete loco; });
 LinkedList<LocomotiveConsist *> LocomotiveManager::_consists([](LocomotiveConsist *consist) {delete consist; });
 
-TaskHandle_t LocomotiveManager::_taskHandle;
+AddressIndex<Locomotive> LocomotiveManager::_locoIndex;
+AddressIndex<Locomotive> LocomotiveManager::_registerIndex;
+AddressIndex<LocomotiveConsist> LocomotiveManager::_consistIndex;
+AddressIndex<LocomotiveConsist> LocomotiveManager::_consistMemberIndex;
 xSemaphoreHandle LocomotiveManager::_lock;
+uint8_t LocomotiveManager::_refreshSlot{0};
+TaskHandle_t LocomotiveManager::_momentumTask;
+static LocomotiveRefreshSource refreshSource;
 
-void LocomotiveManager::processThrottle(const std::vector<String> arguments) {
+void LocomotiveManager::processThrottle(const DCCPPProtocolArguments &arguments) {
   int registerNumber = arguments[0].toInt();
   uint16_t locoAddress = arguments[1].toInt();
   if(isConsistAddress(locoAddress) || isAddressInConsist(locoAddress)) {
     processConsistThrottle(arguments);
     return;
   }
-  Locomotive *instance = getLocomotiveByRegister(registerNumber);
+  Locomotive *instance = getThrottleLocomotive(registerNumber, locoAddress);
   if(instance == nullptr) {
-    instance = new Locomotive(registerNumber);
-    _locos.add(instance);
+    wifiInterface.send(COMMAND_FAILED_RESPONSE);
+    return;
   }
-  instance->setLocoAddress(locoAddress);
   instance->setSpeed(arguments[2].toInt());
   instance->setDirection(arguments[3].toInt() == 1);
   instance->sendLocoUpdate();
   instance->showStatus();
 }
 
+void LocomotiveManager::processThrottleBatch(const DCCPPProtocolArguments &arguments) {
+  if(arguments.empty() || arguments.size() % 4 || arguments.size() / 4 > UINT8_MAX) {
+    wifiInterface.send(COMMAND_FAILED_RESPONSE);
+    return;
+  }
+  struct ConsistUpdate {
+    LocomotiveConsist *consist;
+    uint16_t locoAddress;
+    int8_t speed;
+    bool forward;
+  };
+  std::vector<Packet> packets;
+  packets.reserve(arguments.size() / 4);
+  std::vector<ConsistUpdate> consistUpdates;
+  uint16_t updated = 0;
+  uint16_t failed = 0;
+  MUTEX_LOCK(_lock);
+  for(size_t index = 0; index < arguments.size(); index += 4) {
+    const uint8_t registerNumber = arguments[index].toInt();
+    const uint16_t locoAddress = arguments[index + 1].toInt();
+    const int8_t speed = arguments[index + 2].toInt();
+    const bool forward = arguments[index + 3].toInt() == 1;
+    // consists send their own packets as they may need to update multiple
+    // locomotives, this is done once the lock has been released as queueing
+    // the packets may wait for room in the packet queue.
+    LocomotiveConsist *consist = getConsistByID(locoAddress);
+    if(consist == nullptr) {
+      consist = getConsistForLoco(locoAddress);
+    }
+    if(consist != nullptr) {
+      consistUpdates.push_back({consist, locoAddress, speed, forward});
+      updated++;
+      continue;
+    }
+    Locomotive *instance = getThrottleLocomotive(registerNumber, locoAddress);
+    if(instance == nullptr) {
+      failed++;
+      continue;
+    }
+    instance->setSpeed(speed);
+    instance->setDirection(forward);
+    packets.emplace_back();
+    instance->encodeSpeedPacket(packets.back());
+    packets.back().numberOfRepeats = 0;
+    updated++;
+  }
+  MUTEX_UNLOCK(_lock);
+  if(!packets.empty()) {
+    dccSignal[DCC_SIGNAL_OPERATIONS]->loadPacketBatch(packets.data(), packets.size());
+  }
+  for(auto &update : consistUpdates) {
+    update.consist->updateThrottle(update.locoAddress, update.speed, update.forward);
+  }
+  wifiInterface.printf(F("<tb %d %d>"), updated, failed);
+}
+
 // This method decodes the incoming function packet(s) to update the stored
 // functinon states. Loco update will be sent afterwards.
-void LocomotiveManager::processFunction(const std::vector<String> arguments) {
+void LocomotiveManager::processFunction(const DCCPPProtocolArguments &arguments) {
   int locoAddress = arguments[0].toInt();
   int functionByte = arguments[1].toInt();
+  // F13-F20 and F21-F28 are selected by 222 and 223, reject anything else
+  // rather than guessing the function group.
+  if(arguments.size() > 2 && functionByte != 222 && functionByte != 223) {
+    wifiInterface.send(COMMAND_FAILED_RESPONSE);
+    return;
+  }
   if(isConsistAddress(locoAddress)) {
     return;
   }
   auto loco = getLocomotive(locoAddress);
+  if(loco == nullptr) {
+    return;
+  }
   // check this is a request for functions F13-F28
   if(arguments.size() > 2) {
     int secondaryFunctionByte = arguments[2].toInt();
-    if((functionByte & 0xDE) == 0xDE) {
+    if(functionByte == 222) {
       for(uint8_t funcID = 13; funcID <= 20; funcID++) {
         loco->setFunction(funcID, bitRead(secondaryFunctionByte, funcID-13));
       }
@@ -86,15 +156,16 @@ void LocomotiveManager::processFunction(const std::vector<String> arguments) {
   loco->sendLocoUpdate();
 }
 
-void LocomotiveManager::processConsistThrottle(const std::vector<String> arguments) {
+void LocomotiveManager::processConsistThrottle(const DCCPPProtocolArguments &arguments) {
   uint16_t locoAddress = arguments[1].toInt();
   int8_t speed = arguments[2].toInt();
   bool forward = arguments[3].toInt() == 1;
-  for (const auto& consist : _consists) {
-    if (consist->getLocoAddress() == locoAddress || consist->isAddressInConsist(locoAddress)) {
-      consist->updateThrottle(locoAddress, speed, forward);
-      return;
-    }
+  LocomotiveConsist *consist = getConsistByID(locoAddress);
+  if(consist == nullptr) {
+    consist = getConsistForLoco(locoAddress);
+  }
+  if(consist != nullptr) {
+    consist->updateThrottle(locoAddress, speed, forward);
   }
 }
 
@@ -111,47 +182,72 @@ void LocomotiveManager::showConsistStatus() {
 	}
 }
 
-void LocomotiveManager::updateTask(void *param) {
+// Called by the OPS signal generator when it has nothing else to send. The
+// locomotive state slots which have refresh enabled (managed locomotives,
+// decoder assisted consists and the locomotives in command station consists)
+// are checked in turn for a packet that is due for a refresh, if none are due
+// nothing is returned and the signal generator sends an idle packet.
+bool LocomotiveManager::getRefreshPacket(Packet &packet) {
+  // the signal generator lock is held by the caller, never block here as the
+  // lock may be held by a task that is queueing a packet.
+  if(xSemaphoreTake(_lock, 0) != pdTRUE) {
+    return false;
+  }
+  const uint32_t now = millis();
+  bool found = false;
+  for(uint16_t count = 0; count < MAX_LOCOMOTIVE_SLOTS && !found; count++) {
+    _refreshSlot = (_refreshSlot + 1) % MAX_LOCOMOTIVE_SLOTS;
+    if((Locomotive::_state.flags[_refreshSlot] & LOCOMOTIVE_REFRESH_FLAGS) == LOCOMOTIVE_REFRESH_FLAGS) {
+      found = Locomotive::getRefreshPacket(_refreshSlot, packet, now);
+    }
+  }
+  MUTEX_UNLOCK(_lock);
+  return found;
+}
+
+// ramps the speed of any locomotives that have not reached their target speed,
+// a changed speed is flagged so the next refresh pass sends it ahead of the
+// other refresh packets.
+void LocomotiveManager::momentumTask(void *param) {
+  uint32_t lastUpdate = millis();
   while(true) {
-    if(dccSignal[DCC_SIGNAL_OPERATIONS]->isEnabled()) {
-      MUTEX_LOCK(_lock);
-      for (const auto& loco : _locos) {
-        // if it has been more than 50ms we should send a loco update packet
-        if(millis() > loco->getLastUpdate() + 50) {
-          loco->sendLocoUpdate();
-        }
-      }
-      for (const auto& loco : _consists) {
-        // if it has been more than 50ms we should send a loco update packet
-        if(millis() > loco->getLastUpdate() + 50) {
-          loco->sendLocoUpdate();
-        }
+    vTaskDelay(pdMS_TO_TICKS(LOCOMOTIVE_MOMENTUM_INTERVAL));
+    MUTEX_LOCK(_lock);
+    const uint32_t now = millis();
+    for(uint8_t slot = 0; slot < MAX_LOCOMOTIVE_SLOTS; slot++) {
+      if((Locomotive::_state.flags[slot] & LOCOMOTIVE_REFRESH_FLAGS) == LOCOMOTIVE_REFRESH_FLAGS) {
+        Locomotive::updateMomentum(slot, now - lastUpdate);
       }
-      MUTEX_UNLOCK(_lock);
     }
-    vTaskDelay(pdMS_TO_TICKS(25));
+    lastUpdate = now;
+    MUTEX_UNLOCK(_lock);
   }
 }
 
 void LocomotiveManager::emergencyStop() {
-  for (const auto& loco : _locos) {
-    loco->setSpeed(-1);
-	}
+  // all locomotives (including those in consists) are stopped immediately
+  // without momentum so they do not resume ramping once the eStop is cleared.
+  Locomotive::stopAll();
   sendDCCEmergencyStop();
 }
 
-Locomotive *LocomotiveManager::getLocomotive(const uint16_t locoAddress, const bool managed) {
+void LocomotiveManager::clearEmergencyStop() {
+  clearDCCEmergencyStop();
+}
+
+Locomotive *LocomotiveManager::getLocomotive(const uint16_t locoAddress, const bool create) {
   Locomotive *instance = nullptr;
   if(locoAddress) {
-    for (const auto& loco : _locos) {
-      if(loco->getLocoAddress() == locoAddress) {
-        instance = loco;
-      }
-    }
-    if(instance == nullptr) {
+    instance = _locoIndex.get(locoAddress);
+    if(instance == nullptr && create) {
       instance = new Locomotive(_locos.length());
-      instance->setLocoAddress(locoAddress);
-      if(managed) {
+      if(instance != nullptr) {
+        instance->setLocoAddress(locoAddress);
+        instance->setRefreshEnabled(true);
+        if(!indexLocomotive(instance)) {
+          delete instance;
+          return nullptr;
+        }
         _locos.add(instance);
       }
     }
@@ -159,41 +255,63 @@ Locomotive *LocomotiveManager::getLocomotive(const uint16_t locoAddress, const b
   return instance;
 }
 
-Locomotive *LocomotiveManager::getLocomotiveByRegister(const uint8_t registerNumber) {
-  for (const auto& loco : _locos) {
-    if(loco->getRegister() == registerNumber) {
-      return loco;
+// returns the locomotive for a throttle register, creating it when needed. The
+// locomotive is readdressed when the register was used for another address.
+Locomotive *LocomotiveManager::getThrottleLocomotive(const uint8_t registerNumber, const uint16_t locoAddress) {
+  Locomotive *instance = getLocomotiveByRegister(registerNumber);
+  if(instance == nullptr) {
+    instance = new Locomotive(registerNumber);
+    if(instance == nullptr) {
+      return nullptr;
+    }
+    instance->setLocoAddress(locoAddress);
+    instance->setRefreshEnabled(true);
+    if(!indexLocomotive(instance)) {
+      delete instance;
+      return nullptr;
+    }
+    _locos.add(instance);
+  } else if(instance->getLocoAddress() != locoAddress) {
+    unindexLocomotiveAddress(instance);
+    instance->setLocoAddress(locoAddress);
+    if(!_locoIndex.put(locoAddress, instance)) {
+      log_e("Unable to index Locomotive %d, out of memory", locoAddress);
     }
   }
-  return nullptr;
+  return instance;
+}
+
+Locomotive *LocomotiveManager::getLocomotiveByRegister(const uint8_t registerNumber) {
+  return _registerIndex.get(registerNumber);
 }
 
 void LocomotiveManager::removeLocomotive(const uint16_t locoAddress) {
+  // the idle packet is queued once the lock has been released as queueing it
+  // may wait for room in the packet queue.
+  Packet idlePacket;
+  bool removed = false;
   MUTEX_LOCK(_lock);
-  Locomotive *locoToRemove = nullptr;
-  for (const auto& loco : _locos) {
-    if(loco->getLocoAddress() == locoAddress) {
-      locoToRemove = loco;
-    }
-  }
+  Locomotive *locoToRemove = _locoIndex.get(locoAddress);
   if(locoToRemove != nullptr) {
     locoToRemove->setIdle();
-    locoToRemove->sendLocoUpdate();
+    locoToRemove->encodeSpeedPacket(idlePacket);
+    unindexLocomotiveAddress(locoToRemove);
+    unindexLocomotiveRegister(locoToRemove);
     _locos.remove(locoToRemove);
+    removed = true;
   }
   MUTEX_UNLOCK(_lock);
+  if(removed) {
+    dccSignal[DCC_SIGNAL_OPERATIONS]->loadPacket(idlePacket, 0);
+  }
 }
 
 bool LocomotiveManager::removeLocomotiveConsist(const uint16_t consistAddress) {
   MUTEX_LOCK(_lock);
-  LocomotiveConsist *consistToRemove = nullptr;
-  for (const auto& consist : _consists) {
-    if(consist->getLocoAddress() == consistAddress) {
-      consistToRemove = consist;
-    }
-  }
+  LocomotiveConsist *consistToRemove = getConsistByID(consistAddress);
   if (consistToRemove != nullptr) {
     consistToRemove->releaseLocomotives();
+    unindexConsist(consistToRemove);
     _consists.remove(consistToRemove);
     MUTEX_UNLOCK(_lock);
     return true;
@@ -211,7 +329,10 @@ void LocomotiveManager::init() {
   InfoScreen::replaceLine(INFO_SCREEN_ROTATING_STATUS_LINE, F("Found %02d Locos"), locoCount);
   if(locoCount > 0) {
     for(auto loco : root.get<JsonArray>(JSON_LOCOS_NODE)) {
-      _roster.add(new RosterEntry(loco.as<JsonObject &>()));
+      auto entry = new RosterEntry(loco.as<JsonObject &>());
+      if(entry != nullptr) {
+        _roster.add(entry);
+      }
     }
   }
   JsonObject &consistRoot = configStore.load(CONSISTS_JSON_FILE);
@@ -221,14 +342,26 @@ void LocomotiveManager::init() {
   InfoScreen::replaceLine(INFO_SCREEN_ROTATING_STATUS_LINE, F("Found %02d Consists"), consistCount);
   if(locoCount > 0) {
     for(auto consist : consistRoot.get<JsonArray>(JSON_CONSISTS_NODE)) {
-      _consists.add(new LocomotiveConsist(consist.as<JsonObject &>()));
+      auto instance = new LocomotiveConsist(consist.as<JsonObject &>());
+      if(instance != nullptr) {
+        _consists.add(instance);
+        // the consist is still usable from the list when it can't be indexed
+        indexConsist(instance);
+      }
     }
   }
-  xTaskCreate(updateTask, "LocomotiveManager", DEFAULT_THREAD_STACKSIZE, NULL, DEFAULT_THREAD_PRIO, &_taskHandle);
+  dccSignal[DCC_SIGNAL_OPERATIONS]->setRefreshSource(&refreshSource);
+  xTaskCreate(momentumTask, "LocoMomentum", DEFAULT_THREAD_STACKSIZE, NULL, DEFAULT_THREAD_PRIO, &_momentumTask);
 }
 
 void LocomotiveManager::clear() {
   MUTEX_LOCK(_lock);
+  // the indexes are cleared first so the consist destructors do not search
+  // the lists while they are being freed.
+  _locoIndex.clear();
+  _registerIndex.clear();
+  _consistIndex.clear();
+  _consistMemberIndex.clear();
   _locos.free();
   _consists.free();
   _roster.free();
@@ -295,39 +428,19 @@ void LocomotiveManager::getRosterEntries(JsonArray &array) {
 }
 
 bool LocomotiveManager::isConsistAddress(uint16_t address) {
-  for (const auto& consist : _consists) {
-    if(consist->getLocoAddress() == address) {
-      return true;
-    }
-  }
-  return false;
+  return _consistIndex.contains(address);
 }
 
 bool LocomotiveManager::isAddressInConsist(uint16_t address) {
-  for (const auto& consist : _consists) {
-    if(consist->isAddressInConsist(address)) {
-      return true;
-    }
-  }
-  return false;
+  return _consistMemberIndex.contains(address);
 }
 
 LocomotiveConsist *LocomotiveManager::getConsistByID(uint8_t consistAddress) {
-  for (const auto& consist : _consists) {
-    if(consist->getLocoAddress() == consistAddress) {
-      return consist;
-    }
-  }
-  return nullptr;
+  return _consistIndex.get(consistAddress);
 }
 
 LocomotiveConsist *LocomotiveManager::getConsistForLoco(uint16_t locomotiveAddress) {
-  for (const auto& consist : _consists) {
-    if(consist->isAddressInConsist(locomotiveAddress)) {
-      return consist;
-    }
-  }
-  return nullptr;
+  return _consistMemberIndex.get(locomotiveAddress);
 }
 
 LocomotiveConsist *LocomotiveManager::createLocomotiveConsist(int8_t consistAddress) {
@@ -343,19 +456,110 @@ LocomotiveConsist *LocomotiveManager::createLocomotiveConsist(int8_t consistAddr
     }
     if(newConsistAddress > 0) {
       log_i("Adding new Loco Consist %d", newConsistAddress);
-      _consists.add(new LocomotiveConsist(newConsistAddress, true));
-      return getConsistByID(newConsistAddress);
+      auto consist = new LocomotiveConsist(newConsistAddress, true);
+      if(consist != nullptr && !indexConsist(consist)) {
+        delete consist;
+        return nullptr;
+      }
+      if(consist != nullptr) {
+        _consists.add(consist);
+      }
+      return consist;
     } else {
       log_i("Unable to locate free address for new Loco Consist, giving up.");
     }
   } else {
     log_i("Adding new Loco Consist %d", consistAddress);
-    _consists.add(new LocomotiveConsist(abs(consistAddress), consistAddress < 0));
-    return getConsistByID(abs(consistAddress));
+    auto consist = new LocomotiveConsist(abs(consistAddress), consistAddress < 0);
+    if(consist != nullptr && !indexConsist(consist)) {
+      delete consist;
+      return nullptr;
+    }
+    if(consist != nullptr) {
+      _consists.add(consist);
+    }
+    return consist;
   }
   return nullptr;
 }
 
+void LocomotiveManager::addConsistMember(uint16_t address, LocomotiveConsist *consist) {
+  if(!_consistMemberIndex.contains(address) && !_consistMemberIndex.put(address, consist)) {
+    log_e("Unable to index LocomotiveConsist member %d, out of memory", address);
+  }
+}
+
+void LocomotiveManager::removeConsistMember(uint16_t address, LocomotiveConsist *consist) {
+  if(_consistMemberIndex.remove(address, consist)) {
+    // the locomotive may also be part of another consist
+    for (const auto& other : _consists) {
+      if(other != consist && other->isAddressInConsist(address)) {
+        _consistMemberIndex.put(address, other);
+        break;
+      }
+    }
+  }
+}
+
+// adds the locomotive to the address and register indexes, returns false (and
+// leaves both indexes unchanged) when there is not enough memory to do so.
+bool LocomotiveManager::indexLocomotive(Locomotive *loco) {
+  if(!_locoIndex.put(loco->getLocoAddress(), loco)) {
+    log_e("Unable to index Locomotive %d, out of memory", loco->getLocoAddress());
+    return false;
+  }
+  if(!_registerIndex.contains(loco->getRegister()) && !_registerIndex.put(loco->getRegister(), loco)) {
+    log_e("Unable to index Locomotive register %d, out of memory", loco->getRegister());
+    unindexLocomotiveAddress(loco);
+    return false;
+  }
+  return true;
+}
+
+void LocomotiveManager::unindexLocomotiveAddress(Locomotive *loco) {
+  const uint16_t address = loco->getLocoAddress();
+  if(_locoIndex.remove(address, loco)) {
+    for (const auto& other : _locos) {
+      if(other != loco && other->getLocoAddress() == address) {
+        _locoIndex.put(address, other);
+      }
+    }
+  }
+}
+
+void LocomotiveManager::unindexLocomotiveRegister(Locomotive *loco) {
+  const uint8_t registerNumber = loco->getRegister();
+  if(_registerIndex.remove(registerNumber, loco)) {
+    for (const auto& other : _locos) {
+      if(other != loco && other->getRegister() == registerNumber) {
+        _registerIndex.put(registerNumber, other);
+        break;
+      }
+    }
+  }
+}
+
+bool LocomotiveManager::indexConsist(LocomotiveConsist *consist) {
+  if(!_consistIndex.contains(consist->getLocoAddress()) &&
+     !_consistIndex.put(consist->getLocoAddress(), consist)) {
+    log_e("Unable to index LocomotiveConsist %d, out of memory", consist->getLocoAddress());
+    return false;
+  }
+  return true;
+}
+
+void LocomotiveManager::unindexConsist(LocomotiveConsist *consist) {
+  const uint16_t address = consist->getLocoAddress();
+  if(_consistIndex.remove(address, consist)) {
+    for (const auto& other : _consists) {
+      if(other != consist && other->getLocoAddress() == address) {
+        _consistIndex.put(address, other);
+        break;
+      }
+    }
+  }
+}
+
 RosterEntry *LocomotiveManager::getRosterEntry(uint16_t address, bool create) {
   RosterEntry *instance = nullptr;
   for (const auto& entry : _roster) {
@@ -366,7 +570,9 @@ RosterEntry *LocomotiveManager::getRosterEntry(uint16_t address, bool create) {
   if(instance == nullptr && create) {
     log_v("No roster entry for address %d, creating", address);
     instance = new RosterEntry(address);
-    _roster.add(instance);
+    if(instance != nullptr) {
+      _roster.add(instance);
+    }
   }
   return instance;
 }
@@ -386,12 +592,29 @@ void LocomotiveManager::removeRosterEntry(uint16_t address) {
   }
 }
 
+static ObjectPool<RosterEntry, MAX_ROSTER_ENTRIES> rosterPool;
+
+void *RosterEntry::operator new(size_t size) noexcept {
+  void *ptr = rosterPool.allocate();
+  if(ptr == nullptr) {
+    log_w("Unable to allocate RosterEntry, all %d are in use", MAX_ROSTER_ENTRIES);
+  }
+  return ptr;
+}
+
+void RosterEntry::operator delete(void *ptr) {
+  rosterPool.release(ptr);
+}
+
 RosterEntry::RosterEntry(const JsonObject &json) {
-  _description = json[JSON_DESCRIPTION_NODE].as<String>();
+  setDescription(json[JSON_DESCRIPTION_NODE].as<String>());
   _address = json[JSON_ADDRESS_NODE];
-  _type = json[JSON_TYPE_NODE].as<String>();
+  setType(json[JSON_TYPE_NODE].as<String>());
   _idleOnStartup = json[JSON_IDLE_ON_STARTUP_NODE] == JSON_VALUE_TRUE;
   _defaultOnThrottles = json[JSON_DEFAULT_ON_THROTTLE_NODE] == JSON_VALUE_TRUE;
+  // older roster entries do not have these and default to no momentum.
+  _acceleration = json[JSON_ACCELERATION_NODE];
+  _braking = json[JSON_BRAKING_NODE];
 }
 
 void RosterEntry::toJson(JsonObject &json) {
@@ -400,4 +623,6 @@ void RosterEntry::toJson(JsonObject &json) {
   json[JSON_TYPE_NODE] = _type;
   json[JSON_IDLE_ON_STARTUP_NODE] = _idleOnStartup ? JSON_VALUE_TRUE : JSON_VALUE_FALSE;
   json[JSON_DEFAULT_ON_THROTTLE_NODE] = _defaultOnThrottles ? JSON_VALUE_TRUE : JSON_VALUE_FALSE;
+  json[JSON_ACCELERATION_NODE] = _acceleration;
+  json[JSON_BRAKING_NODE] = _braking;
 }
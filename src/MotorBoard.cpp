@@ -50,7 +50,7 @@ void GenericMotorBoard::powerOn(bool announce) {
 #if LOCONET_ENABLED
     locoNet.reportPower(true);
 #endif
-		wifiInterface.printf(F("<p1 %s>"), _name.c_str());
+		wifiInterface.broadcastf(F("<p1 %s>"), _name.c_str());
 	}
 }
 
@@ -64,12 +64,12 @@ void GenericMotorBoard::powerOff(bool announce, bool overCurrent) {
 #if LOCONET_ENABLED
         locoNet.send(OPC_IDLE, 0, 0);
 #endif
-			  wifiInterface.printf(F("<p2 %s>"), _name.c_str());
+			  wifiInterface.broadcastf(F("<p2 %s>"), _name.c_str());
 		  } else {
 #if LOCONET_ENABLED
         locoNet.reportPower(false);
 #endif
-			  wifiInterface.printf(F("<p0 %s>"), _name.c_str());
+			  wifiInterface.broadcastf(F("<p0 %s>"), _name.c_str());
       }
 		}
 	}
@@ -157,6 +157,15 @@ void MotorBoardManager::registerBoard(adc1_channel_t sensePin, uint8_t enablePin
   motorBoards.add(new GenericMotorBoard(sensePin, enablePin, triggerAmps, maxAmps, name, programmingTrack));
 }
 
+void MotorBoardManager::registerBoard(const std::vector<MotorBoardDistrict> districts) {
+  for(const auto& district : districts) {
+    registerBoard(district.senseChannel, district.enablePin, district.type, district.name);
+    // the district shares the encoded OPS packet stream, only the output pin
+    // is added to the OPS signal generator.
+    dccSignal[DCC_SIGNAL_OPERATIONS]->addOutputPin(district.signalPin);
+  }
+}
+
 GenericMotorBoard *MotorBoardManager::getBoardByName(String name) {
   for (const auto& board : motorBoards) {
 		if(board->getName() == name) {
@@ -280,21 +289,21 @@ bool MotorBoardManager::isTrackPowerOn() {
   return state;
 }
 
-void CurrentDrawCommand::process(const std::vector<String> arguments) {
+void CurrentDrawCommand::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.size() == 0) {
     MotorBoardManager::showStatus();
   } else {
-    wifiInterface.printf(F("<a %d %s>"), MotorBoardManager::getLastRead(arguments[0]), arguments[0].c_str());
+    wifiInterface.printf(F("<a %d %s>"), MotorBoardManager::getLastRead(arguments[0].c_str()), arguments[0].c_str());
   }
 }
 
-void PowerOnCommand::process(const std::vector<String> arguments) {
+void PowerOnCommand::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.size() == 0) {
     MotorBoardManager::powerOnAll();
   }
 }
 
-void PowerOffCommand::process(const std::vector<String> arguments) {
+void PowerOffCommand::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.size() == 0) {
     MotorBoardManager::powerOffAll();
   }
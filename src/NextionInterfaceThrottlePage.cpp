@@ -220,8 +220,9 @@ void NextionThrottlePage::activateFunctionGroup(const NextionButton *button) {
 }
 
 void NextionThrottlePage::setLocoDirection(bool direction) {
-  if(_locoNumbers[_activeLoco]) {
-    LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setDirection(direction);
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
+    loco->setDirection(direction);
     if(direction) {
       _fwdButton.setPictureID(FWD_PIC_ON);
       _revButton.setPictureID(REV_PIC_OFF);
@@ -233,7 +234,8 @@ void NextionThrottlePage::setLocoDirection(bool direction) {
 }
 
 void NextionThrottlePage::toggleFunction(const NextionButton *button) {
-  if(_locoNumbers[_activeLoco]) {
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
     for(uint8_t function = 0; function < 10; function++) {
       uint16_t functionPicOff = _activeFunctionGroup * 8 + function + F1_PIC_OFF;
       uint16_t functionPicOn = _activeFunctionGroup * 8 + function + F1_PIC_ON;
@@ -241,22 +243,22 @@ void NextionThrottlePage::toggleFunction(const NextionButton *button) {
         if(function == FUNC_LIGHT_INDEX) { // Front Light
           if(_functionButtons[FUNC_LIGHT_INDEX].getPictureID() == F0_PIC_OFF) {
             _functionButtons[FUNC_LIGHT_INDEX].setPictureID(F0_PIC_ON);
-            LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setFunction(0, true);
+            loco->setFunction(0, true);
           } else {
             _functionButtons[FUNC_LIGHT_INDEX].setPictureID(F0_PIC_OFF);
-            LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setFunction(0, false);
+            loco->setFunction(0, false);
           }
         } else if(function == FUNC_CLEAR_INDEX) { // Clear all 28 functions... 29?
           for(uint8_t index = 0; index < 28; index++) {
-            LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setFunction(index, false);
+            loco->setFunction(index, false);
           }
         } else {
           if(_functionButtons[function].getPictureID() == functionPicOff) {
             _functionButtons[function].setPictureID(functionPicOn);
-            LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setFunction(_activeFunctionGroup * 8 + function + 1, true);
+            loco->setFunction(_activeFunctionGroup * 8 + function + 1, true);
           } else {
             _functionButtons[function].setPictureID(functionPicOff);
-            LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setFunction(_activeFunctionGroup * 8 + function + 1, false);
+            loco->setFunction(_activeFunctionGroup * 8 + function + 1, false);
           }
         }
       }
@@ -275,32 +277,35 @@ uint32_t NextionThrottlePage::getCurrentLocoAddress() {
 }
 
 void NextionThrottlePage::decreaseLocoSpeed() {
-  if(_locoNumbers[_activeLoco]) {
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
     int8_t speed = _speedNumber.getTextAsNumber() - SPEED_INCREMENT;
     if(speed < 0) {
       speed = 0;
     }
-    LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setSpeed(speed);
+    loco->setSpeed(speed);
     _speedNumber.setTextAsNumber(speed);
     _speedSlider.setValue(speed);
   }
 }
 
 void NextionThrottlePage::increaseLocoSpeed() {
-  if(_locoNumbers[_activeLoco]) {
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
     int8_t speed = _speedNumber.getTextAsNumber() + SPEED_INCREMENT;
     if(speed < 0) {
       speed = 0;
     }
-    LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setSpeed(speed);
+    loco->setSpeed(speed);
     _speedNumber.setTextAsNumber(speed);
     _speedSlider.setValue(speed);
   }
 }
 
 void NextionThrottlePage::setLocoSpeed(uint8_t speed) {
-  if(_locoNumbers[_activeLoco]) {
-    LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco])->setSpeed(speed);
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
+    loco->setSpeed(speed);
     _speedNumber.setTextAsNumber(speed);
     _speedSlider.setValue(speed);
   }
@@ -346,8 +351,8 @@ void NextionThrottlePage::refreshLocomotiveDetails()
       _locoButtons[index].setText("");
     }
   }
-  if(_locoNumbers[_activeLoco]) {
-    auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  auto loco = LocomotiveManager::getLocomotive(_locoNumbers[_activeLoco]);
+  if(loco) {
     _speedSlider.setValue(loco->getSpeed());
     _speedNumber.setTextAsNumber(loco->getSpeed());
     if(loco->isDirectionForward()) {
@@ -238,7 +238,7 @@ void Output::set(bool active, bool announce) {
   digitalWrite(_pin, _active);
   log_i("Output(%d) set to %s", _id, _active ? JSON_VALUE_ON : JSON_VALUE_OFF);
   if(announce) {
-    wifiInterface.printf(F("<Y %d %d>"), _id, !_active);
+    wifiInterface.broadcastf(F("<Y %d %d>"), _id, !_active);
   }
 }
 
@@ -279,7 +279,7 @@ void Output::showStatus() {
   wifiInterface.printf(F("<Y %d %d %d %d>"), _id, _pin, _flags, !_active);
 }
 
-void OutputCommandAdapter::process(const std::vector<String> arguments) {
+void OutputCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.empty()) {
     // list all outputs
     OutputManager::showStatus();
@@ -0,0 +1,156 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "DCCppESP32.h"
+
+/**********************************************************************
+
+DCC++ESP32 COMMAND STATION supports RailCom feedback on the OPS track.
+
+After each DCC packet the OPS signal generator sends the packet end bit and
+then shorts the track outputs (via RAILCOM_BRAKE_PIN) for the RailCom cutout.
+The bytes received from the RailCom detector during each channel of the
+cutout are captured by the signal generator ISR and decoded by a background
+task. The following are sent to all connected clients:
+  <RA ADDRESS>       : a decoder reported ADDRESS in channel 1, this is only
+                       sent when the detected address changes.
+  <RP ADDRESS VALUE> : the decoder at ADDRESS replied to a POM packet (read
+                       or write) with the CV VALUE.
+
+**********************************************************************/
+
+#if RAILCOM_ENABLED
+#include <driver/uart.h>
+#include <soc/uart_struct.h>
+
+#define RAILCOM_UART_DEV (RAILCOM_UART == 1 ? UART1 : UART2)
+
+SPSCRingBuffer<RailComCutout, InternalRAMAllocator> *RailComManager::_cutouts;
+RailComCutout *RailComManager::_activeCutout{nullptr};
+TaskHandle_t RailComManager::_taskHandle;
+RailComDecoder RailComManager::_decoder;
+uint16_t RailComManager::_detectedAddress{0};
+uint16_t RailComManager::_pomAddress{0};
+uint8_t RailComManager::_pomValue{0};
+uint32_t RailComManager::_pomTimestamp{0};
+volatile uint32_t RailComManager::_overflows{0};
+
+// reads (up to max) bytes from the UART RX FIFO, any additional bytes are
+// discarded. The UART driver is not installed, the FIFO is read directly
+// from the signal generator ISR.
+static inline __attribute__((always_inline)) uint8_t readRailComFIFO(uint8_t *buffer, uint8_t max) {
+  uint8_t count = 0;
+  while(RAILCOM_UART_DEV.status.rxfifo_cnt) {
+    const uint8_t value = RAILCOM_UART_DEV.fifo.rw_byte;
+    if(count < max) {
+      buffer[count++] = value;
+    }
+  }
+  return count;
+}
+
+void RailComManager::init() {
+  log_i("[RailCom] Configuring UART%d (RX: %d) and brake pin %d", RAILCOM_UART, RAILCOM_UART_RX_PIN, RAILCOM_BRAKE_PIN);
+  pinMode(RAILCOM_BRAKE_PIN, OUTPUT);
+  digitalWrite(RAILCOM_BRAKE_PIN, LOW);
+  uart_config_t config = {};
+  config.baud_rate = RAILCOM_BAUD_RATE;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  ESP_ERROR_CHECK(uart_param_config((uart_port_t)RAILCOM_UART, &config));
+  ESP_ERROR_CHECK(uart_set_pin((uart_port_t)RAILCOM_UART, UART_PIN_NO_CHANGE, RAILCOM_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+  _cutouts = new SPSCRingBuffer<RailComCutout, InternalRAMAllocator>(RAILCOM_CUTOUT_QUEUE_SIZE);
+  xTaskCreate(railComTask, "RailCom", DEFAULT_THREAD_STACKSIZE, NULL, DEFAULT_THREAD_PRIO, &_taskHandle);
+}
+
+void IRAM_ATTR RailComManager::startCutout(const Packet *packet) {
+  // discard anything received outside of the cutout
+  readRailComFIFO(nullptr, 0);
+  _activeCutout = _cutouts->reserve();
+  if(_activeCutout == nullptr) {
+    _overflows++;
+    return;
+  }
+  _activeCutout->timestamp = esp_timer_get_time();
+  for(uint8_t index = 0; index < 4; index++) {
+    _activeCutout->packet[index] = packet->buffer[index + 2];
+  }
+  _activeCutout->channel1Size = 0;
+  _activeCutout->channel2Size = 0;
+}
+
+void IRAM_ATTR RailComManager::endChannel1() {
+  if(_activeCutout != nullptr) {
+    _activeCutout->channel1Size = readRailComFIFO(_activeCutout->channel1, RAILCOM_CHANNEL1_BYTES);
+  }
+}
+
+void IRAM_ATTR RailComManager::endCutout() {
+  if(_activeCutout != nullptr) {
+    _activeCutout->channel2Size = readRailComFIFO(_activeCutout->channel2, RAILCOM_CHANNEL2_BYTES);
+    _activeCutout = nullptr;
+    _cutouts->commit();
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(_taskHandle, &higherPriorityTaskWoken);
+    if(higherPriorityTaskWoken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+void RailComManager::railComTask(void *param) {
+  RailComFeedback feedback;
+  uint32_t overflows = 0;
+  while(true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    RailComCutout *cutout;
+    while((cutout = _cutouts->peek()) != nullptr) {
+      _decoder.process(*cutout, feedback);
+      publish(*cutout, feedback);
+      _cutouts->pop();
+    }
+    if(overflows != _overflows) {
+      log_w("[RailCom] %d cutout(s) dropped, decoding is falling behind", _overflows - overflows);
+      overflows = _overflows;
+    }
+  }
+}
+
+void RailComManager::publish(const RailComCutout &cutout, const RailComFeedback &feedback) {
+  if(feedback.invalid) {
+    log_v("[RailCom] Cutout at %u contained %d invalid byte(s)", cutout.timestamp, feedback.invalid);
+  }
+  if(feedback.detectedAddress && feedback.detectedAddress != _detectedAddress) {
+    _detectedAddress = feedback.detectedAddress;
+    log_i("[RailCom] Detected decoder address %d", _detectedAddress);
+    wifiInterface.broadcastf(F("<RA %d>"), _detectedAddress);
+  }
+  if(feedback.pomValid && feedback.packetAddress) {
+    const uint32_t now = cutout.timestamp / 1000;
+    if(feedback.packetAddress != _pomAddress || feedback.pomValue != _pomValue ||
+       now - _pomTimestamp > RAILCOM_POM_REPORT_INTERVAL) {
+      log_i("[RailCom] Decoder %d POM value %d", feedback.packetAddress, feedback.pomValue);
+      wifiInterface.broadcastf(F("<RP %d %d>"), feedback.packetAddress, feedback.pomValue);
+    }
+    _pomAddress = feedback.packetAddress;
+    _pomValue = feedback.pomValue;
+    _pomTimestamp = now;
+  }
+}
+#endif
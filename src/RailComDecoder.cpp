@@ -0,0 +1,150 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "RailComDecoder.h"
+
+#define INV RAILCOM_CODE_INVALID
+#define ACK RAILCOM_CODE_ACK
+#define NACK RAILCOM_CODE_NACK
+#define BUSY RAILCOM_CODE_BUSY
+#define RSV RAILCOM_CODE_RESERVED
+
+// 4/8 decoding table from RCN-217, every valid RailCom byte has exactly four
+// bits set. Both 0x0F and 0xF0 are accepted as ACK since early decoders used
+// the former.
+const uint8_t RailComDecoder::_decodeTable[256] = {
+  INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, ACK, // 0x00
+  INV, INV, INV, INV, INV, INV, INV, 0x33, INV, INV, INV, 0x34, INV, 0x35, 0x36, INV, // 0x10
+  INV, INV, INV, INV, INV, INV, INV, 0x3A, INV, INV, INV, 0x3B, INV, 0x3C, 0x37, INV, // 0x20
+  INV, INV, INV, 0x3F, INV, 0x3D, 0x38, INV, INV, 0x3E, 0x39, INV, NACK, INV, INV, INV, // 0x30
+  INV, INV, INV, INV, INV, INV, INV, 0x24, INV, INV, INV, 0x23, INV, 0x22, 0x21, INV, // 0x40
+  INV, INV, INV, 0x1F, INV, 0x1E, 0x20, INV, INV, 0x1D, 0x1C, INV, 0x1B, INV, INV, INV, // 0x50
+  INV, INV, INV, 0x19, INV, 0x18, 0x1A, INV, INV, 0x17, 0x16, INV, 0x15, INV, INV, INV, // 0x60
+  INV, 0x25, 0x14, INV, 0x13, INV, INV, INV, 0x32, INV, INV, INV, INV, INV, INV, INV, // 0x70
+  INV, INV, INV, INV, INV, INV, INV, RSV, INV, INV, INV, 0x0E, INV, 0x0D, 0x0C, INV, // 0x80
+  INV, INV, INV, 0x0A, INV, 0x09, 0x0B, INV, INV, 0x08, 0x07, INV, 0x06, INV, INV, INV, // 0x90
+  INV, INV, INV, 0x04, INV, 0x03, 0x05, INV, INV, 0x02, 0x01, INV, 0x00, INV, INV, INV, // 0xA0
+  INV, 0x0F, 0x10, INV, 0x11, INV, INV, INV, 0x12, INV, INV, INV, INV, INV, INV, INV, // 0xB0
+  INV, INV, INV, RSV, INV, 0x2B, 0x30, INV, INV, 0x2A, 0x2F, INV, 0x31, INV, INV, INV, // 0xC0
+  INV, 0x29, 0x2E, INV, 0x2D, INV, INV, INV, 0x2C, INV, INV, INV, INV, INV, INV, INV, // 0xD0
+  INV, BUSY, 0x28, INV, 0x27, INV, INV, INV, 0x26, INV, INV, INV, INV, INV, INV, INV, // 0xE0
+  ACK, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, INV, // 0xF0
+};
+
+#undef INV
+#undef ACK
+#undef NACK
+#undef BUSY
+#undef RSV
+
+uint16_t RailComDecoder::getPacketAddress(const uint8_t *packet) {
+  // the first payload byte starts at bit 23 of the encoded packet (last bit
+  // of packet[0]) and the second payload byte occupies all of packet[2].
+  const uint8_t first = (packet[0] << 7) | (packet[1] >> 1);
+  const uint8_t second = packet[2];
+  if(first >= 1 && first <= 127) {
+    return first;
+  } else if(first >= 192 && first <= 231) {
+    return ((first & 0x3F) << 8) | second;
+  }
+  // broadcast, accessory or idle packet
+  return 0;
+}
+
+void RailComDecoder::process(const RailComCutout &cutout, RailComFeedback &feedback) {
+  feedback = RailComFeedback();
+  feedback.packetAddress = getPacketAddress(cutout.packet);
+
+  // channel 1 only carries a single 12 bit datagram (ADR_HIGH or ADR_LOW)
+  uint8_t index = 0;
+  if(cutout.channel1Size == RAILCOM_CHANNEL1_BYTES) {
+    parseDatagram(cutout.channel1, cutout.channel1Size, index, feedback);
+  } else if(cutout.channel1Size) {
+    feedback.invalid++;
+  }
+
+  // channel 2 may contain multiple datagrams and/or ACK/NACK/BUSY bytes
+  index = 0;
+  while(index < cutout.channel2Size) {
+    const uint8_t value = decode(cutout.channel2[index]);
+    if(value == RAILCOM_CODE_ACK) {
+      feedback.acks++;
+      index++;
+    } else if(value == RAILCOM_CODE_NACK) {
+      feedback.nacks++;
+      index++;
+    } else if(value == RAILCOM_CODE_BUSY) {
+      feedback.busy++;
+      index++;
+    } else if(!parseDatagram(cutout.channel2, cutout.channel2Size, index, feedback)) {
+      // the remaining bytes can not be aligned to a datagram boundary
+      break;
+    }
+  }
+}
+
+bool RailComDecoder::parseDatagram(const uint8_t *data, uint8_t size, uint8_t &index, RailComFeedback &feedback) {
+  const uint8_t first = decode(data[index]);
+  if(first > 0x3F) {
+    feedback.invalid++;
+    return false;
+  }
+  const uint8_t id = first >> 2;
+  // POM and address datagrams are 12 bits (two bytes), EXT and DYN are 18
+  // bits (three bytes), all others are 36 bits (six bytes).
+  uint8_t length = 6;
+  if(id == RAILCOM_DATAGRAM_POM || id == RAILCOM_DATAGRAM_ADR_HIGH || id == RAILCOM_DATAGRAM_ADR_LOW) {
+    length = 2;
+  } else if(id == RAILCOM_DATAGRAM_EXT || id == RAILCOM_DATAGRAM_DYN) {
+    length = 3;
+  }
+  if(index + length > size) {
+    feedback.invalid++;
+    return false;
+  }
+  for(uint8_t offset = 1; offset < length; offset++) {
+    if(decode(data[index + offset]) > 0x3F) {
+      feedback.invalid++;
+      return false;
+    }
+  }
+  if(length == 2) {
+    processDatagram(id, ((first & 0x03) << 6) | decode(data[index + 1]), feedback);
+  }
+  index += length;
+  return true;
+}
+
+void RailComDecoder::processDatagram(uint8_t id, uint8_t value, RailComFeedback &feedback) {
+  if(id == RAILCOM_DATAGRAM_POM) {
+    feedback.pomValid = true;
+    feedback.pomValue = value;
+    return;
+  } else if(id == RAILCOM_DATAGRAM_ADR_HIGH) {
+    _addressHigh = value;
+  } else {
+    _addressLow = value;
+  }
+  if(_addressHigh < 0 || _addressLow < 0) {
+    return;
+  }
+  if(_addressHigh == 0) {
+    feedback.detectedAddress = _addressLow & 0x7F;
+  } else if(_addressHigh & 0x80) {
+    feedback.detectedAddress = ((_addressHigh & 0x3F) << 8) | _addressLow;
+  }
+}
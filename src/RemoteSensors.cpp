@@ -173,7 +173,7 @@ void RemoteSensor::toJson(JsonObject &json, bool includeState) {
   json[F("pullUp")] = isPullUp();
 }
 
-void RemoteSensorsCommandAdapter::process(const std::vector<String> arguments) {
+void RemoteSensorsCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.empty()) {
     // list all sensors
     RemoteSensorManager::show();
@@ -291,7 +291,7 @@ void S88SensorBus::show() {
   }
 }
 
-void S88BusCommandAdapter::process(const std::vector<String> arguments) {
+void S88BusCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.empty()) {
     // list all sensor groups
     for (const auto& sensorBus : s88SensorBus) {
@@ -242,7 +242,7 @@ void Sensor::show() {
   wifiInterface.printf(F("<Q %d %d %d>"), _sensorID, _pin, _pullUp);
 }
 
-void SensorCommandAdapter::process(const std::vector<String> arguments) {
+void SensorCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.empty()) {
     // list all sensors
     for (const auto& sensor : sensors) {
@@ -311,13 +311,11 @@ void Turnout::toJson(JsonObject &json, bool readableStrings) {
 void Turnout::set(bool thrown, bool sendDCCPacket) {
   _thrown = thrown;
   if(sendDCCPacket) {
-    std::vector<String> args;
-    args.push_back(String(_boardAddress));
-    args.push_back(String(_index));
-    args.push_back(String(_thrown));
-    DCCPPProtocolHandler::getCommandHandler("a")->process(args);
+    char args[16];
+    snprintf(args, sizeof(args), "%d %d %d", _boardAddress, _index, _thrown);
+    DCCPPProtocolHandler::getCommandHandler("a")->process(DCCPPProtocolArguments(args));
   }
-  wifiInterface.printf(F("<H %d %d>"), _turnoutID, _thrown);
+  wifiInterface.broadcastf(F("<H %d %d>"), _turnoutID, _thrown);
   log_i("Turnout(%d) %s", _turnoutID, _thrown ? JSON_VALUE_THROWN.c_str() : JSON_VALUE_CLOSED.c_str());
 }
 
@@ -325,7 +323,7 @@ void Turnout::showStatus() {
   wifiInterface.printf(F("<H %d %d %d %d>"), _turnoutID, _address, _index, _thrown);
 }
 
-void TurnoutCommandAdapter::process(const std::vector<String> arguments) {
+void TurnoutCommandAdapter::process(const DCCPPProtocolArguments &arguments) {
   if(arguments.empty()) {
     // list all turnouts
     TurnoutManager::showStatus();
@@ -346,20 +344,20 @@ void TurnoutCommandAdapter::process(const std::vector<String> arguments) {
   }
 }
 
-void AccessoryCommand::process(const std::vector<String> arguments) {
+void AccessoryCommand::process(const DCCPPProtocolArguments &arguments) {
   if(dccSignal[DCC_SIGNAL_OPERATIONS]->isEnabled()) {
-    std::vector<uint8_t> packetBuffer;
     uint16_t boardAddress = arguments[0].toInt();
     uint8_t boardIndex = arguments[1].toInt();
     bool activate = arguments[2].toInt() == 1;
     log_v("DCC Accessory Packet %d:%d state: %d", boardAddress, boardIndex, activate);
-    // first byte is of the form 10AAAAAA, where AAAAAA represent 6 least
-    // signifcant bits of accessory address
-    packetBuffer.push_back(0x80 + boardAddress % 64);
-    // second byte is of the form 1AAACDDD, where C should be 1, and the least
-    // significant D represent activate/deactivate
-    packetBuffer.push_back(((((boardAddress / 64) % 8) << 4) +
-      (boardIndex % 4 << 1) + activate) ^ 0xF8);
-    dccSignal[DCC_SIGNAL_OPERATIONS]->loadPacket(packetBuffer, 1);
+    uint8_t packetBuffer[] = {
+      // first byte is of the form 10AAAAAA, where AAAAAA represent 6 least
+      // signifcant bits of accessory address
+      (uint8_t)(0x80 + boardAddress % 64),
+      // second byte is of the form 1AAACDDD, where C should be 1, and the least
+      // significant D represent activate/deactivate
+      (uint8_t)(((((boardAddress / 64) % 8) << 4) + (boardIndex % 4 << 1) + activate) ^ 0xF8)
+    };
+    dccSignal[DCC_SIGNAL_OPERATIONS]->loadBytePacket(packetBuffer, 2, 1, false, DCC_PACKET_PRIORITY_ACCESSORY);
   }
 }
@@ -16,6 +16,7 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 **********************************************************************/
 
 #include "DCCppESP32.h"
+#include <atomic>
 #include <ESPAsyncWebServer.h>
 #include <AsyncJson.h>
 #include <Update.h>
@@ -41,16 +42,35 @@ enum HTTP_STATUS_CODES {
 
 class WebSocketClient : public DCCPPProtocolConsumer {
 public:
-  WebSocketClient(int clientID, IPAddress remoteIP) : _id(clientID), _remoteIP(remoteIP) {
+  WebSocketClient(AsyncWebSocketClient *client) : _server(client->server()), _id(client->id()),
+    _remoteIP(client->remoteIP()) {
+  }
+  virtual ~WebSocketClient() {
+    unregister();
   }
-  virtual ~WebSocketClient() {}
   int getID() {
     return _id;
   }
+  // this is called from any task (with the protocol client list locked), the
+  // message is queued via the web socket server by client ID rather than via
+  // the AsyncWebSocketClient as the async_tcp task may be disconnecting and
+  // deleting that client at the same time. The server only hands out clients
+  // which are still connected, a message for any other client is dropped. The
+  // server sends the queued message when the socket is writable, a client
+  // whose queue is full is closed.
+  void send(const String &buf) {
+    if(!_server->availableForWrite(_id)) {
+      log_w("[WS %s] message queue is full, dropping slow client", getName().c_str());
+      _server->close(_id);
+    } else {
+      _server->text(_id, buf);
+    }
+  }
   String getName() {
     return _remoteIP.toString() + "/" + String(_id);
   }
 private:
+  AsyncWebSocket *_server;
   uint32_t _id;
   IPAddress _remoteIP;
 };
@@ -133,10 +153,20 @@ DCCPPWebServer::DCCPPWebServer() : AsyncWebServer(80), webSocket("/ws") {
     std::bind(&DCCPPWebServer::handleConfig, this, std::placeholders::_1));
   on("/locomotive", HTTP_GET | HTTP_POST | HTTP_PUT | HTTP_DELETE,
     std::bind(&DCCPPWebServer::handleLocomotive, this, std::placeholders::_1));
+  on("/diagnostics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    auto jsonResponse = new AsyncJsonResponse(true);
+    JsonArray &array = jsonResponse->getRoot();
+    for(auto generator : dccSignal) {
+      generator->toJson(array.createNestedObject());
+    }
+    jsonResponse->setCode(STATUS_OK);
+    jsonResponse->setLength();
+    request->send(jsonResponse);
+  });
   webSocket.onEvent([](AsyncWebSocket * server, AsyncWebSocketClient * client,
       AwsEventType type, void * arg, uint8_t *data, size_t len) {
     if (type == WS_EVT_CONNECT) {
-      webSocketClients.add(new WebSocketClient(client->id(), client->remoteIP()));
+      webSocketClients.add(new WebSocketClient(client));
       client->printf("DCC++ESP32 v%s. READY!", VERSION);
   #if INFO_SCREEN_WS_CLIENTS_LINE >= 0
       InfoScreen::printf(12, INFO_SCREEN_WS_CLIENTS_LINE, F("%02d"), webSocketClients.length());
@@ -149,6 +179,8 @@ DCCPPWebServer::DCCPPWebServer() : AsyncWebServer(80), webSocket("/ws") {
         }
       }
       if(toRemove != nullptr) {
+        log_i("WebSocket %s disconnected (dropped frames: %d, oversized frames: %d)",
+          toRemove->getName().c_str(), toRemove->getDroppedFrames(), toRemove->getOversizedFrames());
         webSocketClients.remove(toRemove);
       }
   #if INFO_SCREEN_WS_CLIENTS_LINE >= 0
@@ -218,111 +250,196 @@ DCCPPWebServer::DCCPPWebServer() : AsyncWebServer(80), webSocket("/ws") {
   addHandler(&webSocket);
 }
 
+// sends an empty JSON response with the provided status code.
+static void sendProgrammerStatus(AsyncWebServerRequest *request, int code) {
+  auto jsonResponse = new AsyncJsonResponse();
+  jsonResponse->setCode(code);
+  jsonResponse->setLength();
+  request->send(jsonResponse);
+}
+
+// result of a programming track job, this is written by the programming track
+// worker task and only read by the web server once complete is set.
+struct ProgrammerJobResult {
+  std::atomic<bool> complete{false};
+  int code{STATUS_OK};
+  String body;
+};
+
+// response for a programming track job. The web server (async_tcp) task polls
+// the connection of a request whose response has not been sent yet, this
+// holds back the response until the job has completed and then sends it from
+// that poll so the connection is never touched by the worker task. When the
+// client disconnects the response is deleted by the web server while the job
+// only keeps the result alive.
+class ProgrammerJobResponse : public AsyncAbstractResponse {
+public:
+  ProgrammerJobResponse(std::shared_ptr<ProgrammerJobResult> result) : _result(result) {
+    _contentType = JSON_MIMETYPE;
+  }
+  bool _sourceValid() const override {
+    return true;
+  }
+  void _respond(AsyncWebServerRequest *request) override {
+    if(_result->complete.load(std::memory_order_acquire)) {
+      start(request);
+    } else {
+      _waiting = true;
+    }
+  }
+  size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) override {
+    if(_waiting) {
+      if(_result->complete.load(std::memory_order_acquire)) {
+        _waiting = false;
+        start(request);
+      }
+      return 0;
+    }
+    return AsyncAbstractResponse::_ack(request, len, time);
+  }
+  size_t _fillBuffer(uint8_t *buffer, size_t maxLen) override {
+    const size_t length = std::min(maxLen, _result->body.length() - _offset);
+    memcpy(buffer, _result->body.c_str() + _offset, length);
+    _offset += length;
+    return length;
+  }
+private:
+  void start(AsyncWebServerRequest *request) {
+    _code = _result->code;
+    _contentLength = _result->body.length();
+    AsyncAbstractResponse::_respond(request);
+  }
+  std::shared_ptr<ProgrammerJobResult> _result;
+  bool _waiting{false};
+  size_t _offset{0};
+};
+
+// reads the decoder configuration and address from the decoder on the
+// programming track, this is called from the programming track worker task.
+static int identifyDecoder(JsonObject &node, bool create) {
+  int code = STATUS_OK;
+  int16_t decoderConfig = readCV(CV_NAMES::DECODER_CONFIG);
+  uint16_t decoderAddress = 0;
+  if(decoderConfig > 0) {
+    if(bitRead(decoderConfig, DECODER_CONFIG_BITS::DECODER_TYPE)) {
+      uint8_t decoderManufacturer = readCV(CV_NAMES::DECODER_MANUFACTURER);
+      int16_t addrMSB = readCV(CV_NAMES::ACCESSORY_DECODER_MSB_ADDRESS);
+      int16_t addrLSB = readCV(CV_NAMES::SHORT_ADDRESS);
+      if(addrMSB >= 0 && addrLSB >= 0) {
+        if(decoderManufacturer == 0xA5) { // MERG uses 7 bit LSB
+          decoderAddress = (uint16_t)(((addrMSB & 0x07) << 7) | (addrLSB & 0x7F));
+        } else if(decoderManufacturer == 0x19) { // Team Digital uses 8 bit LSB and 4 bit MSB
+          decoderAddress = (uint16_t)(((addrMSB & 0x0F) << 8) | addrLSB);
+        } else { // NMRA spec shows 6 bit LSB
+          decoderAddress = (uint16_t)(((addrMSB & 0x07) << 6) | (addrLSB & 0x1F));
+        }
+        node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_LONG_ADDRESS;
+      } else {
+        log_w("Failed to read address MSB/LSB");
+        code = STATUS_SERVER_ERROR;
+      }
+    } else {
+      if(bitRead(decoderConfig, DECODER_CONFIG_BITS::SHORT_OR_LONG_ADDRESS)) {
+        int16_t addrMSB = readCV(CV_NAMES::LONG_ADDRESS_MSB_ADDRESS);
+        int16_t addrLSB = readCV(CV_NAMES::LONG_ADDRESS_LSB_ADDRESS);
+        if(addrMSB >= 0 && addrLSB >= 0) {
+          decoderAddress = (uint16_t)(((addrMSB & 0xFF) << 8) | (addrLSB & 0xFF));
+          node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_LONG_ADDRESS;
+        } else {
+          log_w("Unable to read address MSB/LSB");
+          code = STATUS_SERVER_ERROR;
+        }
+      } else {
+        int16_t shortAddr = readCV(CV_NAMES::SHORT_ADDRESS);
+        if(shortAddr > 0) {
+          decoderAddress = shortAddr;
+          node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_SHORT_ADDRESS;
+        } else {
+          log_w("Unable to read short address CV");
+          code = STATUS_SERVER_ERROR;
+        }
+      }
+      if(bitRead(decoderConfig, DECODER_CONFIG_BITS::SPEED_TABLE)) {
+        node[JSON_SPEED_TABLE_NODE] = JSON_VALUE_ON;
+      } else {
+        node[JSON_SPEED_TABLE_NODE] = JSON_VALUE_OFF;
+      }
+    }
+    if(decoderAddress > 0) {
+      node[JSON_ADDRESS_NODE] = decoderAddress;
+      auto roster = LocomotiveManager::getRosterEntry(decoderAddress, false);
+      if(roster) {
+        node[JSON_LOCO_NODE] = roster;
+      } else if(create) {
+        roster = LocomotiveManager::getRosterEntry(decoderAddress);
+        if(roster && decoderConfig > 0) {
+          if(bitRead(decoderConfig, DECODER_CONFIG_BITS::DECODER_TYPE)) {
+            roster->setType(JSON_VALUE_STATIONARY_DECODER);
+          } else {
+            roster->setType(JSON_VALUE_MOBILE_DECODER);
+          }
+        }
+        node[JSON_LOCO_NODE] = roster;
+      }
+    } else {
+      log_w("Failed to read decoder address");
+      code = STATUS_SERVER_ERROR;
+    }
+  } else {
+    log_w("Failed to read decoder configuration");
+    code = STATUS_SERVER_ERROR;
+  }
+  return code;
+}
+
+// queues a programming track job for the request, the job fills in the JSON
+// response and returns the status code. The response is sent by the web
+// server once the job completes, see ProgrammerJobResponse.
+void DCCPPWebServer::queueProgrammerJob(AsyncWebServerRequest *request,
+  std::function<int(JsonObject &)> job) {
+  auto result = std::make_shared<ProgrammerJobResult>();
+  if(!ProgTrackManager::queue([result, job](bool energized) {
+    DynamicJsonBuffer buffer;
+    JsonObject &root = buffer.createObject();
+    if(energized) {
+      result->code = job(root);
+    } else {
+      log_w("Failed to energize the programming track");
+      result->code = STATUS_SERVER_ERROR;
+    }
+    root.printTo(result->body);
+    result->complete.store(true, std::memory_order_release);
+  })) {
+    sendProgrammerStatus(request, STATUS_SERVER_ERROR);
+    return;
+  }
+  request->send(new ProgrammerJobResponse(result));
+}
+
 void DCCPPWebServer::handleProgrammer(AsyncWebServerRequest *request) {
- 	auto jsonResponse = new AsyncJsonResponse();
   if(!MotorBoardManager::getBoardByName(MOTORBOARD_NAME_PROG)->isOn()) {
     MotorBoardManager::powerOn(MOTORBOARD_NAME_PROG);
   }
-	// new programmer request
+  // programming track requests are run by the programming track worker task,
+  // the arguments are captured here as the job may run after the client has
+  // disconnected.
 	if (request->method() == HTTP_GET) {
 		if (request->arg(JSON_PROG_ON_MAIN.c_str()).equalsIgnoreCase(JSON_VALUE_TRUE)) {
-			jsonResponse->setCode(STATUS_NOT_ALLOWED);
+			sendProgrammerStatus(request, STATUS_NOT_ALLOWED);
 		} else if(request->hasArg(JSON_IDENTIFY_NODE.c_str())) {
-      JsonObject &node = jsonResponse->getRoot();
-      if(enterProgrammingMode()) {
-        int16_t decoderConfig = readCV(CV_NAMES::DECODER_CONFIG);
-        uint16_t decoderAddress = 0;
-        if(decoderConfig > 0) {
-          if(bitRead(decoderConfig, DECODER_CONFIG_BITS::DECODER_TYPE)) {
-            uint8_t decoderManufacturer = readCV(CV_NAMES::DECODER_MANUFACTURER);
-            int16_t addrMSB = readCV(CV_NAMES::ACCESSORY_DECODER_MSB_ADDRESS);
-            int16_t addrLSB = readCV(CV_NAMES::SHORT_ADDRESS);
-            if(addrMSB >= 0 && addrLSB >= 0) {
-              if(decoderManufacturer == 0xA5) { // MERG uses 7 bit LSB
-                decoderAddress = (uint16_t)(((addrMSB & 0x07) << 7) | (addrLSB & 0x7F));
-              } else if(decoderManufacturer == 0x19) { // Team Digital uses 8 bit LSB and 4 bit MSB
-                decoderAddress = (uint16_t)(((addrMSB & 0x0F) << 8) | addrLSB);
-              } else { // NMRA spec shows 6 bit LSB
-                decoderAddress = (uint16_t)(((addrMSB & 0x07) << 6) | (addrLSB & 0x1F));
-              }
-              node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_LONG_ADDRESS;
-            } else {
-              log_w("Failed to read address MSB/LSB");
-              jsonResponse->setCode(STATUS_SERVER_ERROR);
-            }
-          } else {
-            if(bitRead(decoderConfig, DECODER_CONFIG_BITS::SHORT_OR_LONG_ADDRESS)) {
-              int16_t addrMSB = readCV(CV_NAMES::LONG_ADDRESS_MSB_ADDRESS);
-              int16_t addrLSB = readCV(CV_NAMES::LONG_ADDRESS_LSB_ADDRESS);
-              if(addrMSB >= 0 && addrLSB >= 0) {
-                decoderAddress = (uint16_t)(((addrMSB & 0xFF) << 8) | (addrLSB & 0xFF));
-                node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_LONG_ADDRESS;
-              } else {
-                log_w("Unable to read address MSB/LSB");
-                jsonResponse->setCode(STATUS_SERVER_ERROR);
-              }
-            } else {
-              int16_t shortAddr = readCV(CV_NAMES::SHORT_ADDRESS);
-              if(shortAddr > 0) {
-                decoderAddress = shortAddr;
-                node[JSON_ADDRESS_MODE_NODE] = JSON_VALUE_SHORT_ADDRESS;
-              } else {
-                log_w("Unable to read short address CV");
-                jsonResponse->setCode(STATUS_SERVER_ERROR);
-              }
-            }
-            if(bitRead(decoderConfig, DECODER_CONFIG_BITS::SPEED_TABLE)) {
-              node[JSON_SPEED_TABLE_NODE] = JSON_VALUE_ON;
-            } else {
-              node[JSON_SPEED_TABLE_NODE] = JSON_VALUE_OFF;
-            }
-          }
-          if(decoderAddress > 0) {
-            node[JSON_ADDRESS_NODE] = decoderAddress;
-            auto roster = LocomotiveManager::getRosterEntry(decoderAddress, false);
-            if(roster) {
-              node[JSON_LOCO_NODE] = roster;
-            } else if(request->hasArg(JSON_CREATE_NODE.c_str()) && request->arg(JSON_CREATE_NODE).equalsIgnoreCase(JSON_VALUE_TRUE)) {
-              roster = LocomotiveManager::getRosterEntry(decoderAddress);
-              if(decoderConfig > 0) {
-                if(bitRead(decoderConfig, DECODER_CONFIG_BITS::DECODER_TYPE)) {
-                  roster->setType(JSON_VALUE_STATIONARY_DECODER);
-                } else {
-                  roster->setType(JSON_VALUE_MOBILE_DECODER);
-                }
-              }
-              node[JSON_LOCO_NODE] = roster;
-            }
-          } else {
-            log_w("Failed to read decoder address");
-            jsonResponse->setCode(STATUS_SERVER_ERROR);
-          }
-        } else {
-          log_w("Failed to read decoder configuration");
-          jsonResponse->setCode(STATUS_SERVER_ERROR);
-        }
-        leaveProgrammingMode();
-      } else {
-        log_w("Programmer already in use");
-        jsonResponse->setCode(STATUS_SERVER_ERROR);
-      }
+      const bool create = request->hasArg(JSON_CREATE_NODE.c_str()) &&
+        request->arg(JSON_CREATE_NODE).equalsIgnoreCase(JSON_VALUE_TRUE);
+      queueProgrammerJob(request, [create](JsonObject &node) {
+        return identifyDecoder(node, create);
+      });
     } else {
-      uint16_t cvNumber = request->arg(JSON_CV_NODE.c_str()).toInt();
-      if(enterProgrammingMode()) {
+      const uint16_t cvNumber = request->arg(JSON_CV_NODE.c_str()).toInt();
+      queueProgrammerJob(request, [cvNumber](JsonObject &node) {
         int16_t cvValue = readCV(cvNumber);
-        JsonObject &node = jsonResponse->getRoot();
         node[JSON_CV_NODE] = cvNumber;
         node[JSON_VALUE_NODE] = cvValue;
-        if(cvValue < 0) {
-          jsonResponse->setCode(STATUS_SERVER_ERROR);
-        } else {
-          jsonResponse->setCode(STATUS_OK);
-        }
-        leaveProgrammingMode();
-      } else {
-        log_w("Programmer already in use");
-        jsonResponse->setCode(STATUS_SERVER_ERROR);
-      }
+        return cvValue < 0 ? STATUS_SERVER_ERROR : STATUS_OK;
+      });
 		}
   } else if(request->method() == HTTP_POST && request->hasArg(JSON_PROG_ON_MAIN.c_str())) {
     if (request->arg(JSON_PROG_ON_MAIN.c_str()).equalsIgnoreCase(JSON_VALUE_TRUE)) {
@@ -333,33 +450,26 @@ void DCCPPWebServer::handleProgrammer(AsyncWebServerRequest *request) {
         writeOpsCVByte(request->arg(JSON_ADDRESS_NODE.c_str()).toInt(), request->arg(JSON_CV_NODE.c_str()).toInt(),
           request->arg(JSON_VALUE_NODE.c_str()).toInt());
       }
-			jsonResponse->setCode(STATUS_OK);
+			sendProgrammerStatus(request, STATUS_OK);
 		} else {
-      bool writeSuccess = false;
-      if(enterProgrammingMode()) {
-        if(request->hasArg(JSON_CV_BIT_NODE.c_str())) {
-          writeSuccess = writeProgCVBit(request->arg(JSON_CV_NODE.c_str()).toInt(), request->arg(JSON_CV_BIT_NODE.c_str()).toInt(),
-            request->arg(JSON_VALUE_NODE.c_str()).equalsIgnoreCase(JSON_VALUE_TRUE));
-        } else {
-          writeSuccess = writeProgCVByte(request->arg(JSON_CV_NODE.c_str()).toInt(), request->arg(JSON_VALUE_NODE.c_str()).toInt());
-        }
-        leaveProgrammingMode();
-      }
-      if(writeSuccess) {
-        jsonResponse->setCode(STATUS_OK);
+      const uint16_t cvNumber = request->arg(JSON_CV_NODE.c_str()).toInt();
+      if(request->hasArg(JSON_CV_BIT_NODE.c_str())) {
+        const uint8_t bit = request->arg(JSON_CV_BIT_NODE.c_str()).toInt();
+        const bool value = request->arg(JSON_VALUE_NODE.c_str()).equalsIgnoreCase(JSON_VALUE_TRUE);
+        queueProgrammerJob(request, [cvNumber, bit, value](JsonObject &) {
+          return writeProgCVBit(cvNumber, bit, value) ? STATUS_OK : STATUS_SERVER_ERROR;
+        });
       } else {
-        jsonResponse->setCode(STATUS_SERVER_ERROR);
+        const uint8_t value = request->arg(JSON_VALUE_NODE.c_str()).toInt();
+        queueProgrammerJob(request, [cvNumber, value](JsonObject &) {
+          return writeProgCVByte(cvNumber, value) ? STATUS_OK : STATUS_SERVER_ERROR;
+        });
       }
 		}
   } else {
-    jsonResponse->setCode(STATUS_BAD_REQUEST);
+    sendProgrammerStatus(request, STATUS_BAD_REQUEST);
   }
-  log_d("Setting response size");
-	jsonResponse->setLength();
-  log_d("Sending response, %d bytes", jsonResponse->getSize());
-	request->send(jsonResponse);
-  log_d("sent");
- }
+}
 
 void DCCPPWebServer::handlePower(AsyncWebServerRequest *request) {
  	auto jsonResponse = new AsyncJsonResponse(true);
@@ -503,7 +613,7 @@ void DCCPPWebServer::handleSensors(AsyncWebServerRequest *request) {
 }
 
 void DCCPPWebServer::handleConfig(AsyncWebServerRequest *request) {
-  std::vector<String> arguments;
+  DCCPPProtocolArguments arguments;
   if(request->method() == HTTP_POST) {
     DCCPPProtocolHandler::getCommandHandler("E")->process(arguments);
   } else {
@@ -550,6 +660,7 @@ void DCCPPWebServer::handleRemoteSensors(AsyncWebServerRequest *request) {
 
 void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
   // method - url pattern - meaning
+  // DELETE /locomotive/estop - release the emergency stop
   // ANY /locomotive/estop - send emergency stop to all locomotives
   // GET /locomotive/roster - roster
   // GET /locomotive/roster?address=<address> - get roster entry
@@ -565,9 +676,13 @@ void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
   auto jsonResponse = new AsyncJsonResponse(request->method() == HTTP_GET && !request->params());
   jsonResponse->setCode(STATUS_OK);
   // check if we have an eStop command, we don't care how this gets sent to the
-  // command station (method) so check it first
+  // command station (method other than DELETE) so check it first
   if(url.endsWith("/estop")) {
-    LocomotiveManager::emergencyStop();
+    if(request->method() == HTTP_DELETE) {
+      LocomotiveManager::clearEmergencyStop();
+    } else {
+      LocomotiveManager::emergencyStop();
+    }
   } else if(url.indexOf("/roster") > 0) {
     if(request->method() == HTTP_GET && !request->hasArg(JSON_ADDRESS_NODE.c_str())) {
       LocomotiveManager::getRosterEntries(jsonResponse->getRoot());
@@ -576,7 +691,9 @@ void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
         LocomotiveManager::removeRosterEntry(request->arg(JSON_ADDRESS_NODE).toInt());
       } else {
         RosterEntry *entry = LocomotiveManager::getRosterEntry(request->arg(JSON_ADDRESS_NODE).toInt());
-        if(request->method() == HTTP_PUT || request->method() == HTTP_POST) {
+        if(entry == nullptr) {
+          jsonResponse->setCode(STATUS_SERVER_ERROR);
+        } else if(request->method() == HTTP_PUT || request->method() == HTTP_POST) {
           if(request->hasArg(JSON_DESCRIPTION_NODE.c_str())) {
             entry->setDescription(request->arg(JSON_DESCRIPTION_NODE));
           }
@@ -589,8 +706,21 @@ void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
           if(request->hasArg(JSON_DEFAULT_ON_THROTTLE_NODE.c_str())) {
             entry->setDefaultOnThrottles(request->arg(JSON_DEFAULT_ON_THROTTLE_NODE).equalsIgnoreCase(JSON_VALUE_TRUE));
           }
+          if(request->hasArg(JSON_ACCELERATION_NODE.c_str())) {
+            entry->setAcceleration(request->arg(JSON_ACCELERATION_NODE).toInt());
+          }
+          if(request->hasArg(JSON_BRAKING_NODE.c_str())) {
+            entry->setBraking(request->arg(JSON_BRAKING_NODE).toInt());
+          }
+          // apply any momentum change to the active locomotive
+          auto loco = LocomotiveManager::getLocomotive(entry->getAddress(), false);
+          if(loco) {
+            loco->setMomentum(entry->getAcceleration(), entry->getBraking());
+          }
+        }
+        if(entry) {
+          entry->toJson(jsonResponse->getRoot());
         }
-        entry->toJson(jsonResponse->getRoot());
       }
     }
   } else {
@@ -602,7 +732,9 @@ void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
       LocomotiveManager::getActiveLocos(jsonResponse->getRoot()); 
     } else if (request->hasArg(JSON_ADDRESS_NODE.c_str())) {
       auto loco = LocomotiveManager::getLocomotive(request->arg(JSON_ADDRESS_NODE.c_str()).toInt());
-      if(request->method() == HTTP_PUT || request->method() == HTTP_POST) {
+      if(loco == nullptr) {
+        jsonResponse->setCode(STATUS_SERVER_ERROR);
+      } else if(request->method() == HTTP_PUT || request->method() == HTTP_POST) {
         // Creation / Update of active locomotive
         bool needUpdate = false;
         if(request->hasArg(JSON_IDLE_NODE.c_str()) && request->arg(JSON_IDLE_NODE.c_str()).equalsIgnoreCase(JSON_VALUE_TRUE)) {
@@ -628,13 +760,18 @@ void DCCPPWebServer::handleLocomotive(AsyncWebServerRequest *request) {
           loco->showStatus();
         }
       } else if(request->method() == HTTP_DELETE) {
-        // Removal of an active locomotive
+        // Removal of an active locomotive, the response is built before the
+        // locomotive is released.
+        loco->toJson(jsonResponse->getRoot());
         LocomotiveManager::removeLocomotive(request->arg(JSON_ADDRESS_NODE.c_str()).toInt());
 #if NEXTION_ENABLED
         static_cast<NextionThrottlePage *>(nextionPages[THROTTLE_PAGE])->invalidateLocomotive(request->arg(JSON_ADDRESS_NODE.c_str()).toInt());
 #endif
+        loco = nullptr;
+      }
+      if(loco) {
+        loco->toJson(jsonResponse->getRoot());
       }
-      loco->toJson(jsonResponse->getRoot());
     } else {
       // missing arg or unknown request
       jsonResponse->setCode(STATUS_BAD_REQUEST);
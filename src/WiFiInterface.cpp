@@ -22,46 +22,146 @@ COPYRIGHT (c) 2017-2019 Mike Dunston
 #include <ESPAsyncWebServer.h>
 #include <IPAddress.h>
 #include "WebServer.h"
+#include "DCCppBinaryProtocol.h"
 #include <esp_log.h>
 #include <esp_wifi_internal.h>
 #include <esp_task_wdt.h>
 
-#if defined(HC12_RADIO_ENABLED) && HC12_RADIO_ENABLED
-#include "HC12Interface.h"
-#endif
+static_assert((DCCPP_CLIENT_OUTPUT_BUFFER_SIZE & (DCCPP_CLIENT_OUTPUT_BUFFER_SIZE - 1)) == 0,
+  "DCCPP_CLIENT_OUTPUT_BUFFER_SIZE must be a power of two");
 
 class WiFiClientWrapper : public DCCPPProtocolConsumer {
 public:
-  WiFiClientWrapper(WiFiClient client) : _client(client) {
-    log_i("WiFiClient connected from %s", _client.remoteIP().toString().c_str());
+  WiFiClientWrapper(WiFiClient client, bool binary=false) : _client(client), _binary(binary) {
+    log_i("WiFiClient connected from %s%s", _client.remoteIP().toString().c_str(), _binary ? " (binary)" : "");
     _client.setNoDelay(true);
   }
 
   virtual ~WiFiClientWrapper() {
+    unregister();
     stop();
   }
 
   void stop() {
-    log_i("Disconnecting %s", _client.remoteIP().toString().c_str());
+    log_i("Disconnecting %s (dropped frames: %d, oversized frames: %d, invalid messages: %d)",
+      _client.remoteIP().toString().c_str(), getDroppedFrames(), getOversizedFrames(),
+      _binaryConsumer.getInvalidMessages());
     _client.stop();
   }
 
+  // queues the data in the output buffer, this can be called from any task.
+  // If there is not enough room the client is flagged as too slow and will be
+  // disconnected by the next update().
+  void send(const String &buf) {
+    if(_binary) {
+      DCCPPBinaryEncodedMessage message;
+      DCCPPBinaryConsumer::encode(buf, message);
+      const OutputSegment segments[] = {
+        {message.head, message.headLength},
+        {message.body, message.bodyLength},
+        {message.crc, sizeof(message.crc)}
+      };
+      queueOutput(segments, 3);
+    } else {
+      const OutputSegment segment = {reinterpret_cast<const uint8_t *>(buf.c_str()), buf.length()};
+      queueOutput(&segment, 1);
+    }
+  }
+
   bool update() {
     uint8_t buf[128];
     while (_client.available()) {
       auto len = _client.available();
       log_v("[%s] reading %d bytes", _client.remoteIP().toString().c_str(), len);
       auto added = _client.readBytes(&buf[0], len < 128 ? len : 128);
-      feed(&buf[0], added);
+      if(_binary) {
+        _binaryConsumer.feed(getClientID(), &buf[0], added);
+      } else {
+        feed(&buf[0], added);
+      }
     }
-    return _client.connected();
+    if(_outputOverflow) {
+      log_w("[%s] output buffer is full, dropping slow client", _client.remoteIP().toString().c_str());
+      return false;
+    }
+    return flush() && _client.connected();
   }
 
   WiFiClient getClient() {
     return _client;
   }
 private:
+  struct OutputSegment {
+    const uint8_t *data;
+    uint32_t len;
+  };
+
+  // queues the segments as a single message, either all or none of them are
+  // added to the output buffer.
+  void queueOutput(const OutputSegment *segments, uint8_t count) {
+    uint32_t len = 0;
+    for(uint8_t index = 0; index < count; index++) {
+      len += segments[index].len;
+    }
+    portENTER_CRITICAL(&_outputMux);
+    if(_outputHead - _outputTail + len > DCCPP_CLIENT_OUTPUT_BUFFER_SIZE) {
+      _outputOverflow = true;
+    } else {
+      for(uint8_t index = 0; index < count; index++) {
+        const uint8_t *data = segments[index].data;
+        const uint32_t segmentLength = segments[index].len;
+        if(segmentLength == 0) {
+          continue;
+        }
+        const uint32_t offset = _outputHead % DCCPP_CLIENT_OUTPUT_BUFFER_SIZE;
+        const uint32_t first = std::min<uint32_t>(segmentLength, DCCPP_CLIENT_OUTPUT_BUFFER_SIZE - offset);
+        memcpy(&_output[offset], data, first);
+        memcpy(&_output[0], data + first, segmentLength - first);
+        _outputHead += segmentLength;
+      }
+    }
+    portEXIT_CRITICAL(&_outputMux);
+  }
+
+  // sends as much of the output buffer as the socket will accept without
+  // blocking, returns false if the socket has failed.
+  bool flush() {
+    while(true) {
+      portENTER_CRITICAL(&_outputMux);
+      const uint32_t head = _outputHead;
+      portEXIT_CRITICAL(&_outputMux);
+      if(head == _outputTail) {
+        return true;
+      }
+      // only the contiguous part up to the end of the buffer is sent at once
+      const uint32_t offset = _outputTail % DCCPP_CLIENT_OUTPUT_BUFFER_SIZE;
+      const uint32_t len = std::min<uint32_t>(head - _outputTail, DCCPP_CLIENT_OUTPUT_BUFFER_SIZE - offset);
+      int sent = ::send(_client.fd(), &_output[offset], len, MSG_DONTWAIT);
+      if(sent < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      portENTER_CRITICAL(&_outputMux);
+      _outputTail += sent;
+      portEXIT_CRITICAL(&_outputMux);
+      if((uint32_t)sent < len) {
+        return true;
+      }
+    }
+  }
+
   WiFiClient _client;
+  // when set the client uses the binary protocol (see DCCppBinaryProtocol.h)
+  // for both commands and responses.
+  const bool _binary;
+  DCCPPBinaryConsumer _binaryConsumer;
+  // output buffer, _outputHead and _outputTail are the total number of bytes
+  // queued and sent. Producers (any task) only advance _outputHead and the
+  // owning task (loop) only advances _outputTail.
+  char _output[DCCPP_CLIENT_OUTPUT_BUFFER_SIZE];
+  uint32_t _outputHead{0};
+  uint32_t _outputTail{0};
+  bool _outputOverflow{false};
+  portMUX_TYPE _outputMux{portMUX_INITIALIZER_UNLOCKED};
 };
 
 const String wifiSSID = WIFI_SSID;
@@ -69,6 +169,9 @@ const String wifiPassword = WIFI_PASSWORD;
 
 DCCPPWebServer dccppWebServer;
 WiFiServer DCCppServer(DCCPP_JMRI_CLIENT_PORT);
+#if DCCPP_BINARY_PROTOCOL_ENABLED
+WiFiServer DCCppBinaryServer(DCCPP_BINARY_CLIENT_PORT);
+#endif
 LinkedList<WiFiClientWrapper *> DCCppClients([](WiFiClientWrapper *consumer) {consumer->stop(); delete consumer; });
 bool wifiConnected = false;
 
@@ -127,10 +230,18 @@ void WiFiInterface::begin() {
     } else {
       log_i("Adding dccpp.tcp service to mDNS advertiser");
       MDNS.addService("dccpp", "tcp", DCCPP_JMRI_CLIENT_PORT);
+#if DCCPP_BINARY_PROTOCOL_ENABLED
+      log_i("Adding dccpp-bin.tcp service to mDNS advertiser");
+      MDNS.addService("dccpp-bin", "tcp", DCCPP_BINARY_CLIENT_PORT);
+#endif
     }
 
     DCCppServer.setNoDelay(true);
     DCCppServer.begin();
+#if DCCPP_BINARY_PROTOCOL_ENABLED
+    DCCppBinaryServer.setNoDelay(true);
+    DCCppBinaryServer.begin();
+#endif
     dccppWebServer.begin();
 #if LCC_ENABLED
     lccInterface.startWiFiDependencies();
@@ -197,6 +308,14 @@ void WiFiInterface::update() {
       DCCppClients.add(new WiFiClientWrapper(client));
     }
   }
+#if DCCPP_BINARY_PROTOCOL_ENABLED
+  if (DCCppBinaryServer.hasClient()) {
+    WiFiClient client = DCCppBinaryServer.available();
+    if(client) {
+      DCCppClients.add(new WiFiClientWrapper(client, true));
+    }
+  }
+#endif
   for (const auto& client : DCCppClients) {
     if(!client->update()) {
       log_d("dropping dead connection from %s", client->getClient().remoteIP().toString().c_str());
@@ -210,14 +329,16 @@ void WiFiInterface::showInitInfo() {
 }
 
 void WiFiInterface::send(const String &buf) {
-  for (const auto& client : DCCppClients) {
-    client->getClient().print(buf);
-    delay(1);
+  const uint32_t clientID = DCCPPProtocolConsumer::getActiveClientID();
+  if(clientID) {
+    DCCPPProtocolConsumer::sendToClient(clientID, buf);
+  } else {
+    DCCPPProtocolConsumer::sendToAll(buf);
   }
-	dccppWebServer.broadcastToWS(buf);
-#if HC12_RADIO_ENABLED
-	HC12Interface::send(buf);
-#endif
+}
+
+void WiFiInterface::broadcast(const String &buf) {
+  DCCPPProtocolConsumer::sendToAll(buf);
 }
 
 void WiFiInterface::printf(const __FlashStringHelper *fmt, ...) {
@@ -228,3 +349,12 @@ void WiFiInterface::printf(const __FlashStringHelper *fmt, ...) {
 	va_end(args);
 	send(buf);
 }
+
+void WiFiInterface::broadcastf(const __FlashStringHelper *fmt, ...) {
+	char buf[256] = {0};
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf_P(buf, sizeof(buf), (const char *)fmt, args);
+	va_end(args);
+	broadcast(buf);
+}
@@ -0,0 +1,83 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Decodes the DCC signal on an output pin (as driven by the signal generator
+// ISR) back into packets, the same way a decoder on the track would. Each bit
+// is validated against the NMRA S-9.1 half bit timings (52-64us for a one and
+// 90-10000us for a zero, both halves must match), the packet framing
+// (preamble of at least 10 one bits, start bits, end bit) and the checksum.
+class DCCTrackDecoder {
+public:
+  struct Packet {
+    // virtual time (in microseconds) at which the end bit started
+    uint64_t time;
+    std::vector<uint8_t> bytes;
+  };
+
+  DCCTrackDecoder(uint8_t pin);
+
+  const std::vector<Packet> &getPackets() const {
+    return _packets;
+  }
+  // number of bits with invalid timing, framing errors and checksum errors.
+  uint32_t getErrors() const {
+    return _errors;
+  }
+  // shortest and longest half bit seen for one and zero bits.
+  uint32_t getMinOneHalfBit() const {
+    return _minOne;
+  }
+  uint32_t getMaxOneHalfBit() const {
+    return _maxOne;
+  }
+  uint32_t getMinZeroHalfBit() const {
+    return _minZero;
+  }
+  uint32_t getMaxZeroHalfBit() const {
+    return _maxZero;
+  }
+  void clear();
+
+private:
+  void edge(bool, uint64_t);
+  void decodeBit(bool, uint64_t);
+  void error();
+
+  const uint8_t _pin;
+  uint64_t _rise{0};
+  uint64_t _fall{0};
+  bool _haveRise{false};
+  enum {
+    PREAMBLE,
+    DATA_BITS,
+    START_OR_END_BIT
+  } _state{PREAMBLE};
+  uint8_t _preambleBits{0};
+  uint8_t _bitCount{0};
+  uint8_t _byte{0};
+  std::vector<uint8_t> _bytes;
+  std::vector<Packet> _packets;
+  uint32_t _errors{0};
+  uint32_t _minOne{UINT32_MAX};
+  uint32_t _maxOne{0};
+  uint32_t _minZero{UINT32_MAX};
+  uint32_t _maxZero{0};
+};
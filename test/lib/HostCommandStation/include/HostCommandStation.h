@@ -0,0 +1,61 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <vector>
+#include "DCCppESP32.h"
+#include "HostScheduler.h"
+#include "HostPins.h"
+#include "DCCTrackDecoder.h"
+
+// Command station support for the native tests. The network interfaces are
+// not available on the host, protocol commands are instead sent via
+// HostProtocolClient which collects the responses sent to it.
+namespace host {
+
+// initializes the command station modules in the same order as setup() in
+// DCCppESP32.cpp, the modules which depend on WiFi or external devices are
+// skipped. Repeated calls have no effect.
+void startCommandStation();
+
+// powers on the OPS track and waits for the signal to start.
+void powerOnOps();
+
+} // namespace host
+
+class HostProtocolClient : public DCCPPProtocolConsumer {
+public:
+  virtual ~HostProtocolClient() {
+    unregister();
+  }
+  void send(const String &buf) override {
+    responses.push_back(buf);
+  }
+  // feeds the command (including the < and >) as if it was received from the
+  // client, the responses sent while processing it are returned.
+  String command(const char *command) {
+    responses.clear();
+    std::vector<uint8_t> buffer(command, command + strlen(command));
+    feed(buffer.data(), buffer.size());
+    String result;
+    for(auto &response : responses) {
+      result += response;
+    }
+    return result;
+  }
+  std::vector<String> responses;
+};
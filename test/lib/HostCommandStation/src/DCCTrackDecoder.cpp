@@ -0,0 +1,120 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <algorithm>
+#include "DCCTrackDecoder.h"
+#include "HostPins.h"
+
+// longest packet accepted before the packet is treated as a framing error.
+static constexpr uint8_t MAX_PACKET_BYTES = 12;
+
+DCCTrackDecoder::DCCTrackDecoder(uint8_t pin) : _pin(pin) {
+  host::addPinListener([this](uint8_t pin, bool level, uint64_t time) {
+    if(pin == _pin) {
+      edge(level, time);
+    }
+  });
+}
+
+void DCCTrackDecoder::clear() {
+  _packets.clear();
+  _errors = 0;
+  _minOne = _minZero = UINT32_MAX;
+  _maxOne = _maxZero = 0;
+}
+
+void DCCTrackDecoder::edge(bool level, uint64_t time) {
+  if(!level) {
+    _fall = time;
+    return;
+  }
+  // a bit is complete on the rising edge which starts the next bit
+  if(_haveRise && _fall > _rise) {
+    const uint32_t high = _fall - _rise;
+    const uint32_t low = time - _fall;
+    const bool highIsOne = high >= 52 && high <= 64;
+    const bool lowIsOne = low >= 52 && low <= 64;
+    const bool highIsZero = high >= 90 && high <= 10000;
+    const bool lowIsZero = low >= 90 && low <= 10000;
+    if(highIsOne && lowIsOne) {
+      _minOne = std::min(_minOne, std::min(high, low));
+      _maxOne = std::max(_maxOne, std::max(high, low));
+      decodeBit(true, _rise);
+    } else if(highIsZero && lowIsZero) {
+      _minZero = std::min(_minZero, std::min(high, low));
+      _maxZero = std::max(_maxZero, std::max(high, low));
+      decodeBit(false, _rise);
+    } else {
+      error();
+    }
+  }
+  _rise = time;
+  _haveRise = true;
+}
+
+void DCCTrackDecoder::decodeBit(bool value, uint64_t time) {
+  switch(_state) {
+    case PREAMBLE:
+      if(value) {
+        _preambleBits = std::min(_preambleBits + 1, 255);
+      } else if(_preambleBits >= 10) {
+        // packet start bit
+        _state = DATA_BITS;
+        _bitCount = 0;
+        _bytes.clear();
+      } else {
+        error();
+      }
+      break;
+    case DATA_BITS:
+      _byte = (_byte << 1) | (value ? 1 : 0);
+      if(++_bitCount == 8) {
+        _bytes.push_back(_byte);
+        _bitCount = 0;
+        _state = START_OR_END_BIT;
+      }
+      break;
+    case START_OR_END_BIT:
+      if(!value) {
+        if(_bytes.size() >= MAX_PACKET_BYTES) {
+          error();
+        } else {
+          _state = DATA_BITS;
+        }
+      } else {
+        uint8_t checksum = 0;
+        for(auto byte : _bytes) {
+          checksum ^= byte;
+        }
+        if(_bytes.size() < 3 || checksum != 0) {
+          error();
+        } else {
+          _packets.push_back({time, _bytes});
+        }
+        // the end bit also counts as the first bit of the next preamble
+        _state = PREAMBLE;
+        _preambleBits = 1;
+      }
+      break;
+  }
+}
+
+void DCCTrackDecoder::error() {
+  _errors++;
+  _state = PREAMBLE;
+  _preambleBits = 0;
+}
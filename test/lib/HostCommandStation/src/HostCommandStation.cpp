@@ -0,0 +1,133 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include "HostCommandStation.h"
+#include "Turnouts.h"
+#include "RemoteSensors.h"
+
+// globals normally defined by DCCppESP32.cpp
+const char * buildTime = __DATE__ " " __TIME__;
+WiFiInterface wifiInterface;
+std::vector<uint8_t> restrictedPins;
+bool otaComplete = false;
+bool otaInProgress = false;
+
+void esp32_restart() {
+  fprintf(stderr, "[host] esp32_restart() called\n");
+  abort();
+}
+
+// WiFiInterface without the network, responses are routed to the protocol
+// clients (HostProtocolClient) exactly as WiFiInterface.cpp routes them.
+WiFiInterface::WiFiInterface() {
+}
+
+void WiFiInterface::begin() {
+}
+
+void WiFiInterface::update() {
+}
+
+void WiFiInterface::showConfiguration() {
+}
+
+void WiFiInterface::showInitInfo() {
+}
+
+void WiFiInterface::send(const String &buf) {
+  const uint32_t clientID = DCCPPProtocolConsumer::getActiveClientID();
+  if(clientID) {
+    DCCPPProtocolConsumer::sendToClient(clientID, buf);
+  } else {
+    DCCPPProtocolConsumer::sendToAll(buf);
+  }
+}
+
+void WiFiInterface::broadcast(const String &buf) {
+  DCCPPProtocolConsumer::sendToAll(buf);
+}
+
+void WiFiInterface::printf(const __FlashStringHelper *fmt, ...) {
+  char buf[256] = {0};
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf_P(buf, sizeof(buf), (const char *)fmt, args);
+  va_end(args);
+  send(buf);
+}
+
+void WiFiInterface::broadcastf(const __FlashStringHelper *fmt, ...) {
+  char buf[256] = {0};
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf_P(buf, sizeof(buf), (const char *)fmt, args);
+  va_end(args);
+  broadcast(buf);
+}
+
+namespace host {
+
+void startCommandStation() {
+  static bool started = false;
+  if(started) {
+    return;
+  }
+  started = true;
+#ifndef ALLOW_USAGE_OF_RESTRICTED_GPIO_PINS
+  restrictedPins.push_back(0);
+  restrictedPins.push_back(2);
+  restrictedPins.push_back(5);
+  restrictedPins.push_back(6);
+  restrictedPins.push_back(7);
+  restrictedPins.push_back(8);
+  restrictedPins.push_back(9);
+  restrictedPins.push_back(10);
+  restrictedPins.push_back(11);
+  restrictedPins.push_back(12);
+  restrictedPins.push_back(15);
+#endif
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  InfoScreen::init();
+  configStore.init();
+#if DCC_SIGNAL_GENERATOR_RMT
+  dccSignal[DCC_SIGNAL_OPERATIONS] = new SignalGenerator_RMT("OPS", 512, DCC_SIGNAL_OPERATIONS, DCC_SIGNAL_PIN_OPERATIONS);
+  dccSignal[DCC_SIGNAL_PROGRAMMING] = new SignalGenerator_RMT("PROG", 10, DCC_SIGNAL_PROGRAMMING, DCC_SIGNAL_PIN_PROGRAMMING);
+#else
+  dccSignal[DCC_SIGNAL_OPERATIONS] = new SignalGenerator_HardwareTimer("OPS", 512, DCC_SIGNAL_OPERATIONS, DCC_SIGNAL_PIN_OPERATIONS);
+  dccSignal[DCC_SIGNAL_PROGRAMMING] = new SignalGenerator_HardwareTimer("PROG", 10, DCC_SIGNAL_PROGRAMMING, DCC_SIGNAL_PIN_PROGRAMMING);
+#endif
+  MotorBoardManager::registerBoard(MOTORBOARD_CURRENT_SENSE_OPS,
+    MOTORBOARD_ENABLE_PIN_OPS, MOTORBOARD_TYPE_OPS, MOTORBOARD_NAME_OPS);
+  MotorBoardManager::registerBoard(MOTORBOARD_CURRENT_SENSE_PROG,
+    MOTORBOARD_ENABLE_PIN_PROG, MOTORBOARD_TYPE_PROG, MOTORBOARD_NAME_PROG, true);
+  DCCPPProtocolHandler::init();
+  ProgTrackManager::init();
+  OutputManager::init();
+  TurnoutManager::init();
+  SensorManager::init();
+  RemoteSensorManager::init();
+  LocomotiveManager::init();
+}
+
+void powerOnOps() {
+  startCommandStation();
+  MotorBoardManager::powerOnAll();
+  // let the signal generator pick up the first packet
+  advance(1000);
+}
+
+} // namespace host
@@ -0,0 +1,105 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// Arduino core stand-in for the native test environment, only the parts of
+// the arduino-esp32 core used by the command station are provided.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp32-hal-log.h"
+#include "esp32-hal-timer.h"
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+
+#define ARDUINO_RUNNING_CORE 1
+#define DEFAULT_THREAD_STACKSIZE 2048
+#define DEFAULT_THREAD_PRIO 18
+
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) (bitvalue ? bitSet(value, bit) : bitClear(value, bit))
+#define bit(b) (1UL << (b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// newlib provides strlcpy but older glibc versions do not
+size_t hostStrlcpy(char *, const char *, size_t);
+#define strlcpy hostStrlcpy
+
+long map(long, long, long, long, long);
+long random(long);
+long random(long, long);
+
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+uint16_t analogRead(uint8_t);
+
+// time is virtual, see HostScheduler.h
+unsigned long micros();
+unsigned long millis();
+void delay(uint32_t);
+void delayMicroseconds(uint32_t);
+void yield();
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() {
+    return 128 * 1024;
+  }
+  void restart();
+};
+
+extern EspClass ESP;
@@ -0,0 +1,84 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Stream.h"
+
+// in-memory file system for the native test environment, the contents are
+// kept for the lifetime of the test executable. Like SPIFFS it is flat, a
+// path is just a file name and mkdir/rmdir do not change anything.
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+struct HostFile;
+
+class File : public Stream {
+public:
+  File() {}
+  File(std::shared_ptr<HostFile> file) : _file(file) {}
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override {}
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char *name() const;
+  operator bool() const {
+    return _file != nullptr;
+  }
+  using Print::write;
+private:
+  std::shared_ptr<HostFile> _file;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ);
+  File open(const String &path, const char *mode = FILE_READ) {
+    return open(path.c_str(), mode);
+  }
+  bool exists(const char *path);
+  bool exists(const String &path) {
+    return exists(path.c_str());
+  }
+  bool remove(const char *path);
+  bool remove(const String &path) {
+    return remove(path.c_str());
+  }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) {
+    return mkdir(path.c_str());
+  }
+  bool rmdir(const char *path);
+  bool rmdir(const String &path) {
+    return rmdir(path.c_str());
+  }
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
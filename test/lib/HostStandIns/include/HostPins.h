@@ -0,0 +1,42 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// GPIO and ADC state for the native test environment. Pin levels are set by
+// digitalWrite, the GPIO set/clear registers and the virtual RMT channels,
+// listeners are notified of every level change with the virtual time (in
+// microseconds) at which it happened.
+namespace host {
+
+typedef std::function<void(uint8_t pin, bool level, uint64_t time)> PinListener;
+
+void addPinListener(PinListener);
+void clearPinListeners();
+
+void writePin(uint8_t, bool);
+bool pinLevel(uint8_t);
+
+// sets the level returned by digitalRead for an input pin.
+void setPinInput(uint8_t, bool);
+
+// sets the value returned by adc1_get_raw for the channel.
+void setADC(uint8_t, int);
+
+} // namespace host
@@ -0,0 +1,61 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Deterministic scheduler for the native (host) test environment.
+//
+// Each FreeRTOS task (including the thread running the tests) is backed by a
+// host thread but only one of them runs at a time, a task runs until it blocks
+// (vTaskDelay, ulTaskNotifyTake, a semaphore or queue wait) at which point the
+// highest priority ready task is resumed. Time is virtual, it only advances
+// when every task is blocked and it then jumps straight to the next event
+// (a task timeout or a peripheral event such as a timer alarm). Peripheral
+// events run the registered ISR from the scheduler, so interrupts never
+// preempt a running task but always run at the exact virtual time they are
+// due. A test run is therefore fully repeatable and runs as fast as the host
+// can execute it.
+namespace host {
+
+// current virtual time in microseconds.
+uint64_t now();
+
+// blocks the calling task for the given number of microseconds of virtual
+// time, all other tasks and peripheral events run in the meantime.
+void advance(uint64_t);
+
+// blocks the calling task until the condition is true or the timeout (in
+// microseconds of virtual time) expires, returns the final condition value.
+bool runUntil(std::function<bool()>, uint64_t);
+
+// true while a peripheral event (ISR) is being processed.
+bool inISR();
+
+// source of timed events (timer alarms, RMT items), the scheduler calls
+// processEvent once virtual time reaches nextEvent.
+class Peripheral {
+public:
+  // virtual time of the next event or UINT64_MAX if none is pending.
+  virtual uint64_t nextEvent() = 0;
+  virtual void processEvent(uint64_t) = 0;
+};
+
+void addPeripheral(Peripheral *);
+
+} // namespace host
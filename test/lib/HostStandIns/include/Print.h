@@ -0,0 +1,68 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t written = 0;
+    while(size--) {
+      written += write(*buffer++);
+    }
+    return written;
+  }
+  size_t write(const char *str) {
+    return str ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0;
+  }
+  size_t write(const char *buffer, size_t size) {
+    return write(reinterpret_cast<const uint8_t *>(buffer), size);
+  }
+
+  size_t print(const String &s) {
+    return write(s.c_str(), s.length());
+  }
+  size_t print(const char *str) {
+    return write(str);
+  }
+  size_t print(const __FlashStringHelper *str) {
+    return write(reinterpret_cast<const char *>(str));
+  }
+  size_t print(char c) {
+    return write((uint8_t)c);
+  }
+  template<typename T>
+  size_t print(T value) {
+    return print(String(value));
+  }
+  size_t println() {
+    return write("\r\n");
+  }
+  template<typename T>
+  size_t println(T value) {
+    size_t written = print(value);
+    return written + println();
+  }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  virtual void flush() {}
+};
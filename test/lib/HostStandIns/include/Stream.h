@@ -0,0 +1,63 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) {
+    _timeout = timeout;
+  }
+  // time is virtual and all data is already available on the host so the
+  // read functions never wait for more data.
+  size_t readBytes(char *buffer, size_t length) {
+    size_t count = 0;
+    while(count < length && available() > 0) {
+      *buffer++ = (char)read();
+      count++;
+    }
+    return count;
+  }
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    return readBytes(reinterpret_cast<char *>(buffer), length);
+  }
+  String readString() {
+    String result;
+    while(available() > 0) {
+      result += (char)read();
+    }
+    return result;
+  }
+  String readStringUntil(char terminator) {
+    String result;
+    while(available() > 0) {
+      const char c = (char)read();
+      if(c == terminator) {
+        break;
+      }
+      result += c;
+    }
+    return result;
+  }
+protected:
+  unsigned long _timeout{1000};
+};
@@ -0,0 +1,309 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// Arduino String for the native test environment, backed by std::string.
+// Only the parts of the Arduino API used by the command station are
+// provided, with the same semantics (ie: numeric constructors format the
+// value, indexOf returns -1 when not found).
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <type_traits>
+
+class __FlashStringHelper;
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+#define F(string_literal) (FPSTR(string_literal))
+
+class String {
+public:
+  String(const char *cstr = "") : _buffer(cstr ? cstr : "") {}
+  String(const String &str) = default;
+  String(String &&str) = default;
+  String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) {}
+  explicit String(char c) : _buffer(1, c) {}
+  explicit String(unsigned char value, unsigned char base = 10) : String((unsigned long)value, base) {}
+  explicit String(int value, unsigned char base = 10) : String((long)value, base) {}
+  explicit String(unsigned int value, unsigned char base = 10) : String((unsigned long)value, base) {}
+  explicit String(long value, unsigned char base = 10) {
+    if(value < 0 && base == 10) {
+      _buffer = "-" + format((unsigned long)-value, base);
+    } else {
+      _buffer = format((unsigned long)value, base);
+    }
+  }
+  explicit String(unsigned long value, unsigned char base = 10) : _buffer(format(value, base)) {}
+  explicit String(float value, unsigned char decimalPlaces = 2) : String((double)value, decimalPlaces) {}
+  explicit String(double value, unsigned char decimalPlaces = 2) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    _buffer = buf;
+  }
+
+  String &operator=(const String &rhs) = default;
+  String &operator=(String &&rhs) = default;
+  String &operator=(const char *cstr) {
+    _buffer = cstr ? cstr : "";
+    return *this;
+  }
+  String &operator=(const __FlashStringHelper *str) {
+    return *this = reinterpret_cast<const char *>(str);
+  }
+
+  unsigned char reserve(unsigned int size) {
+    _buffer.reserve(size);
+    return 1;
+  }
+  unsigned int length() const {
+    return _buffer.length();
+  }
+  bool isEmpty() const {
+    return _buffer.empty();
+  }
+  const char *c_str() const {
+    return _buffer.c_str();
+  }
+
+  unsigned char concat(const String &str) {
+    _buffer += str._buffer;
+    return 1;
+  }
+  unsigned char concat(const char *cstr) {
+    if(cstr) {
+      _buffer += cstr;
+    }
+    return 1;
+  }
+  unsigned char concat(char c) {
+    _buffer += c;
+    return 1;
+  }
+  template<typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+  unsigned char concat(T value) {
+    return concat(String(value));
+  }
+  template<typename T>
+  String &operator+=(const T &rhs) {
+    concat(rhs);
+    return *this;
+  }
+  String &operator+=(const char *cstr) {
+    concat(cstr);
+    return *this;
+  }
+  String &operator+=(const __FlashStringHelper *str) {
+    concat(reinterpret_cast<const char *>(str));
+    return *this;
+  }
+
+  int compareTo(const String &s) const {
+    return _buffer.compare(s._buffer);
+  }
+  unsigned char equals(const String &s) const {
+    return _buffer == s._buffer;
+  }
+  unsigned char equals(const char *cstr) const {
+    return _buffer == (cstr ? cstr : "");
+  }
+  unsigned char equalsIgnoreCase(const String &s) const {
+    return strcasecmp(c_str(), s.c_str()) == 0;
+  }
+  unsigned char operator==(const String &rhs) const {
+    return equals(rhs);
+  }
+  unsigned char operator==(const char *cstr) const {
+    return equals(cstr);
+  }
+  unsigned char operator!=(const String &rhs) const {
+    return !equals(rhs);
+  }
+  unsigned char operator!=(const char *cstr) const {
+    return !equals(cstr);
+  }
+  unsigned char operator<(const String &rhs) const {
+    return compareTo(rhs) < 0;
+  }
+  unsigned char startsWith(const String &prefix) const {
+    return _buffer.compare(0, prefix.length(), prefix._buffer) == 0;
+  }
+  unsigned char endsWith(const String &suffix) const {
+    return length() >= suffix.length() &&
+      _buffer.compare(length() - suffix.length(), suffix.length(), suffix._buffer) == 0;
+  }
+
+  char charAt(unsigned int index) const {
+    return index < length() ? _buffer[index] : 0;
+  }
+  void setCharAt(unsigned int index, char c) {
+    if(index < length()) {
+      _buffer[index] = c;
+    }
+  }
+  char operator[](unsigned int index) const {
+    return charAt(index);
+  }
+  char &operator[](unsigned int index) {
+    return _buffer[index];
+  }
+  void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const {
+    toCharArray(reinterpret_cast<char *>(buf), bufsize, index);
+  }
+  void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const {
+    if(!bufsize || !buf) {
+      return;
+    }
+    if(index >= length()) {
+      buf[0] = 0;
+      return;
+    }
+    const unsigned int n = std::min<unsigned int>(bufsize - 1, length() - index);
+    memcpy(buf, _buffer.data() + index, n);
+    buf[n] = 0;
+  }
+
+  int indexOf(char ch, unsigned int fromIndex = 0) const {
+    return toIndex(_buffer.find(ch, fromIndex));
+  }
+  int indexOf(const String &str, unsigned int fromIndex = 0) const {
+    return toIndex(_buffer.find(str._buffer, fromIndex));
+  }
+  int lastIndexOf(char ch) const {
+    return toIndex(_buffer.rfind(ch));
+  }
+  int lastIndexOf(const String &str) const {
+    return toIndex(_buffer.rfind(str._buffer));
+  }
+  String substring(unsigned int beginIndex) const {
+    return substring(beginIndex, length());
+  }
+  String substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if(beginIndex > endIndex) {
+      std::swap(beginIndex, endIndex);
+    }
+    if(beginIndex >= length()) {
+      return String();
+    }
+    endIndex = std::min(endIndex, length());
+    return String(_buffer.substr(beginIndex, endIndex - beginIndex).c_str());
+  }
+
+  void replace(const String &find, const String &replace) {
+    if(find.isEmpty()) {
+      return;
+    }
+    size_t pos = 0;
+    while((pos = _buffer.find(find._buffer, pos)) != std::string::npos) {
+      _buffer.replace(pos, find.length(), replace._buffer);
+      pos += replace.length();
+    }
+  }
+  void remove(unsigned int index) {
+    remove(index, (unsigned int)-1);
+  }
+  void remove(unsigned int index, unsigned int count) {
+    if(index < length()) {
+      _buffer.erase(index, count);
+    }
+  }
+  void toLowerCase() {
+    for(auto &c : _buffer) {
+      c = tolower(c);
+    }
+  }
+  void toUpperCase() {
+    for(auto &c : _buffer) {
+      c = toupper(c);
+    }
+  }
+  void trim() {
+    const size_t first = _buffer.find_first_not_of(" \t\r\n\f\v");
+    if(first == std::string::npos) {
+      _buffer.clear();
+      return;
+    }
+    _buffer = _buffer.substr(first, _buffer.find_last_not_of(" \t\r\n\f\v") - first + 1);
+  }
+
+  long toInt() const {
+    return atol(c_str());
+  }
+  float toFloat() const {
+    return atof(c_str());
+  }
+  double toDouble() const {
+    return atof(c_str());
+  }
+
+private:
+  static std::string format(unsigned long value, unsigned char base) {
+    if(base < 2 || base > 36) {
+      base = 10;
+    }
+    std::string result;
+    do {
+      const int digit = value % base;
+      result.insert(result.begin(), digit < 10 ? '0' + digit : 'A' + digit - 10);
+      value /= base;
+    } while(value);
+    return result;
+  }
+  static int toIndex(size_t pos) {
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+
+  std::string _buffer;
+};
+
+inline String operator+(const String &lhs, const String &rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+inline String operator+(const String &lhs, const char *rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+inline String operator+(const char *lhs, const String &rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+inline String operator+(const String &lhs, char rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+inline String operator+(const String &lhs, const __FlashStringHelper *rhs) {
+  return lhs + reinterpret_cast<const char *>(rhs);
+}
+
+template<typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+inline String operator+(const String &lhs, T rhs) {
+  return lhs + String(rhs);
+}
+
+inline unsigned char operator==(const char *lhs, const String &rhs) {
+  return rhs.equals(lhs);
+}
@@ -0,0 +1,88 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "driver/gpio.h"
+#include "soc/rmt_struct.h"
+
+typedef enum {
+  RMT_CHANNEL_0 = 0,
+  RMT_CHANNEL_1,
+  RMT_CHANNEL_2,
+  RMT_CHANNEL_3,
+  RMT_CHANNEL_4,
+  RMT_CHANNEL_5,
+  RMT_CHANNEL_6,
+  RMT_CHANNEL_7,
+  RMT_CHANNEL_MAX
+} rmt_channel_t;
+
+typedef enum {
+  RMT_MODE_TX = 0,
+  RMT_MODE_RX,
+  RMT_MODE_MAX
+} rmt_mode_t;
+
+typedef enum {
+  RMT_IDLE_LEVEL_LOW = 0,
+  RMT_IDLE_LEVEL_HIGH,
+  RMT_IDLE_LEVEL_MAX
+} rmt_idle_level_t;
+
+typedef enum {
+  RMT_CARRIER_LEVEL_LOW = 0,
+  RMT_CARRIER_LEVEL_HIGH,
+  RMT_CARRIER_LEVEL_MAX
+} rmt_carrier_level_t;
+
+typedef struct {
+  bool loop_en;
+  uint32_t carrier_freq_hz;
+  uint8_t carrier_duty_percent;
+  rmt_carrier_level_t carrier_level;
+  bool carrier_en;
+  rmt_idle_level_t idle_level;
+  bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct {
+  bool filter_en;
+  uint8_t filter_ticks_thresh;
+  uint16_t idle_threshold;
+} rmt_rx_config_t;
+
+typedef struct {
+  rmt_mode_t rmt_mode;
+  rmt_channel_t channel;
+  uint8_t clk_div;
+  gpio_num_t gpio_num;
+  uint8_t mem_block_num;
+  union {
+    rmt_tx_config_t tx_config;
+    rmt_rx_config_t rx_config;
+  };
+} rmt_config_t;
+
+typedef intr_handle_t rmt_isr_handle_t;
+
+esp_err_t rmt_config(const rmt_config_t *);
+esp_err_t rmt_isr_register(void (*)(void *), void *, int, rmt_isr_handle_t *);
+esp_err_t rmt_set_tx_thr_intr_en(rmt_channel_t, bool, uint16_t);
+esp_err_t rmt_tx_start(rmt_channel_t, bool);
+esp_err_t rmt_tx_stop(rmt_channel_t);
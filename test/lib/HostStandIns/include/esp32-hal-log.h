@@ -0,0 +1,48 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// log output goes to stderr, the level is controlled by CORE_DEBUG_LEVEL in
+// the same way as the arduino-esp32 core.
+
+#include <stdio.h>
+
+#define ARDUHAL_LOG_LEVEL_NONE (0)
+#define ARDUHAL_LOG_LEVEL_ERROR (1)
+#define ARDUHAL_LOG_LEVEL_WARN (2)
+#define ARDUHAL_LOG_LEVEL_INFO (3)
+#define ARDUHAL_LOG_LEVEL_DEBUG (4)
+#define ARDUHAL_LOG_LEVEL_VERBOSE (5)
+
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL ARDUHAL_LOG_LEVEL_WARN
+#endif
+#define ARDUHAL_LOG_LEVEL CORE_DEBUG_LEVEL
+
+#define ARDUHAL_LOG_FORMAT(letter, format) "[" #letter "][%s:%u] %s(): " format "\n", __FILE__, __LINE__, __FUNCTION__
+
+#define HOST_LOG(level, letter, format, ...) do { \
+    if(ARDUHAL_LOG_LEVEL >= level) { \
+      fprintf(stderr, ARDUHAL_LOG_FORMAT(letter, format), ##__VA_ARGS__); \
+    } \
+  } while(0)
+
+#define log_v(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_VERBOSE, V, format, ##__VA_ARGS__)
+#define log_d(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_DEBUG, D, format, ##__VA_ARGS__)
+#define log_i(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_INFO, I, format, ##__VA_ARGS__)
+#define log_w(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_WARN, W, format, ##__VA_ARGS__)
+#define log_e(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_ERROR, E, format, ##__VA_ARGS__)
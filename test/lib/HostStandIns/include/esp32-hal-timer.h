@@ -0,0 +1,36 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// esp32-hal-timer stand-in, the timers are driven by virtual time and their
+// registers are exposed via TIMERG0/TIMERG1 (soc/timer_group_struct.h).
+
+#include <stdint.h>
+
+struct hw_timer_s;
+typedef struct hw_timer_s hw_timer_t;
+
+hw_timer_t *timerBegin(uint8_t, uint16_t, bool);
+void timerEnd(hw_timer_t *);
+void timerStart(hw_timer_t *);
+void timerStop(hw_timer_t *);
+void timerWrite(hw_timer_t *, uint64_t);
+void timerAttachInterrupt(hw_timer_t *, void (*)(void), bool);
+void timerDetachInterrupt(hw_timer_t *);
+void timerAlarmWrite(hw_timer_t *, uint64_t, bool);
+void timerAlarmEnable(hw_timer_t *);
+void timerAlarmDisable(hw_timer_t *);
@@ -0,0 +1,46 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// GPIO output registers, writes are forwarded to the host pin recorder (see
+// HostPins.h) so the pin levels can be observed by the tests.
+
+#include <stdint.h>
+
+void hostWritePinMask(uint32_t mask, bool high, bool upperBank);
+
+template<bool UPPER_BANK, bool SET>
+struct HostGPIOWriteRegister {
+  HostGPIOWriteRegister &operator=(uint32_t mask) {
+    hostWritePinMask(mask, SET, UPPER_BANK);
+    return *this;
+  }
+};
+
+template<bool UPPER_BANK, bool SET>
+struct HostGPIOWriteRegisterVal {
+  HostGPIOWriteRegister<UPPER_BANK, SET> val;
+};
+
+typedef struct gpio_dev_s {
+  HostGPIOWriteRegister<false, true> out_w1ts;
+  HostGPIOWriteRegister<false, false> out_w1tc;
+  HostGPIOWriteRegisterVal<true, true> out1_w1ts;
+  HostGPIOWriteRegisterVal<true, false> out1_w1tc;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
@@ -0,0 +1,65 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// RMT registers and channel memory used by the command station, matching
+// ESP-IDF v3.2. The virtual RMT peripheral (see driver/rmt.h) sends the items
+// from RMTMEM and raises the threshold interrupt via RMT.int_st.
+
+#include <stdint.h>
+
+typedef volatile struct rmt_dev_s {
+  union {
+    struct {
+      uint32_t fifo_mask: 1;
+      uint32_t mem_tx_wrap_en: 1;
+      uint32_t reserved2: 30;
+    };
+    uint32_t val;
+  } apb_conf;
+  union {
+    uint32_t val;
+  } int_st;
+  union {
+    uint32_t val;
+  } int_clr;
+} rmt_dev_t;
+
+typedef struct {
+  union {
+    struct {
+      uint32_t duration0: 15;
+      uint32_t level0: 1;
+      uint32_t duration1: 15;
+      uint32_t level1: 1;
+    };
+    uint32_t val;
+  };
+} rmt_item32_t;
+
+// each channel has a 64 item memory block, a channel which uses more than one
+// block continues into the memory of the following channel(s).
+typedef volatile struct rmt_mem_s {
+  struct {
+    union {
+      rmt_item32_t data32[64];
+    };
+  } chan[8];
+} rmt_mem_t;
+
+extern rmt_dev_t RMT;
+extern rmt_mem_t RMTMEM;
@@ -0,0 +1,51 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+#pragma once
+
+// layout of the timer registers used by the command station, matching
+// ESP-IDF v3.2. See esp32-hal-timer.h for how the virtual timers use them.
+
+#include <stdint.h>
+
+typedef volatile struct timg_dev_s {
+  struct {
+    union {
+      struct {
+        uint32_t reserved0: 10;
+        uint32_t alarm_en: 1;
+        uint32_t level_int_en: 1;
+        uint32_t edge_int_en: 1;
+        uint32_t divider: 16;
+        uint32_t autoreload: 1;
+        uint32_t increase: 1;
+        uint32_t enable: 1;
+      };
+      uint32_t val;
+    } config;
+    uint32_t cnt_low;
+    uint32_t cnt_high;
+    uint32_t update;
+    uint32_t alarm_low;
+    uint32_t alarm_high;
+    uint32_t load_low;
+    uint32_t load_high;
+    uint32_t reload;
+  } hw_timer[2];
+} timg_dev_t;
+
+extern timg_dev_t TIMERG0;
+extern timg_dev_t TIMERG1;
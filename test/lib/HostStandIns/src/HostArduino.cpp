@@ -0,0 +1,206 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <chrono>
+#include <vector>
+#include <driver/gpio.h>
+#include <driver/adc.h>
+#include <soc/gpio_struct.h>
+#include <xtensa/core-macros.h>
+
+#include "HostScheduler.h"
+#include "HostPins.h"
+
+EspClass ESP;
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+TwoWire Wire;
+gpio_dev_t GPIO;
+const uint32_t GPIO_PIN_MUX_REG[GPIO_NUM_MAX] = {0};
+
+static bool pinLevels[GPIO_NUM_MAX];
+static int adcValues[ADC1_CHANNEL_MAX];
+static std::vector<host::PinListener> &pinListeners() {
+  static auto listeners = new std::vector<host::PinListener>();
+  return *listeners;
+}
+
+namespace host {
+
+void addPinListener(PinListener listener) {
+  pinListeners().push_back(listener);
+}
+
+void clearPinListeners() {
+  pinListeners().clear();
+}
+
+void writePin(uint8_t pin, bool level) {
+  if(pin >= GPIO_NUM_MAX || pinLevels[pin] == level) {
+    return;
+  }
+  pinLevels[pin] = level;
+  const uint64_t time = now();
+  for(auto &listener : pinListeners()) {
+    listener(pin, level, time);
+  }
+}
+
+bool pinLevel(uint8_t pin) {
+  return pin < GPIO_NUM_MAX && pinLevels[pin];
+}
+
+void setPinInput(uint8_t pin, bool level) {
+  if(pin < GPIO_NUM_MAX) {
+    pinLevels[pin] = level;
+  }
+}
+
+void setADC(uint8_t channel, int value) {
+  if(channel < ADC1_CHANNEL_MAX) {
+    adcValues[channel] = value;
+  }
+}
+
+} // namespace host
+
+void hostWritePinMask(uint32_t mask, bool high, bool upperBank) {
+  for(uint8_t bit = 0; mask; bit++, mask >>= 1) {
+    if(mask & 1) {
+      host::writePin(bit + (upperBank ? 32 : 0), high);
+    }
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if(mode & PULLUP) {
+    host::setPinInput(pin, true);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  host::writePin(pin, value != LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  return host::pinLevel(pin) ? HIGH : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return 0;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode) {
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+  host::writePin(pin, level != 0);
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin) {
+  return host::pinLevel(pin);
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width) {
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+  return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+  return adcValues[channel];
+}
+
+size_t hostStrlcpy(char *dst, const char *src, size_t size) {
+  const size_t len = strlen(src);
+  if(size) {
+    const size_t count = std::min(len, size - 1);
+    memcpy(dst, src, count);
+    dst[count] = 0;
+  }
+  return len;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+long random(long howbig) {
+  return howbig ? rand() % howbig : 0;
+}
+
+long random(long howsmall, long howbig) {
+  return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+unsigned long micros() {
+  return host::now();
+}
+
+unsigned long millis() {
+  return host::now() / 1000;
+}
+
+void delay(uint32_t ms) {
+  host::advance(ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t us) {
+  host::advance(us);
+}
+
+void yield() {
+  vHostTaskYield();
+}
+
+int64_t esp_timer_get_time() {
+  return host::now();
+}
+
+uint32_t xthal_get_ccount() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "[host] ESP.restart() called\n");
+  abort();
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  return write(buf, std::min<size_t>(len, sizeof(buf) - 1));
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
@@ -0,0 +1,135 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <map>
+#include <string>
+#include <SPIFFS.h>
+
+fs::SPIFFSFS SPIFFS;
+
+namespace fs {
+
+struct HostFile {
+  std::string name;
+  std::string *data;
+  size_t position;
+};
+
+static std::map<std::string, std::string> &files() {
+  static auto contents = new std::map<std::string, std::string>();
+  return *contents;
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+  if(!_file) {
+    return 0;
+  }
+  _file->data->append(reinterpret_cast<const char *>(buf), size);
+  return size;
+}
+
+int File::available() {
+  return _file ? _file->data->size() - _file->position : 0;
+}
+
+int File::read() {
+  if(!available()) {
+    return -1;
+  }
+  return (uint8_t)(*_file->data)[_file->position++];
+}
+
+int File::peek() {
+  if(!available()) {
+    return -1;
+  }
+  return (uint8_t)(*_file->data)[_file->position];
+}
+
+size_t File::position() const {
+  return _file ? _file->position : 0;
+}
+
+size_t File::size() const {
+  return _file ? _file->data->size() : 0;
+}
+
+void File::close() {
+  _file = nullptr;
+}
+
+const char *File::name() const {
+  return _file ? _file->name.c_str() : nullptr;
+}
+
+File FS::open(const char *path, const char *mode) {
+  auto entry = files().find(path);
+  if(mode[0] == 'r') {
+    if(entry == files().end()) {
+      return File();
+    }
+  } else if(mode[0] == 'w') {
+    files()[path].clear();
+    entry = files().find(path);
+  } else {
+    entry = files().emplace(path, std::string()).first;
+  }
+  auto file = std::make_shared<HostFile>();
+  file->name = path;
+  file->data = &entry->second;
+  file->position = 0;
+  return File(file);
+}
+
+bool FS::exists(const char *path) {
+  return files().count(path) != 0;
+}
+
+bool FS::remove(const char *path) {
+  return files().erase(path) != 0;
+}
+
+bool FS::mkdir(const char *path) {
+  return true;
+}
+
+bool FS::rmdir(const char *path) {
+  return true;
+}
+
+bool SPIFFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles) {
+  return true;
+}
+
+bool SPIFFSFS::format() {
+  files().clear();
+  return true;
+}
+
+size_t SPIFFSFS::usedBytes() {
+  size_t used = 0;
+  for(auto &entry : files()) {
+    used += entry.second.size();
+  }
+  return used;
+}
+
+} // namespace fs
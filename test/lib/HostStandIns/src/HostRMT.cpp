@@ -0,0 +1,223 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <Arduino.h>
+#include <vector>
+#include <driver/rmt.h>
+#include <rom/gpio.h>
+#include <soc/gpio_sig_map.h>
+
+#include "HostScheduler.h"
+#include "HostPins.h"
+
+rmt_dev_t RMT;
+rmt_mem_t RMTMEM;
+
+// RMT transmit channels, each item is sent as level0 for duration0 followed
+// by level1 for duration1. The channel memory is used in wrap-around mode
+// (the only mode used by the command station) and the threshold interrupt
+// is raised after every tx_thresh items. An item with a zero duration ends
+// the transmission.
+class HostRMT : public host::Peripheral {
+public:
+  struct Channel {
+    uint8_t clkDiv{1};
+    uint8_t memBlocks{1};
+    bool idleLevel{false};
+    bool running{false};
+    bool secondHalf{false};
+    uint16_t index{0};
+    uint32_t itemsSent{0};
+    uint16_t threshold{0};
+    bool thresholdEnabled{false};
+    uint64_t nextTime{UINT64_MAX};
+    std::vector<uint8_t> pins;
+  };
+
+  uint64_t nextEvent() override {
+    uint64_t next = UINT64_MAX;
+    for(auto &channel : channels) {
+      if(channel.running) {
+        next = std::min(next, channel.nextTime);
+      }
+    }
+    return next;
+  }
+
+  void processEvent(uint64_t now) override {
+    for(uint8_t ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+      auto &channel = channels[ch];
+      if(!channel.running || channel.nextTime > now) {
+        continue;
+      }
+      auto item = currentItem(ch);
+      if(!channel.secondHalf) {
+        if(item.duration1 == 0) {
+          stop(ch);
+          continue;
+        }
+        drive(ch, item.level1);
+        channel.nextTime += ticksToMicros(ch, item.duration1);
+        channel.secondHalf = true;
+        continue;
+      }
+      // the item has been sent, advance to the next one
+      channel.secondHalf = false;
+      channel.itemsSent++;
+      if(++channel.index >= channel.memBlocks * 64) {
+        if(!RMT.apb_conf.mem_tx_wrap_en) {
+          stop(ch);
+          continue;
+        }
+        channel.index = 0;
+      }
+      if(channel.thresholdEnabled && channel.threshold &&
+         (channel.itemsSent % channel.threshold) == 0 && isr) {
+        RMT.int_st.val |= (1 << (24 + ch));
+        RMT.int_clr.val = 0;
+        isr(isrArg);
+        RMT.int_st.val &= ~RMT.int_clr.val;
+      }
+      startItem(ch, now);
+    }
+  }
+
+  uint64_t ticksToMicros(uint8_t ch, uint32_t ticks) {
+    // the RMT is clocked from the 80MHz APB clock
+    return std::max<uint64_t>(1, (uint64_t)ticks * channels[ch].clkDiv / 80);
+  }
+
+  rmt_item32_t currentItem(uint8_t ch) {
+    // channels using more than one memory block continue into the memory
+    // of the following channel(s)
+    auto items = const_cast<rmt_item32_t *>(&RMTMEM.chan[0].data32[0]);
+    rmt_item32_t item;
+    item.val = items[ch * 64 + channels[ch].index].val;
+    return item;
+  }
+
+  void startItem(uint8_t ch, uint64_t now) {
+    auto &channel = channels[ch];
+    auto item = currentItem(ch);
+    if(item.duration0 == 0) {
+      stop(ch);
+      return;
+    }
+    drive(ch, item.level0);
+    channel.nextTime = now + ticksToMicros(ch, item.duration0);
+  }
+
+  void stop(uint8_t ch) {
+    channels[ch].running = false;
+    drive(ch, channels[ch].idleLevel);
+  }
+
+  void drive(uint8_t ch, bool level) {
+    for(auto pin : channels[ch].pins) {
+      host::writePin(pin, level);
+    }
+  }
+
+  void route(uint8_t pin, int ch) {
+    for(auto &channel : channels) {
+      channel.pins.erase(std::remove(channel.pins.begin(), channel.pins.end(), pin), channel.pins.end());
+    }
+    if(ch >= 0) {
+      channels[ch].pins.push_back(pin);
+    }
+  }
+
+  Channel channels[RMT_CHANNEL_MAX];
+  void (*isr)(void *){nullptr};
+  void *isrArg{nullptr};
+};
+
+static HostRMT &hostRMT() {
+  static auto rmt = [] {
+    auto instance = new HostRMT();
+    host::addPeripheral(instance);
+    return instance;
+  }();
+  return *rmt;
+}
+
+esp_err_t rmt_config(const rmt_config_t *config) {
+  if(config->channel >= RMT_CHANNEL_MAX || config->rmt_mode != RMT_MODE_TX ||
+     config->mem_block_num == 0 || config->channel + config->mem_block_num > RMT_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  auto &channel = hostRMT().channels[config->channel];
+  channel.clkDiv = config->clk_div;
+  channel.memBlocks = config->mem_block_num;
+  channel.idleLevel = config->tx_config.idle_level == RMT_IDLE_LEVEL_HIGH;
+  hostRMT().route(config->gpio_num, config->channel);
+  return ESP_OK;
+}
+
+esp_err_t rmt_isr_register(void (*fn)(void *), void *arg, int flags, rmt_isr_handle_t *handle) {
+  if(hostRMT().isr) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  hostRMT().isr = fn;
+  hostRMT().isrArg = arg;
+  if(handle) {
+    *handle = reinterpret_cast<rmt_isr_handle_t>(&hostRMT());
+  }
+  return ESP_OK;
+}
+
+esp_err_t rmt_set_tx_thr_intr_en(rmt_channel_t ch, bool enable, uint16_t threshold) {
+  if(ch >= RMT_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  hostRMT().channels[ch].thresholdEnabled = enable;
+  if(enable) {
+    hostRMT().channels[ch].threshold = threshold;
+  }
+  return ESP_OK;
+}
+
+esp_err_t rmt_tx_start(rmt_channel_t ch, bool resetIndex) {
+  if(ch >= RMT_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  auto &channel = hostRMT().channels[ch];
+  if(resetIndex) {
+    channel.index = 0;
+  }
+  channel.itemsSent = 0;
+  channel.secondHalf = false;
+  channel.running = true;
+  hostRMT().startItem(ch, host::now());
+  return ESP_OK;
+}
+
+esp_err_t rmt_tx_stop(rmt_channel_t ch) {
+  if(ch >= RMT_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  hostRMT().stop(ch);
+  return ESP_OK;
+}
+
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv) {
+  if(signal_idx >= RMT_SIG_OUT0_IDX && signal_idx < RMT_SIG_OUT0_IDX + RMT_CHANNEL_MAX) {
+    hostRMT().route(gpio, signal_idx - RMT_SIG_OUT0_IDX);
+  } else {
+    hostRMT().route(gpio, -1);
+  }
+}
@@ -0,0 +1,548 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostScheduler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+namespace host {
+
+struct Task {
+  std::string name;
+  UBaseType_t priority;
+  TaskFunction_t function;
+  void *param;
+  std::condition_variable wake;
+  // when blocked the task becomes ready once the condition is true or the
+  // deadline has passed, whichever happens first.
+  bool blocked{false};
+  std::function<bool()> condition;
+  uint64_t deadline{UINT64_MAX};
+  bool timedOut{false};
+  bool deleted{false};
+  uint32_t notifyValue{0};
+};
+
+// thrown by vTaskDelete(NULL) to unwind the calling task's thread.
+struct TaskDeleted {};
+
+// The kernel state is intentionally never destroyed, task threads are still
+// parked on it when the test process exits.
+struct Kernel {
+  std::mutex lock;
+  std::vector<Task *> tasks;
+  std::vector<Peripheral *> peripherals;
+  Task *running{nullptr};
+  size_t lastIndex{0};
+  uint64_t now{0};
+  bool inISR{false};
+};
+
+static Kernel &kernel() {
+  static Kernel *instance = new Kernel();
+  return *instance;
+}
+
+// the task backed by the calling thread and the kernel lock it holds while it
+// is the running task.
+static thread_local Task *currentTask = nullptr;
+static thread_local std::unique_lock<std::mutex> *heldLock = nullptr;
+
+// returns the calling task, the first thread to use the scheduler (the test
+// runner) becomes the "main" task.
+static Task *self() {
+  if(currentTask == nullptr) {
+    auto &k = kernel();
+    auto task = new Task();
+    task->name = "main";
+    task->priority = 1;
+    heldLock = new std::unique_lock<std::mutex>(k.lock);
+    k.tasks.push_back(task);
+    k.running = task;
+    currentTask = task;
+  }
+  return currentTask;
+}
+
+static bool isReady(Task *task) {
+  auto &k = kernel();
+  if(task->deleted) {
+    return false;
+  }
+  if(!task->blocked) {
+    return true;
+  }
+  if(task->condition && task->condition()) {
+    task->blocked = false;
+    task->timedOut = false;
+    return true;
+  }
+  if(k.now >= task->deadline) {
+    task->blocked = false;
+    task->timedOut = true;
+    return true;
+  }
+  return false;
+}
+
+// runs all peripheral events which are due at the current virtual time.
+static void runPeripherals() {
+  auto &k = kernel();
+  uint32_t iterations = 0;
+  bool fired = true;
+  while(fired) {
+    fired = false;
+    for(auto peripheral : k.peripherals) {
+      if(peripheral->nextEvent() <= k.now) {
+        k.inISR = true;
+        peripheral->processEvent(k.now);
+        k.inISR = false;
+        fired = true;
+      }
+    }
+    if(++iterations > 100000) {
+      fprintf(stderr, "[host] peripheral events are not advancing time\n");
+      abort();
+    }
+  }
+}
+
+// selects the highest priority ready task (round robin between tasks of the
+// same priority), advancing virtual time when no task is ready.
+static Task *pickNext() {
+  auto &k = kernel();
+  while(true) {
+    Task *best = nullptr;
+    size_t bestIndex = 0;
+    const size_t count = k.tasks.size();
+    for(size_t offset = 1; offset <= count; offset++) {
+      const size_t index = (k.lastIndex + offset) % count;
+      Task *task = k.tasks[index];
+      if(isReady(task) && (best == nullptr || task->priority > best->priority)) {
+        best = task;
+        bestIndex = index;
+      }
+    }
+    if(best != nullptr) {
+      k.lastIndex = bestIndex;
+      return best;
+    }
+    uint64_t next = UINT64_MAX;
+    for(auto task : k.tasks) {
+      if(!task->deleted && task->deadline < next) {
+        next = task->deadline;
+      }
+    }
+    for(auto peripheral : k.peripherals) {
+      const uint64_t event = peripheral->nextEvent();
+      if(event < next) {
+        next = event;
+      }
+    }
+    if(next == UINT64_MAX) {
+      fprintf(stderr, "[host] deadlock, all tasks are blocked without a timeout\n");
+      abort();
+    }
+    if(next > k.now) {
+      k.now = next;
+    }
+    runPeripherals();
+  }
+}
+
+static void switchTo(Task *next) {
+  auto &k = kernel();
+  Task *me = currentTask;
+  if(next == me) {
+    return;
+  }
+  k.running = next;
+  next->wake.notify_one();
+  me->wake.wait(*heldLock, [&k, me] { return k.running == me; });
+}
+
+// blocks the calling task until the condition is true or the deadline passes,
+// returns false on timeout.
+static bool block(std::function<bool()> condition, uint64_t deadline) {
+  Task *me = self();
+  if(kernel().inISR) {
+    fprintf(stderr, "[host] blocking call from an ISR\n");
+    abort();
+  }
+  me->blocked = true;
+  me->condition = condition;
+  me->deadline = deadline;
+  me->timedOut = false;
+  switchTo(pickNext());
+  me->condition = nullptr;
+  me->deadline = UINT64_MAX;
+  return !me->timedOut;
+}
+
+static uint64_t deadlineFor(TickType_t ticks) {
+  if(ticks == portMAX_DELAY) {
+    return UINT64_MAX;
+  }
+  return kernel().now + (uint64_t)ticks * portTICK_PERIOD_MS * 1000ULL;
+}
+
+// lets a higher priority task which was made ready by the caller run, this
+// mirrors the preemption that would happen on the ESP32.
+static void yieldIfHigherPriorityReady() {
+  auto &k = kernel();
+  Task *me = self();
+  if(k.inISR) {
+    return;
+  }
+  for(auto task : k.tasks) {
+    if(task != me && task->priority > me->priority && isReady(task)) {
+      switchTo(pickNext());
+      return;
+    }
+  }
+}
+
+static void taskEntry(Task *task) {
+  auto &k = kernel();
+  currentTask = task;
+  heldLock = new std::unique_lock<std::mutex>(k.lock);
+  task->wake.wait(*heldLock, [&k, task] { return k.running == task; });
+  try {
+    task->function(task->param);
+  } catch(TaskDeleted &) {
+  }
+  // returning from a task function is treated the same as deleting the task
+  task->deleted = true;
+  Task *next = pickNext();
+  k.running = next;
+  next->wake.notify_one();
+  heldLock->unlock();
+}
+
+uint64_t now() {
+  self();
+  return kernel().now;
+}
+
+void advance(uint64_t duration) {
+  block(nullptr, kernel().now + duration);
+}
+
+bool runUntil(std::function<bool()> condition, uint64_t timeout) {
+  if(!condition()) {
+    block(condition, kernel().now + timeout);
+  }
+  return condition();
+}
+
+bool inISR() {
+  return kernel().inISR;
+}
+
+void addPeripheral(Peripheral *peripheral) {
+  self();
+  kernel().peripherals.push_back(peripheral);
+}
+
+} // namespace host
+
+using host::kernel;
+using host::self;
+using host::Task;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackSize,
+    void *param, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  auto creator = self();
+  auto task = new Task();
+  task->name = name;
+  task->priority = priority;
+  task->function = function;
+  task->param = param;
+  kernel().tasks.push_back(task);
+  if(handle) {
+    *handle = task;
+  }
+  std::thread(host::taskEntry, task).detach();
+  if(priority > creator->priority) {
+    host::switchTo(host::pickNext());
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackSize,
+    void *param, UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(function, name, stackSize, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+  Task *task = handle ? static_cast<Task *>(handle) : self();
+  if(task == self()) {
+    if(task->name == "main") {
+      fprintf(stderr, "[host] the test runner task can not be deleted\n");
+      abort();
+    }
+    throw host::TaskDeleted();
+  }
+  // the thread stays parked, it will never be selected again
+  task->deleted = true;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if(ticks == 0) {
+    vHostTaskYield();
+  } else {
+    host::block(nullptr, host::deadlineFor(ticks));
+  }
+}
+
+void vHostTaskYield() {
+  host::switchTo(host::pickNext());
+}
+
+TickType_t xTaskGetTickCount() {
+  return host::now() / (portTICK_PERIOD_MS * 1000ULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return self();
+}
+
+const char *pcTaskGetTaskName(TaskHandle_t handle) {
+  return (handle ? static_cast<Task *>(handle) : self())->name.c_str();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle) {
+  return (handle ? static_cast<Task *>(handle) : self())->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+  // host threads do not have a fixed size stack
+  return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  Task *me = self();
+  if(me->notifyValue == 0 && ticks != 0) {
+    host::block([me] { return me->notifyValue > 0; }, host::deadlineFor(ticks));
+  }
+  const uint32_t value = me->notifyValue;
+  if(value) {
+    me->notifyValue = clearOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+  static_cast<Task *>(handle)->notifyValue++;
+  host::yieldIfHigherPriorityReady();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *higherPriorityTaskWoken) {
+  auto task = static_cast<Task *>(handle);
+  task->notifyValue++;
+  if(higherPriorityTaskWoken && kernel().running && task->priority > kernel().running->priority) {
+    *higherPriorityTaskWoken = pdTRUE;
+  }
+}
+
+struct HostSemaphore {
+  enum Type {
+    MUTEX,
+    RECURSIVE_MUTEX,
+    COUNTING
+  } type;
+  UBaseType_t count;
+  UBaseType_t maxCount;
+  Task *owner{nullptr};
+  UBaseType_t depth{0};
+};
+
+static SemaphoreHandle_t createSemaphore(HostSemaphore::Type type, UBaseType_t maxCount, UBaseType_t initialCount) {
+  self();
+  auto semaphore = new HostSemaphore();
+  semaphore->type = type;
+  semaphore->maxCount = maxCount;
+  semaphore->count = initialCount;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return createSemaphore(HostSemaphore::MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return createSemaphore(HostSemaphore::RECURSIVE_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return createSemaphore(HostSemaphore::COUNTING, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  return createSemaphore(HostSemaphore::COUNTING, maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  Task *me = self();
+  if(semaphore->count == 0) {
+    // a blocking take of a mutex the task already holds would never return,
+    // a polling take simply fails as it does on the ESP32.
+    if(semaphore->type != HostSemaphore::COUNTING && semaphore->owner == me && ticks != 0) {
+      fprintf(stderr, "[host] task %s attempted to take a mutex it already holds\n", me->name.c_str());
+      abort();
+    }
+    if(ticks == 0 || !host::block([semaphore] { return semaphore->count > 0; }, host::deadlineFor(ticks))) {
+      return pdFALSE;
+    }
+  }
+  semaphore->count--;
+  semaphore->owner = me;
+  semaphore->depth = 1;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if(semaphore->count >= semaphore->maxCount) {
+    return pdFALSE;
+  }
+  semaphore->count++;
+  semaphore->owner = nullptr;
+  semaphore->depth = 0;
+  host::yieldIfHigherPriorityReady();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  if(semaphore->owner == self()) {
+    semaphore->depth++;
+    return pdTRUE;
+  }
+  return xSemaphoreTake(semaphore, ticks);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+  if(semaphore->owner != self()) {
+    return pdFALSE;
+  }
+  if(--semaphore->depth) {
+    return pdTRUE;
+  }
+  return xSemaphoreGive(semaphore);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken) {
+  if(semaphore->count >= semaphore->maxCount) {
+    return pdFALSE;
+  }
+  semaphore->count++;
+  return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+  return semaphore->count;
+}
+
+struct HostQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  self();
+  auto queue = new HostQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticks, bool front) {
+  if(queue->items.size() >= queue->length) {
+    if(ticks == 0 || host::inISR() ||
+       !host::block([queue] { return queue->items.size() < queue->length; }, host::deadlineFor(ticks))) {
+      return errQUEUE_FULL;
+    }
+  }
+  const uint8_t *data = static_cast<const uint8_t *>(item);
+  std::vector<uint8_t> entry(data, data + queue->itemSize);
+  if(front) {
+    queue->items.push_front(entry);
+  } else {
+    queue->items.push_back(entry);
+  }
+  host::yieldIfHigherPriorityReady();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  return queueSend(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  return queueSend(queue, item, ticks, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken) {
+  return queueSend(queue, item, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  self();
+  if(queue->items.empty()) {
+    if(ticks == 0 || !host::block([queue] { return !queue->items.empty(); }, host::deadlineFor(ticks))) {
+      return errQUEUE_EMPTY;
+    }
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  host::yieldIfHigherPriorityReady();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  queue->items.clear();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  return queue->length - queue->items.size();
+}
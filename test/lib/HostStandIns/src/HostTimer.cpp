@@ -0,0 +1,148 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <Arduino.h>
+#include <soc/timer_group_struct.h>
+
+#include "HostScheduler.h"
+
+timg_dev_t TIMERG0;
+timg_dev_t TIMERG1;
+
+struct hw_timer_s {
+  uint8_t num;
+  void (*isr)(void);
+  // virtual time at which the alarm fires
+  uint64_t alarmTime;
+};
+
+#define HOST_TIMER_REGS(num) (&((num < 2 ? TIMERG0 : TIMERG1).hw_timer[num % 2]))
+
+// The four general purpose timers, the counters are not modelled only the
+// alarms are. When an alarm fires the ISR is called with alarm_en cleared, if
+// the ISR re-arms the alarm (alarm_en = 1) the next alarm is scheduled
+// alarm_low ticks after the previous one as the timers are used with
+// auto-reload.
+class HostTimers : public host::Peripheral {
+public:
+  HostTimers() {
+    for(uint8_t num = 0; num < 4; num++) {
+      timers[num].num = num;
+      timers[num].isr = nullptr;
+      timers[num].alarmTime = UINT64_MAX;
+    }
+  }
+
+  static uint64_t ticksToMicros(uint8_t num, uint32_t ticks) {
+    uint32_t divider = HOST_TIMER_REGS(num)->config.divider;
+    if(divider == 0) {
+      divider = 65536;
+    }
+    // the timers are clocked from the 80MHz APB clock
+    return std::max<uint64_t>(1, (uint64_t)ticks * divider / 80);
+  }
+
+  bool isArmed(uint8_t num) {
+    auto regs = HOST_TIMER_REGS(num);
+    return timers[num].isr && regs->config.enable && regs->config.alarm_en;
+  }
+
+  uint64_t nextEvent() override {
+    uint64_t next = UINT64_MAX;
+    for(uint8_t num = 0; num < 4; num++) {
+      if(isArmed(num)) {
+        next = std::min(next, timers[num].alarmTime);
+      }
+    }
+    return next;
+  }
+
+  void processEvent(uint64_t now) override {
+    for(uint8_t num = 0; num < 4; num++) {
+      if(isArmed(num) && timers[num].alarmTime <= now) {
+        auto regs = HOST_TIMER_REGS(num);
+        const uint64_t fired = timers[num].alarmTime;
+        regs->config.alarm_en = 0;
+        timers[num].isr();
+        timers[num].alarmTime = fired + ticksToMicros(num, regs->alarm_low);
+      }
+    }
+  }
+
+  hw_timer_s timers[4];
+};
+
+static HostTimers &hostTimers() {
+  static auto timers = [] {
+    auto instance = new HostTimers();
+    host::addPeripheral(instance);
+    return instance;
+  }();
+  return *timers;
+}
+
+hw_timer_t *timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+  auto timer = &hostTimers().timers[num];
+  auto regs = HOST_TIMER_REGS(num);
+  regs->config.val = 0;
+  regs->config.divider = divider;
+  regs->config.increase = countUp;
+  regs->config.enable = 1;
+  return timer;
+}
+
+void timerEnd(hw_timer_t *timer) {
+  HOST_TIMER_REGS(timer->num)->config.enable = 0;
+  timer->isr = nullptr;
+}
+
+void timerStart(hw_timer_t *timer) {
+  HOST_TIMER_REGS(timer->num)->config.enable = 1;
+}
+
+void timerStop(hw_timer_t *timer) {
+  HOST_TIMER_REGS(timer->num)->config.enable = 0;
+}
+
+void timerWrite(hw_timer_t *timer, uint64_t value) {
+  HOST_TIMER_REGS(timer->num)->cnt_low = value;
+}
+
+void timerAttachInterrupt(hw_timer_t *timer, void (*isr)(void), bool edge) {
+  timer->isr = isr;
+}
+
+void timerDetachInterrupt(hw_timer_t *timer) {
+  timer->isr = nullptr;
+}
+
+void timerAlarmWrite(hw_timer_t *timer, uint64_t value, bool autoreload) {
+  auto regs = HOST_TIMER_REGS(timer->num);
+  regs->alarm_low = value;
+  regs->alarm_high = 0;
+  regs->config.autoreload = autoreload;
+}
+
+void timerAlarmEnable(hw_timer_t *timer) {
+  auto regs = HOST_TIMER_REGS(timer->num);
+  timer->alarmTime = host::now() + HostTimers::ticksToMicros(timer->num, regs->alarm_low);
+  regs->config.alarm_en = 1;
+}
+
+void timerAlarmDisable(hw_timer_t *timer) {
+  HOST_TIMER_REGS(timer->num)->config.alarm_en = 0;
+}
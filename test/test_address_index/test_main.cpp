@@ -0,0 +1,144 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <map>
+#include <random>
+#include "AddressIndex.h"
+
+// values are only compared by address, they are never dereferenced.
+static uint8_t values[256];
+
+// allocator which can be told to fail so the out of memory handling of the
+// index can be tested.
+struct FailingAllocator {
+  static void *allocate(size_t count, size_t size) {
+    if(failAllocations) {
+      return nullptr;
+    }
+    return calloc(count, size);
+  }
+  static void release(void *ptr) {
+    free(ptr);
+  }
+  static bool failAllocations;
+};
+bool FailingAllocator::failAllocations = false;
+
+void setUp() {
+  FailingAllocator::failAllocations = false;
+}
+
+void tearDown() {
+}
+
+template<typename Index>
+static void assertSameContent(const Index &index, const std::map<uint16_t, uint8_t *> &reference) {
+  TEST_ASSERT_EQUAL(reference.size(), index.size());
+  for(const auto &entry : reference) {
+    TEST_ASSERT_EQUAL_PTR(entry.second, index.get(entry.first));
+  }
+}
+
+// random puts and removes over the full DCC address range (and a narrow range
+// so the same keys are added and removed repeatedly) must leave the index
+// with exactly the content of a std::map given the same operations.
+void test_matches_std_map() {
+  for(uint16_t range : {64, 10240}) {
+    AddressIndex<uint8_t> index(8);
+    std::map<uint16_t, uint8_t *> reference;
+    std::mt19937 random(range);
+    for(uint32_t step = 0; step < 100000; step++) {
+      const uint16_t key = random() % range;
+      const uint32_t operation = random() % 8;
+      if(operation < 4) {
+        uint8_t *value = &values[random() % sizeof(values)];
+        TEST_ASSERT_TRUE(index.put(key, value));
+        reference[key] = value;
+      } else if(operation < 7) {
+        TEST_ASSERT_EQUAL(reference.erase(key) == 1, index.remove(key));
+      } else {
+        auto entry = reference.find(key);
+        TEST_ASSERT_EQUAL_PTR(entry == reference.end() ? nullptr : entry->second, index.get(key));
+      }
+      if(step % 1000 == 999) {
+        assertSameContent(index, reference);
+      }
+    }
+    assertSameContent(index, reference);
+    for(auto entry = reference.begin(); entry != reference.end(); entry = reference.erase(entry)) {
+      TEST_ASSERT_TRUE(index.remove(entry->first, entry->second));
+    }
+    TEST_ASSERT_EQUAL(0, index.size());
+  }
+}
+
+void test_remove_only_matching_value() {
+  AddressIndex<uint8_t> index;
+  TEST_ASSERT_TRUE(index.put(3, &values[0]));
+  TEST_ASSERT_FALSE(index.remove(3, &values[1]));
+  TEST_ASSERT_EQUAL_PTR(&values[0], index.get(3));
+  TEST_ASSERT_TRUE(index.remove(3, &values[0]));
+  TEST_ASSERT_FALSE(index.contains(3));
+}
+
+// when the table can't grow entries are still added until only one empty
+// slot is left, lookups must keep working for every key.
+void test_full_table_rejects_new_entries() {
+  AddressIndex<uint8_t, FailingAllocator> index(8);
+  FailingAllocator::failAllocations = true;
+  for(uint16_t key = 0; key < 7; key++) {
+    TEST_ASSERT_TRUE(index.put(key * 100, &values[key]));
+  }
+  TEST_ASSERT_FALSE(index.put(700, &values[7]));
+  TEST_ASSERT_EQUAL(7, index.size());
+  // replacing an existing entry does not need a new slot
+  TEST_ASSERT_TRUE(index.put(300, &values[8]));
+  TEST_ASSERT_EQUAL_PTR(&values[8], index.get(300));
+  TEST_ASSERT_NULL(index.get(700));
+  TEST_ASSERT_TRUE(index.remove(0));
+  TEST_ASSERT_TRUE(index.put(700, &values[7]));
+  // once memory is available again the table grows as usual
+  FailingAllocator::failAllocations = false;
+  for(uint16_t key = 1000; key < 1100; key++) {
+    TEST_ASSERT_TRUE(index.put(key, &values[key % sizeof(values)]));
+  }
+  TEST_ASSERT_EQUAL(107, index.size());
+  TEST_ASSERT_EQUAL_PTR(&values[7], index.get(700));
+}
+
+void test_failed_initial_allocation() {
+  FailingAllocator::failAllocations = true;
+  AddressIndex<uint8_t, FailingAllocator> index;
+  TEST_ASSERT_EQUAL(0, index.size());
+  TEST_ASSERT_NULL(index.get(3));
+  TEST_ASSERT_FALSE(index.remove(3));
+  TEST_ASSERT_FALSE(index.put(3, &values[0]));
+  index.clear();
+  FailingAllocator::failAllocations = false;
+  TEST_ASSERT_TRUE(index.put(3, &values[0]));
+  TEST_ASSERT_EQUAL_PTR(&values[0], index.get(3));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_std_map);
+  RUN_TEST(test_remove_only_matching_value);
+  RUN_TEST(test_full_table_rejects_new_entries);
+  RUN_TEST(test_failed_initial_allocation);
+  return UNITY_END();
+}
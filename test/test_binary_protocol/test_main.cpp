@@ -0,0 +1,238 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <chrono>
+#include <ctime>
+#include "HostCommandStation.h"
+#include "DCCppBinaryProtocol.h"
+
+// CRC-16/CCITT as described in DCCppBinaryProtocol.h, this is an independent
+// implementation (table free, bitwise) to check the framing against.
+static uint16_t crc16(const std::vector<uint8_t> &data) {
+  uint16_t crc = 0xFFFF;
+  for(auto byte : data) {
+    crc ^= (uint16_t)byte << 8;
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// frames a message (TYPE and PAYLOAD).
+static std::vector<uint8_t> frame(const std::vector<uint8_t> &message) {
+  std::vector<uint8_t> framed = {(uint8_t)(message.size() & 0xFF), (uint8_t)(message.size() >> 8)};
+  framed.insert(framed.end(), message.begin(), message.end());
+  const uint16_t crc = crc16(framed);
+  framed.insert(framed.begin(), DCCPP_BINARY_SYNC);
+  framed.push_back(crc & 0xFF);
+  framed.push_back(crc >> 8);
+  return framed;
+}
+
+// throttle command for register 1 (address 3), the speed identifies each
+// message by its <T> response.
+static std::vector<uint8_t> throttle(uint8_t speed) {
+  return frame({DCCPP_BINARY_THROTTLE, 1, 3, 0, speed, 1});
+}
+
+// number of commands fed through each protocol for the benchmark.
+static constexpr uint32_t BENCHMARK_COMMANDS = 20000;
+
+static std::vector<uint8_t> operator+(std::vector<uint8_t> first, const std::vector<uint8_t> &second) {
+  first.insert(first.end(), second.begin(), second.end());
+  return first;
+}
+
+static HostProtocolClient *client;
+static DCCPPBinaryConsumer *consumer;
+
+// feeds the data to the consumer and returns the responses.
+static String feed(std::vector<uint8_t> data) {
+  client->responses.clear();
+  consumer->feed(client->getClientID(), data.data(), data.size());
+  String result;
+  for(auto &response : client->responses) {
+    result += response;
+  }
+  return result;
+}
+
+void setUp() {
+  client = new HostProtocolClient();
+  consumer = new DCCPPBinaryConsumer();
+}
+
+void tearDown() {
+  delete consumer;
+  delete client;
+}
+
+void test_messages_are_processed() {
+  TEST_ASSERT_EQUAL_STRING("<T 1 10 1><T 1 11 1>", feed(throttle(10) + throttle(11)).c_str());
+  const char text[] = "t 1 3 12 1";
+  std::vector<uint8_t> message = {DCCPP_BINARY_TEXT};
+  message.insert(message.end(), text, text + strlen(text));
+  TEST_ASSERT_EQUAL_STRING("<T 1 12 1>", feed(frame(message)).c_str());
+  TEST_ASSERT_EQUAL(0, consumer->getInvalidMessages());
+}
+
+void test_messages_split_across_reads() {
+  auto data = throttle(20) + throttle(21);
+  String result;
+  for(auto byte : data) {
+    result += feed({byte});
+  }
+  TEST_ASSERT_EQUAL_STRING("<T 1 20 1><T 1 21 1>", result.c_str());
+}
+
+// a message which lost bytes swallows the start of the next message, the
+// next message must still be found once the CRC check has failed.
+void test_truncated_message_does_not_hide_next_message() {
+  auto truncated = throttle(30);
+  truncated.resize(5);
+  TEST_ASSERT_EQUAL_STRING("<T 1 31 1><T 1 32 1>", feed(truncated + throttle(31) + throttle(32)).c_str());
+  TEST_ASSERT_EQUAL(1, consumer->getInvalidMessages());
+}
+
+// a corrupted byte in the payload of a message which happens to be the sync
+// byte, the messages which follow it must still be found.
+void test_corrupt_message_with_sync_in_payload() {
+  auto corrupt = throttle(DCCPP_BINARY_SYNC);
+  corrupt[6]++;
+  TEST_ASSERT_EQUAL_STRING("<T 1 40 1>", feed(corrupt + throttle(40)).c_str());
+  // the sync byte in the payload is rescanned as the start of a message with
+  // an invalid length and is counted as well.
+  TEST_ASSERT_EQUAL(2, consumer->getInvalidMessages());
+}
+
+// noise which looks like a SYNC followed by an invalid (or valid but wrong)
+// length, possibly several times over, must not lose the following messages.
+void test_noise_before_message() {
+  std::vector<uint8_t> invalid = {DCCPP_BINARY_SYNC, 0xFF, 0xFF, DCCPP_BINARY_SYNC, 0x00, 0x00};
+  TEST_ASSERT_EQUAL_STRING("<T 1 50 1>", feed(invalid + throttle(50)).c_str());
+  TEST_ASSERT_EQUAL(2, consumer->getInvalidMessages());
+  // each SYNC starts a 4 byte message which extends into the following ones
+  std::vector<uint8_t> noise = {DCCPP_BINARY_SYNC, 4, 0, DCCPP_BINARY_SYNC, 4, 0, DCCPP_BINARY_SYNC, 4, 0};
+  TEST_ASSERT_EQUAL_STRING("<T 1 51 1><T 1 52 1>", feed(noise + throttle(51) + throttle(52)).c_str());
+}
+
+// the encoded message must match the framing of the message layouts.
+static void assertEncoded(const char *response, const std::vector<uint8_t> &message) {
+  DCCPPBinaryEncodedMessage encoded;
+  String text(response);
+  DCCPPBinaryConsumer::encode(text, encoded);
+  std::vector<uint8_t> data(encoded.head, encoded.head + encoded.headLength);
+  data.insert(data.end(), encoded.body, encoded.body + encoded.bodyLength);
+  data.insert(data.end(), encoded.crc, encoded.crc + sizeof(encoded.crc));
+  TEST_ASSERT_EQUAL(data.size(), encoded.size());
+  auto expected = frame(message);
+  TEST_ASSERT_EQUAL(expected.size(), data.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), data.data(), expected.size());
+}
+
+void test_encode_responses() {
+  assertEncoded("<T 1 50 1>", {DCCPP_BINARY_THROTTLE, 1, 50, 1});
+  assertEncoded("<T 2 -1 0>", {DCCPP_BINARY_THROTTLE, 2, 0xFF, 0});
+  assertEncoded("<Q 300>", {DCCPP_BINARY_SENSOR, 0x2C, 0x01, 1});
+  assertEncoded("<q 7>", {DCCPP_BINARY_SENSOR, 7, 0, 0});
+  assertEncoded("<p1 OPS>", {DCCPP_BINARY_POWER, 1, 'O', 'P', 'S'});
+  assertEncoded("<p0>", {DCCPP_BINARY_POWER, 0});
+  // anything else is sent as text
+  assertEncoded("<X>", {DCCPP_BINARY_TEXT, '<', 'X', '>'});
+  assertEncoded("<T 1 50>", {DCCPP_BINARY_TEXT, '<', 'T', ' ', '1', ' ', '5', '0', '>'});
+  assertEncoded("<Q 1><q 2>", {DCCPP_BINARY_TEXT, '<', 'Q', ' ', '1', '>', '<', 'q', ' ', '2', '>'});
+  assertEncoded("<p2 A B>", {DCCPP_BINARY_TEXT, '<', 'p', '2', ' ', 'A', ' ', 'B', '>'});
+}
+
+// runs the commands through the consumer (including encoding the responses
+// for the binary protocol) and reports the rate and process CPU time.
+template<typename Feed>
+static void runBenchmark(const char *name, const std::vector<std::vector<uint8_t>> &commands, Feed feed,
+  double &cpuTime) {
+  const std::clock_t cpuStart = std::clock();
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t count = 0; count < BENCHMARK_COMMANDS; count++) {
+    feed(commands[count % commands.size()]);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  cpuTime = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+  char message[128];
+  snprintf(message, sizeof(message), "%s: %.0f commands/sec, %.2f us CPU/command", name,
+    BENCHMARK_COMMANDS / elapsed.count(), cpuTime * 1000000 / BENCHMARK_COMMANDS);
+  TEST_MESSAGE(message);
+}
+
+// the same mix of throttle and function commands as sent by a throttle app
+// (see test_jmri_command_mix_benchmark) through the text and binary protocols.
+void test_text_and_binary_command_mix_benchmark() {
+  static const char *text[] = {
+    "<t 1 3 50 1>", "<t 2 1234 20 0>", "<f 3 144>", "<t 3 10 126 1>",
+    "<t 1 3 51 1>", "<f 1234 222 1>", "<t 4 4000 0 1>", "<f 10 128>",
+  };
+  const std::vector<std::vector<uint8_t>> binary = {
+    frame({DCCPP_BINARY_THROTTLE, 1, 3, 0, 50, 1}),
+    frame({DCCPP_BINARY_THROTTLE, 2, 0xD2, 0x04, 20, 0}),
+    frame({DCCPP_BINARY_FUNCTION, 3, 0, 144, 0}),
+    frame({DCCPP_BINARY_THROTTLE, 3, 10, 0, 126, 1}),
+    frame({DCCPP_BINARY_THROTTLE, 1, 3, 0, 51, 1}),
+    frame({DCCPP_BINARY_FUNCTION, 0xD2, 0x04, 222, 1}),
+    frame({DCCPP_BINARY_THROTTLE, 4, 0xA0, 0x0F, 0, 1}),
+    frame({DCCPP_BINARY_FUNCTION, 10, 0, 128, 0}),
+  };
+  std::vector<std::vector<uint8_t>> textCommands;
+  for(auto command : text) {
+    textCommands.emplace_back(command, command + strlen(command));
+  }
+  host::powerOnOps();
+  // both protocols must produce the same responses for the mix
+  for(uint8_t index = 0; index < textCommands.size(); index++) {
+    TEST_ASSERT_EQUAL_STRING(client->command(text[index]).c_str(), feed(binary[index]).c_str());
+  }
+  double textTime, binaryTime;
+  runBenchmark("text", textCommands, [](const std::vector<uint8_t> &command) {
+    client->feed(const_cast<uint8_t *>(command.data()), command.size());
+    client->responses.clear();
+  }, textTime);
+  runBenchmark("binary", binary, [](const std::vector<uint8_t> &command) {
+    consumer->feed(client->getClientID(), command.data(), command.size());
+    DCCPPBinaryEncodedMessage encoded;
+    for(auto &response : client->responses) {
+      DCCPPBinaryConsumer::encode(response, encoded);
+    }
+    client->responses.clear();
+  }, binaryTime);
+  char message[64];
+  snprintf(message, sizeof(message), "binary uses %.0f%% of the text protocol CPU time",
+    binaryTime * 100 / textTime);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(0, consumer->getInvalidMessages());
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  UNITY_BEGIN();
+  RUN_TEST(test_messages_are_processed);
+  RUN_TEST(test_messages_split_across_reads);
+  RUN_TEST(test_truncated_message_does_not_hide_next_message);
+  RUN_TEST(test_corrupt_message_with_sync_in_payload);
+  RUN_TEST(test_noise_before_message);
+  RUN_TEST(test_encode_responses);
+  RUN_TEST(test_text_and_binary_command_mix_benchmark);
+  return UNITY_END();
+}
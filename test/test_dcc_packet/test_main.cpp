@@ -0,0 +1,148 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "DCCPacket.h"
+
+static constexpr uint32_t BENCHMARK_PACKETS = 1000000;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// the encoder used before encodeDCCPacket(), it builds the checksum in a
+// vector and only supports payloads of two to five bytes.
+static void encodeWithVector(Packet &packet, std::vector<uint8_t> data) {
+  uint8_t checksum = data[0];
+  for(size_t i = 1; i < data.size(); i++) {
+    checksum ^= data[i];
+  }
+  data.push_back(checksum);
+  memset(packet.buffer, 0, sizeof(packet.buffer));
+  packet.buffer[0] = 0xFF;
+  packet.buffer[1] = 0xFF;
+  packet.buffer[2] = 0xFC + ((data[0] >> 7) & 1);
+  packet.buffer[3] = data[0] << 1;
+  packet.buffer[4] = data[1];
+  packet.buffer[5] = data[2] >> 1;
+  packet.buffer[6] = data[2] << 7;
+  if(data.size() == 3) {
+    packet.numberOfBits = 49;
+  } else {
+    packet.buffer[6] += data[3] >> 2;
+    packet.buffer[7] = data[3] << 6;
+    if(data.size() == 4) {
+      packet.numberOfBits = 58;
+    } else {
+      packet.buffer[7] += data[4] >> 3;
+      packet.buffer[8] = data[4] << 5;
+      if(data.size() == 5) {
+        packet.numberOfBits = 67;
+      } else {
+        packet.buffer[8] += data[5] >> 4;
+        packet.buffer[9] = data[5] << 4;
+        packet.numberOfBits = 76;
+      }
+    }
+  }
+}
+
+static std::vector<std::vector<uint8_t>> randomPayloads(uint32_t count) {
+  std::mt19937 random(1234);
+  std::vector<std::vector<uint8_t>> payloads;
+  for(uint32_t index = 0; index < count; index++) {
+    std::vector<uint8_t> payload(2 + random() % 4);
+    for(auto &byte : payload) {
+      byte = random();
+    }
+    payloads.push_back(payload);
+  }
+  return payloads;
+}
+
+void test_constant_packets_match_run_time_encoder() {
+  Packet packet;
+  TEST_ASSERT_TRUE(encodeDCCPacket(packet, idlePacket, sizeof(idlePacket)));
+  TEST_ASSERT_EQUAL(0, memcmp(packet.buffer, encodedIdlePacket.buffer, MAX_BYTES_IN_PACKET));
+  TEST_ASSERT_EQUAL(encodedIdlePacket.numberOfBits, packet.numberOfBits);
+  TEST_ASSERT_TRUE(encodeDCCPacket(packet, resetPacket, sizeof(resetPacket)));
+  TEST_ASSERT_EQUAL(0, memcmp(packet.buffer, encodedResetPacket.buffer, MAX_BYTES_IN_PACKET));
+  TEST_ASSERT_TRUE(encodeDCCPacket(packet, eStopPacket, sizeof(eStopPacket)));
+  TEST_ASSERT_EQUAL(0, memcmp(packet.buffer, encodedEStopPacket.buffer, MAX_BYTES_IN_PACKET));
+}
+
+void test_run_time_encoder_matches_previous_encoder() {
+  for(auto &payload : randomPayloads(10000)) {
+    Packet expected, actual;
+    encodeWithVector(expected, payload);
+    TEST_ASSERT_TRUE(encodeDCCPacket(actual, payload.data(), payload.size()));
+    TEST_ASSERT_EQUAL(expected.numberOfBits, actual.numberOfBits);
+    TEST_ASSERT_EQUAL(0, memcmp(expected.buffer, actual.buffer, MAX_BYTES_IN_PACKET));
+  }
+}
+
+void test_payload_length_limits() {
+  Packet packet;
+  uint8_t payload[MAX_DCC_PAYLOAD_BYTES + 1] = {0};
+  TEST_ASSERT_FALSE(encodeDCCPacket(packet, payload, 0));
+  TEST_ASSERT_TRUE(encodeDCCPacket(packet, payload, MAX_DCC_PAYLOAD_BYTES));
+  TEST_ASSERT_EQUAL(dccPacketBits(MAX_DCC_PAYLOAD_BYTES), packet.numberOfBits);
+  TEST_ASSERT_FALSE(encodeDCCPacket(packet, payload, MAX_DCC_PAYLOAD_BYTES + 1));
+}
+
+// reports the encoding time per packet of both encoders, only the results
+// are checked as the timing depends on the host.
+void test_encoder_benchmark() {
+  auto payloads = randomPayloads(1024);
+  Packet packet;
+  uint32_t check = 0;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t index = 0; index < BENCHMARK_PACKETS; index++) {
+    encodeWithVector(packet, payloads[index % payloads.size()]);
+    check += packet.buffer[index % MAX_BYTES_IN_PACKET];
+  }
+  auto vectorTime = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for(uint32_t index = 0; index < BENCHMARK_PACKETS; index++) {
+    auto &payload = payloads[index % payloads.size()];
+    encodeDCCPacket(packet, payload.data(), payload.size());
+    check -= packet.buffer[index % MAX_BYTES_IN_PACKET];
+  }
+  auto encoderTime = std::chrono::steady_clock::now() - start;
+  TEST_ASSERT_EQUAL(0, check);
+  char message[128];
+  snprintf(message, sizeof(message), "previous encoder: %.1fns/packet, encodeDCCPacket: %.1fns/packet",
+    std::chrono::duration<double, std::nano>(vectorTime).count() / BENCHMARK_PACKETS,
+    std::chrono::duration<double, std::nano>(encoderTime).count() / BENCHMARK_PACKETS);
+  TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_constant_packets_match_run_time_encoder);
+  RUN_TEST(test_run_time_encoder_matches_previous_encoder);
+  RUN_TEST(test_payload_length_limits);
+  RUN_TEST(test_encoder_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,93 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include "HostCommandStation.h"
+
+// ADC reading which is well above the ACK threshold of the programming track.
+static constexpr int ACK_CURRENT = 4000;
+
+void setUp() {
+  host::setADC(MOTORBOARD_CURRENT_SENSE_PROG, ACK_CURRENT);
+}
+
+void tearDown() {
+  host::setADC(MOTORBOARD_CURRENT_SENSE_PROG, 0);
+}
+
+// a decoder which ACKs everything reads as 255 and accepts every write.
+void test_acked_packets_are_sampled() {
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->startSignal(false);
+  TEST_ASSERT_EQUAL(255, readCV(1));
+  TEST_ASSERT_TRUE(writeProgCVByte(1, 3));
+  TEST_ASSERT_TRUE(writeProgCVBit(29, 5, true));
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->stopSignal();
+}
+
+// packets which are never sent (the emergency stop discards them) must not
+// be treated as ACKed even though the current reading looks like an ACK.
+void test_unsent_packets_fail_the_operation() {
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->startSignal(false);
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->startEmergencyStop();
+  TEST_ASSERT_EQUAL(-1, readCV(1));
+  TEST_ASSERT_FALSE(writeProgCVByte(1, 3));
+  TEST_ASSERT_FALSE(writeProgCVBit(29, 5, true));
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->clearEmergencyStop();
+  dccSignal[DCC_SIGNAL_PROGRAMMING]->stopSignal();
+}
+
+// the acknowledgement callback must run before the worker can start the job
+// and must not run when the job is rejected.
+void test_queue_acknowledges_before_job_runs() {
+  // the current reading is too high for the track to be energized so the
+  // jobs are called right away with energized false.
+  std::vector<String> events;
+  uint32_t accepted = 0;
+  // the worker holds at most one job so the queue fills up before this ends
+  while(accepted <= PROG_TRACK_JOB_QUEUE_SIZE * 2) {
+    const uint32_t index = accepted;
+    if(!ProgTrackManager::queue([&events, index](bool energized) {
+      events.push_back(String("job ") + String(index));
+    }, [&events, index]() {
+      events.push_back(String("ack ") + String(index));
+    })) {
+      break;
+    }
+    accepted++;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(PROG_TRACK_JOB_QUEUE_SIZE + 1, accepted);
+  TEST_ASSERT_TRUE(host::runUntil([&]() { return events.size() == accepted * 2; }, 60000000));
+  for(uint32_t index = 0; index < accepted; index++) {
+    auto ack = std::find(events.begin(), events.end(), String("ack ") + String(index));
+    auto job = std::find(events.begin(), events.end(), String("job ") + String(index));
+    TEST_ASSERT_TRUE(ack < job);
+  }
+  // the slots are released as the worker receives the jobs
+  TEST_ASSERT_TRUE(ProgTrackManager::queue([&events](bool energized) {
+    events.push_back("job");
+  }));
+  TEST_ASSERT_TRUE(host::runUntil([&]() { return events.back() == "job"; }, 10000000));
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  UNITY_BEGIN();
+  RUN_TEST(test_acked_packets_are_sampled);
+  RUN_TEST(test_unsent_packets_fail_the_operation);
+  RUN_TEST(test_queue_acknowledges_before_job_runs);
+  return UNITY_END();
+}
@@ -0,0 +1,118 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <chrono>
+#include "HostCommandStation.h"
+
+// number of commands fed for the throughput benchmark.
+static constexpr uint32_t BENCHMARK_COMMANDS = 20000;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// builds a <tb> command with the given number of updates.
+static String throttleBatch(uint8_t updates) {
+  String command = "<tb";
+  for(uint8_t update = 0; update < updates; update++) {
+    command += " " + String(update + 1) + " " + String(update + 100) + " 10 1";
+  }
+  command += ">";
+  return command;
+}
+
+void test_argument_limit() {
+  HostProtocolClient client;
+  TEST_ASSERT_EQUAL_STRING("<tb 16 0>",
+    client.command(throttleBatch(DCCPP_MAX_ARGUMENTS / 4).c_str()).c_str());
+  TEST_ASSERT_EQUAL_STRING(COMMAND_FAILED_RESPONSE.c_str(),
+    client.command(throttleBatch(DCCPP_MAX_ARGUMENTS / 4 + 1).c_str()).c_str());
+}
+
+void test_arguments_are_split_on_spaces() {
+  char command[] = "  1 -20   +300 abc ";
+  DCCPPProtocolArguments arguments(command);
+  TEST_ASSERT_EQUAL(4, arguments.size());
+  TEST_ASSERT_EQUAL(1, arguments[0].toInt());
+  TEST_ASSERT_EQUAL(-20, arguments[1].toInt());
+  TEST_ASSERT_EQUAL(300, arguments[2].toInt());
+  TEST_ASSERT_TRUE(arguments[3].equals("abc"));
+  TEST_ASSERT_TRUE(arguments[4].equals(""));
+  TEST_ASSERT_FALSE(arguments.overflow());
+}
+
+void test_destroyed_client_is_unregistered() {
+  uint32_t clientID;
+  {
+    HostProtocolClient client;
+    clientID = client.getClientID();
+    TEST_ASSERT_TRUE(DCCPPProtocolConsumer::sendToClient(clientID, "<O>"));
+    TEST_ASSERT_EQUAL(1, client.responses.size());
+  }
+  TEST_ASSERT_FALSE(DCCPPProtocolConsumer::sendToClient(clientID, "<O>"));
+}
+
+void test_function_group_byte_is_checked() {
+  HostProtocolClient client;
+  TEST_ASSERT_EQUAL_STRING("", client.command("<f 1235 222 5>").c_str());
+  TEST_ASSERT_EQUAL_STRING("", client.command("<f 1235 223 1>").c_str());
+  auto loco = LocomotiveManager::getLocomotive(1235);
+  TEST_ASSERT_TRUE(loco->isFunctionEnabled(13));
+  TEST_ASSERT_FALSE(loco->isFunctionEnabled(14));
+  TEST_ASSERT_TRUE(loco->isFunctionEnabled(15));
+  TEST_ASSERT_TRUE(loco->isFunctionEnabled(21));
+  // 254 passes a (byte & 0xDE) == 0xDE check but is not a function group
+  TEST_ASSERT_EQUAL_STRING(COMMAND_FAILED_RESPONSE.c_str(), client.command("<f 1235 254 255>").c_str());
+  TEST_ASSERT_EQUAL_STRING(COMMAND_FAILED_RESPONSE.c_str(), client.command("<f 1235 144 255>").c_str());
+  TEST_ASSERT_FALSE(loco->isFunctionEnabled(14));
+  TEST_ASSERT_FALSE(loco->isFunctionEnabled(22));
+}
+
+// reports the number of commands per second (host time) for a mix of the
+// commands JMRI sends while running trains: mostly throttle updates for a few
+// locomotives, function changes and the periodic current poll.
+void test_jmri_command_mix_benchmark() {
+  static const char *commands[] = {
+    "<t 1 3 50 1>", "<t 2 1234 20 0>", "<f 3 144>", "<t 3 10 126 1>",
+    "<t 1 3 51 1>", "<f 1234 222 1>", "<t 4 4000 0 1>", "<c>",
+  };
+  static constexpr uint8_t COMMAND_COUNT = sizeof(commands) / sizeof(commands[0]);
+  HostProtocolClient client;
+  host::powerOnOps();
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t count = 0; count < BENCHMARK_COMMANDS; count++) {
+    client.command(commands[count % COMMAND_COUNT]);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  char message[128];
+  snprintf(message, sizeof(message), "%.0f commands/sec", BENCHMARK_COMMANDS / elapsed.count());
+  TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  UNITY_BEGIN();
+  RUN_TEST(test_argument_limit);
+  RUN_TEST(test_arguments_are_split_on_spaces);
+  RUN_TEST(test_destroyed_client_is_unregistered);
+  RUN_TEST(test_function_group_byte_is_checked);
+  RUN_TEST(test_jmri_command_mix_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include "HostCommandStation.h"
+
+static DCCTrackDecoder *opsTrack;
+
+// time (us) allowed for the signal to change after the emergency stop state
+// changes, the RMT signal generator has up to 128 bits in its channel memory
+// ahead of the bit on the track.
+static constexpr uint64_t SIGNAL_SETTLE_TIME = 50000;
+
+// time (us) for the reset and idle packets sent back to back when the signal
+// is started (26 reset and 11 idle packets).
+static constexpr uint64_t SIGNAL_STARTUP_TIME = 400000;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static bool isPacket(const DCCTrackDecoder::Packet &packet, std::vector<uint8_t> bytes) {
+  // the decoded packets include the checksum byte
+  uint8_t checksum = 0;
+  for(auto byte : bytes) {
+    checksum ^= byte;
+  }
+  bytes.push_back(checksum);
+  return packet.bytes == bytes;
+}
+
+// number of packets for short address 3 and eStop packets seen on the track.
+static void countPackets(uint32_t &locoPackets, uint32_t &eStopPackets) {
+  locoPackets = 0;
+  eStopPackets = 0;
+  for(auto &packet : opsTrack->getPackets()) {
+    if(packet.bytes[0] == 3) {
+      locoPackets++;
+    } else if(isPacket(packet, {0x00, 0x41})) {
+      eStopPackets++;
+    }
+  }
+}
+
+void test_throttle_does_not_release_emergency_stop() {
+  HostProtocolClient client;
+  uint32_t locoPackets, eStopPackets;
+  host::powerOnOps();
+  client.command("<t 1 3 50 1>");
+  host::advance(100000);
+  TEST_ASSERT_EQUAL_STRING("<O>", client.command("<!>").c_str());
+  host::advance(SIGNAL_SETTLE_TIME);
+  opsTrack->clear();
+  // neither a new speed nor a stop from the throttle releases the eStop
+  TEST_ASSERT_EQUAL_STRING("<T 1 20 1>", client.command("<t 1 3 20 1>").c_str());
+  host::advance(100000);
+  TEST_ASSERT_EQUAL_STRING("<T 1 0 1>", client.command("<t 1 3 0 1>").c_str());
+  host::advance(100000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  countPackets(locoPackets, eStopPackets);
+  TEST_ASSERT_EQUAL(0, locoPackets);
+  TEST_ASSERT_GREATER_THAN(10, eStopPackets);
+  TEST_ASSERT_TRUE(dccSignal[DCC_SIGNAL_OPERATIONS]->isEmergencyStopActive());
+}
+
+void test_explicit_command_releases_emergency_stop() {
+  HostProtocolClient client;
+  uint32_t locoPackets, eStopPackets;
+  TEST_ASSERT_EQUAL_STRING("<O>", client.command("<! 0>").c_str());
+  TEST_ASSERT_FALSE(dccSignal[DCC_SIGNAL_OPERATIONS]->isEmergencyStopActive());
+  host::advance(SIGNAL_SETTLE_TIME);
+  opsTrack->clear();
+  client.command("<t 1 3 20 1>");
+  host::advance(100000);
+  countPackets(locoPackets, eStopPackets);
+  TEST_ASSERT_GREATER_THAN(0, locoPackets);
+  TEST_ASSERT_EQUAL(0, eStopPackets);
+}
+
+void test_power_cycle_releases_emergency_stop() {
+  HostProtocolClient client;
+  uint32_t locoPackets, eStopPackets;
+  client.command("<!>");
+  host::advance(SIGNAL_SETTLE_TIME);
+  TEST_ASSERT_TRUE(dccSignal[DCC_SIGNAL_OPERATIONS]->isEmergencyStopActive());
+  client.command("<0>");
+  client.command("<1>");
+  TEST_ASSERT_FALSE(dccSignal[DCC_SIGNAL_OPERATIONS]->isEmergencyStopActive());
+  host::advance(SIGNAL_STARTUP_TIME);
+  opsTrack->clear();
+  client.command("<t 1 3 20 1>");
+  host::advance(100000);
+  countPackets(locoPackets, eStopPackets);
+  TEST_ASSERT_GREATER_THAN(0, locoPackets);
+  TEST_ASSERT_EQUAL(0, eStopPackets);
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  opsTrack = new DCCTrackDecoder(DCC_SIGNAL_PIN_OPERATIONS);
+  UNITY_BEGIN();
+  RUN_TEST(test_throttle_does_not_release_emergency_stop);
+  RUN_TEST(test_explicit_command_releases_emergency_stop);
+  RUN_TEST(test_power_cycle_releases_emergency_stop);
+  return UNITY_END();
+}
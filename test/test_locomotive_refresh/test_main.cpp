@@ -0,0 +1,203 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <map>
+#include "HostCommandStation.h"
+
+// measures the spacing of the refresh packets of a single locomotive on the
+// track against the refresh interval of each tier.
+
+static DCCTrackDecoder *opsTrack;
+
+// simulated track time per test (us).
+static constexpr uint64_t REFRESH_TEST_DURATION = 20000000;
+
+enum REFRESH_TIER {
+  SPEED_PACKET,
+  F0_F12_PACKET,
+  F13_F28_PACKET,
+  OTHER_PACKET
+};
+
+// classifies a decoded packet (address 3) into its refresh tier and a key
+// identifying the packet type within the tier.
+static REFRESH_TIER classify(const DCCTrackDecoder::Packet &packet, uint8_t &type) {
+  if(packet.bytes.size() < 3 || packet.bytes[0] != 3) {
+    return OTHER_PACKET;
+  }
+  const uint8_t instruction = packet.bytes[1];
+  if(instruction == 0x3F) {
+    type = 0;
+    return SPEED_PACKET;
+  } else if((instruction & 0xE0) == 0x80) {
+    type = 1;
+    return F0_F12_PACKET;
+  } else if((instruction & 0xF0) == 0xB0) {
+    type = 2;
+    return F0_F12_PACKET;
+  } else if((instruction & 0xF0) == 0xA0) {
+    type = 3;
+    return F0_F12_PACKET;
+  } else if(instruction == 0xDE || instruction == 0xDF) {
+    type = instruction;
+    return F13_F28_PACKET;
+  }
+  return OTHER_PACKET;
+}
+
+struct Spacing {
+  uint32_t count{0};
+  uint64_t min{UINT64_MAX};
+  uint64_t total{0};
+};
+
+// returns the spacing (in ms) between consecutive packets of each type in a
+// tier, measured on the track.
+static Spacing measure(REFRESH_TIER tier) {
+  std::map<uint8_t, uint64_t> last;
+  Spacing spacing;
+  for(auto &packet : opsTrack->getPackets()) {
+    uint8_t type = 0;
+    if(classify(packet, type) != tier) {
+      continue;
+    }
+    if(last.count(type)) {
+      const uint64_t interval = (packet.time - last[type]) / 1000;
+      spacing.count++;
+      spacing.total += interval;
+      spacing.min = std::min(spacing.min, interval);
+    }
+    last[type] = packet.time;
+  }
+  return spacing;
+}
+
+static void runTrack() {
+  opsTrack->clear();
+  host::advance(REFRESH_TEST_DURATION);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+}
+
+static void assertSpacing(REFRESH_TIER tier, uint32_t interval) {
+  auto spacing = measure(tier);
+  TEST_ASSERT_GREATER_THAN(0, spacing.count);
+  // the interval is measured when the packet is pulled from the refresh
+  // source, it then waits for up to a packet time in the wire queue so the
+  // spacing on the track varies by about one packet time (< 10ms).
+  TEST_ASSERT_GREATER_OR_EQUAL(interval - 10, spacing.min);
+  TEST_ASSERT_UINT32_WITHIN(interval / 10 + 10, interval, spacing.total / spacing.count);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// momentum is applied by its own task so the speed ramps at the configured
+// rate even when no refresh packets are being pulled (track power off).
+void test_momentum_ramps_without_refresh() {
+  auto loco = LocomotiveManager::getLocomotive(5);
+  TEST_ASSERT_NOT_NULL(loco);
+  // one second from stopped to LOCOMOTIVE_MAX_SPEED
+  loco->setMomentum(10, 10);
+  loco->setSpeed(LOCOMOTIVE_MAX_SPEED);
+  host::advance(500000);
+  TEST_ASSERT_INT_WITHIN(LOCOMOTIVE_MAX_SPEED / 10, LOCOMOTIVE_MAX_SPEED / 2, loco->getSpeed());
+  host::advance(600000);
+  TEST_ASSERT_EQUAL(LOCOMOTIVE_MAX_SPEED, loco->getSpeed());
+  loco->setSpeed(0);
+  host::advance(1100000);
+  TEST_ASSERT_EQUAL(0, loco->getSpeed());
+  LocomotiveManager::removeLocomotive(5);
+}
+
+void test_moving_locomotive_refresh_tiers() {
+  HostProtocolClient client;
+  host::powerOnOps();
+  TEST_ASSERT_EQUAL_STRING("<T 1 50 1>", client.command("<t 1 3 50 1>").c_str());
+  // F0 and F13 on so all function groups are refreshed
+  client.command("<f 3 144>");
+  client.command("<f 3 222 1>");
+  host::advance(1000000);
+  runTrack();
+  assertSpacing(SPEED_PACKET, LOCOMOTIVE_SPEED_REFRESH_INTERVAL);
+  assertSpacing(F0_F12_PACKET, LOCOMOTIVE_FUNCTION_REFRESH_INTERVAL);
+  assertSpacing(F13_F28_PACKET, LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL);
+}
+
+void test_stopped_locomotive_refresh_tiers() {
+  HostProtocolClient client;
+  TEST_ASSERT_EQUAL_STRING("<T 1 0 1>", client.command("<t 1 3 0 1>").c_str());
+  host::advance(1000000);
+  runTrack();
+  assertSpacing(SPEED_PACKET, LOCOMOTIVE_STOPPED_REFRESH_INTERVAL);
+  assertSpacing(F0_F12_PACKET, LOCOMOTIVE_STOPPED_REFRESH_INTERVAL);
+  assertSpacing(F13_F28_PACKET, LOCOMOTIVE_EXTENDED_FUNCTION_REFRESH_INTERVAL);
+}
+
+static volatile bool batchSent = false;
+
+static void throttleBatchTask(void *arg) {
+  HostProtocolClient client;
+  client.command("<tb 1 10 20 1>");
+  batchSent = true;
+  vTaskDelete(NULL);
+}
+
+// queueing the packets of a consist may wait for room in the packet queue,
+// the manager lock must not be held meanwhile as the signal generator needs
+// it to pull refresh packets.
+void test_throttle_batch_does_not_hold_lock_while_queueing() {
+  HostProtocolClient client;
+  client.command("<C 10 11 12>");
+  TEST_ASSERT_NOT_NULL(LocomotiveManager::getConsistByID(10));
+  // with the signal stopped nothing drains the interactive queue
+  auto signal = dccSignal[DCC_SIGNAL_OPERATIONS];
+  signal->stopSignal();
+  Packet packet = encodedIdlePacket;
+  while(signal->getQueueStatus(DCC_PACKET_PRIORITY_INTERACTIVE).depth <
+        signal->getQueueStatus(DCC_PACKET_PRIORITY_INTERACTIVE).capacity) {
+    signal->loadPacket(packet, 0);
+  }
+  xTaskCreate(throttleBatchTask, "batch", 4096, nullptr, 1, nullptr);
+  host::advance(100000);
+  TEST_ASSERT_FALSE(batchSent);
+  TEST_ASSERT_TRUE(LocomotiveManager::getRefreshPacket(packet));
+  opsTrack->clear();
+  signal->startSignal(true);
+  TEST_ASSERT_TRUE(host::runUntil([]() { return batchSent; }, 1000000));
+  host::advance(1000000);
+  // the consist locomotives are moving forward
+  bool moving = false;
+  for(auto &sent : opsTrack->getPackets()) {
+    moving |= sent.bytes.size() == 4 && sent.bytes[0] == 11 && sent.bytes[1] == 0x3F && sent.bytes[2] > 0x81;
+  }
+  TEST_ASSERT_TRUE(moving);
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  opsTrack = new DCCTrackDecoder(DCC_SIGNAL_PIN_OPERATIONS);
+  UNITY_BEGIN();
+  RUN_TEST(test_momentum_ramps_without_refresh);
+  RUN_TEST(test_moving_locomotive_refresh_tiers);
+  RUN_TEST(test_stopped_locomotive_refresh_tiers);
+  RUN_TEST(test_throttle_batch_does_not_hold_lock_while_queueing);
+  return UNITY_END();
+}
@@ -0,0 +1,202 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "RailComDecoder.h"
+#include "DCCPacket.h"
+
+// replays cutouts built from known DCC packets and RailCom datagrams through
+// RailComDecoder, as they would be captured by RailComManager.
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// 4/8 encodes six data bits (or one of the RAILCOM_CODE values).
+static uint8_t encode(uint8_t value) {
+  for(uint16_t encoded = 0; encoded < 256; encoded++) {
+    if(RailComDecoder::decode(encoded) == value) {
+      return encoded;
+    }
+  }
+  TEST_FAIL_MESSAGE("value can not be encoded");
+  return 0;
+}
+
+// encodes a 12 bit datagram (four bit ID and eight data bits) as two bytes.
+static void encodeDatagram(uint8_t id, uint8_t value, std::vector<uint8_t> &bytes) {
+  bytes.push_back(encode((id << 2) | (value >> 6)));
+  bytes.push_back(encode(value & 0x3F));
+}
+
+static RailComCutout makeCutout(std::vector<uint8_t> payload, std::vector<uint8_t> channel1,
+  std::vector<uint8_t> channel2) {
+  RailComCutout cutout;
+  memset(&cutout, 0, sizeof(cutout));
+  Packet packet;
+  TEST_ASSERT_TRUE(encodeDCCPacket(packet, payload.data(), payload.size()));
+  memcpy(cutout.packet, packet.buffer + 2, sizeof(cutout.packet));
+  TEST_ASSERT_LESS_OR_EQUAL(RAILCOM_CHANNEL1_BYTES, channel1.size());
+  TEST_ASSERT_LESS_OR_EQUAL(RAILCOM_CHANNEL2_BYTES, channel2.size());
+  memcpy(cutout.channel1, channel1.data(), channel1.size());
+  cutout.channel1Size = channel1.size();
+  memcpy(cutout.channel2, channel2.data(), channel2.size());
+  cutout.channel2Size = channel2.size();
+  return cutout;
+}
+
+static uint16_t packetAddress(std::vector<uint8_t> payload) {
+  return RailComDecoder::getPacketAddress(makeCutout(payload, {}, {}).packet);
+}
+
+void test_decode_table_is_consistent() {
+  uint8_t dataValues = 0;
+  for(uint16_t encoded = 0; encoded < 256; encoded++) {
+    const uint8_t value = RailComDecoder::decode(encoded);
+    if(value <= 0x3F) {
+      dataValues++;
+      // every valid RailCom byte has four bits set
+      TEST_ASSERT_EQUAL(4, __builtin_popcount(encoded));
+    }
+  }
+  TEST_ASSERT_EQUAL(64, dataValues);
+  TEST_ASSERT_EQUAL(RAILCOM_CODE_ACK, RailComDecoder::decode(0xF0));
+  TEST_ASSERT_EQUAL(RAILCOM_CODE_ACK, RailComDecoder::decode(0x0F));
+}
+
+void test_packet_address_short_and_long() {
+  TEST_ASSERT_EQUAL(3, packetAddress({0x03, 0x3F, 0xB3}));
+  TEST_ASSERT_EQUAL(127, packetAddress({0x7F, 0x80}));
+  TEST_ASSERT_EQUAL(1000, packetAddress({0xC3, 0xE8, 0x3F, 0x80}));
+  TEST_ASSERT_EQUAL(10239, packetAddress({0xE7, 0xFF, 0x80}));
+  // broadcast, idle and accessory packets
+  TEST_ASSERT_EQUAL(0, packetAddress({0x00, 0x00}));
+  TEST_ASSERT_EQUAL(0, packetAddress({0xFF, 0x00}));
+  TEST_ASSERT_EQUAL(0, packetAddress({0x81, 0xF9}));
+}
+
+void test_short_address_pairs_across_cutouts() {
+  RailComDecoder decoder;
+  RailComFeedback feedback;
+  std::vector<uint8_t> high, low;
+  encodeDatagram(RAILCOM_DATAGRAM_ADR_HIGH, 0, high);
+  encodeDatagram(RAILCOM_DATAGRAM_ADR_LOW, 3, low);
+  decoder.process(makeCutout({0xFF, 0x00}, high, {}), feedback);
+  TEST_ASSERT_EQUAL(0, feedback.detectedAddress);
+  TEST_ASSERT_EQUAL(0, feedback.invalid);
+  decoder.process(makeCutout({0xFF, 0x00}, low, {}), feedback);
+  TEST_ASSERT_EQUAL(3, feedback.detectedAddress);
+  // either half refreshes the address once both have been received
+  decoder.process(makeCutout({0xFF, 0x00}, high, {}), feedback);
+  TEST_ASSERT_EQUAL(3, feedback.detectedAddress);
+}
+
+void test_long_address_pairs_across_cutouts() {
+  RailComDecoder decoder;
+  RailComFeedback feedback;
+  std::vector<uint8_t> high, low;
+  encodeDatagram(RAILCOM_DATAGRAM_ADR_HIGH, 0x80 | (1000 >> 8), high);
+  encodeDatagram(RAILCOM_DATAGRAM_ADR_LOW, 1000 & 0xFF, low);
+  // the low half arriving first is held until the high half is received
+  decoder.process(makeCutout({0x03, 0x3F, 0xB3}, low, {}), feedback);
+  TEST_ASSERT_EQUAL(0, feedback.detectedAddress);
+  TEST_ASSERT_EQUAL(3, feedback.packetAddress);
+  decoder.process(makeCutout({0x03, 0x3F, 0xB3}, high, {}), feedback);
+  TEST_ASSERT_EQUAL(1000, feedback.detectedAddress);
+  // after a reset both halves are needed again
+  decoder.reset();
+  decoder.process(makeCutout({0x03, 0x3F, 0xB3}, high, {}), feedback);
+  TEST_ASSERT_EQUAL(0, feedback.detectedAddress);
+}
+
+void test_pom_datagram_in_channel2() {
+  RailComDecoder decoder;
+  RailComFeedback feedback;
+  std::vector<uint8_t> channel2;
+  encodeDatagram(RAILCOM_DATAGRAM_POM, 0xA5, channel2);
+  decoder.process(makeCutout({0xC3, 0xE8, 0xE4, 0x00, 0x00}, {}, channel2), feedback);
+  TEST_ASSERT_EQUAL(1000, feedback.packetAddress);
+  TEST_ASSERT_TRUE(feedback.pomValid);
+  TEST_ASSERT_EQUAL(0xA5, feedback.pomValue);
+  TEST_ASSERT_EQUAL(0, feedback.invalid);
+}
+
+void test_ack_nack_and_busy_in_channel2() {
+  RailComDecoder decoder;
+  RailComFeedback feedback;
+  std::vector<uint8_t> channel2 = {
+    encode(RAILCOM_CODE_ACK), 0x0F, encode(RAILCOM_CODE_NACK), encode(RAILCOM_CODE_BUSY)
+  };
+  // a POM datagram following the status bytes is still decoded
+  encodeDatagram(RAILCOM_DATAGRAM_POM, 0x12, channel2);
+  decoder.process(makeCutout({0x03, 0xEC, 0x00, 0x00}, {}, channel2), feedback);
+  TEST_ASSERT_EQUAL(2, feedback.acks);
+  TEST_ASSERT_EQUAL(1, feedback.nacks);
+  TEST_ASSERT_EQUAL(1, feedback.busy);
+  TEST_ASSERT_TRUE(feedback.pomValid);
+  TEST_ASSERT_EQUAL(0x12, feedback.pomValue);
+  TEST_ASSERT_EQUAL(0, feedback.invalid);
+}
+
+void test_truncated_datagrams() {
+  RailComDecoder decoder;
+  RailComFeedback feedback;
+  std::vector<uint8_t> address;
+  encodeDatagram(RAILCOM_DATAGRAM_ADR_LOW, 3, address);
+  // only the first byte of the channel 1 datagram was received
+  decoder.process(makeCutout({0x03, 0x3F, 0xB3}, {address[0]}, {}), feedback);
+  TEST_ASSERT_EQUAL(1, feedback.invalid);
+  TEST_ASSERT_EQUAL(0, feedback.detectedAddress);
+
+  // POM datagram cut short in channel 2
+  std::vector<uint8_t> pom;
+  encodeDatagram(RAILCOM_DATAGRAM_POM, 0x42, pom);
+  decoder.process(makeCutout({0x03, 0xEC, 0x00, 0x00}, {}, {pom[0]}), feedback);
+  TEST_ASSERT_FALSE(feedback.pomValid);
+  TEST_ASSERT_EQUAL(1, feedback.invalid);
+
+  // a complete POM datagram followed by the first two bytes of a three byte
+  // EXT datagram
+  std::vector<uint8_t> channel2 = pom;
+  channel2.push_back(encode(RAILCOM_DATAGRAM_EXT << 2));
+  channel2.push_back(encode(0));
+  decoder.process(makeCutout({0x03, 0xEC, 0x00, 0x00}, {}, channel2), feedback);
+  TEST_ASSERT_TRUE(feedback.pomValid);
+  TEST_ASSERT_EQUAL(0x42, feedback.pomValue);
+  TEST_ASSERT_EQUAL(1, feedback.invalid);
+
+  // a byte with the wrong number of bits set in the middle of a datagram
+  decoder.process(makeCutout({0x03, 0xEC, 0x00, 0x00}, {}, {pom[0], 0x00}), feedback);
+  TEST_ASSERT_FALSE(feedback.pomValid);
+  TEST_ASSERT_EQUAL(1, feedback.invalid);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_decode_table_is_consistent);
+  RUN_TEST(test_packet_address_short_and_long);
+  RUN_TEST(test_short_address_pairs_across_cutouts);
+  RUN_TEST(test_long_address_pairs_across_cutouts);
+  RUN_TEST(test_pom_datagram_in_channel2);
+  RUN_TEST(test_ack_nack_and_busy_in_channel2);
+  RUN_TEST(test_truncated_datagrams);
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "RingBuffer.h"
+
+// the producer and consumer run on separate host threads (not the virtual
+// time scheduler) so these tests exercise the real memory ordering of the
+// ring indexes. The spin loops yield so the tests also complete in a
+// reasonable time on a single core host.
+static constexpr uint32_t STRESS_ENTRIES = 200000;
+
+struct StressEntry {
+  uint32_t sequence;
+  uint32_t check;
+};
+
+struct CountingAllocator {
+  static void *allocate(size_t count, size_t size) {
+    allocated++;
+    return calloc(count, size);
+  }
+  static void release(void *ptr) {
+    released++;
+    free(ptr);
+  }
+  static uint32_t allocated;
+  static uint32_t released;
+};
+uint32_t CountingAllocator::allocated = 0;
+uint32_t CountingAllocator::released = 0;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_capacity_is_rounded_up_to_power_of_two() {
+  SPSCRingBuffer<uint32_t> ring(5);
+  TEST_ASSERT_EQUAL(8, ring.capacity());
+  for(uint32_t index = 0; index < 8; index++) {
+    auto entry = ring.reserve();
+    TEST_ASSERT_NOT_NULL(entry);
+    *entry = index;
+    ring.commit();
+  }
+  TEST_ASSERT_NULL(ring.reserve());
+  TEST_ASSERT_EQUAL(8, ring.size());
+  for(uint32_t index = 0; index < 8; index++) {
+    TEST_ASSERT_EQUAL(index, *ring.peek());
+    ring.pop();
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_NULL(ring.peek());
+}
+
+void test_allocator_is_used_for_entries() {
+  {
+    SPSCRingBuffer<uint32_t, CountingAllocator> ring(16);
+    TEST_ASSERT_EQUAL(1, CountingAllocator::allocated);
+    TEST_ASSERT_EQUAL(0, CountingAllocator::released);
+  }
+  TEST_ASSERT_EQUAL(1, CountingAllocator::released);
+}
+
+// rings created with new must be allocated via the allocator and keep the
+// cache line alignment of the indexes.
+void test_new_aligns_instance() {
+  CountingAllocator::allocated = 0;
+  CountingAllocator::released = 0;
+  std::vector<SPSCRingBuffer<uint32_t, CountingAllocator> *> rings;
+  for(uint32_t index = 0; index < 8; index++) {
+    auto ring = new SPSCRingBuffer<uint32_t, CountingAllocator>(16);
+    TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(ring) % RING_BUFFER_CACHE_LINE_SIZE);
+    *ring->reserve() = index;
+    ring->commit();
+    rings.push_back(ring);
+  }
+  TEST_ASSERT_EQUAL(16, CountingAllocator::allocated);
+  for(uint32_t index = 0; index < 8; index++) {
+    TEST_ASSERT_EQUAL(index, *rings[index]->peek());
+    delete rings[index];
+  }
+  TEST_ASSERT_EQUAL(16, CountingAllocator::released);
+}
+
+void test_drain_discards_committed_entries() {
+  SPSCRingBuffer<uint32_t> ring(8);
+  for(uint32_t index = 0; index < 4; index++) {
+    *ring.reserve() = index;
+    ring.commit();
+  }
+  // the consumer is holding the first entry
+  TEST_ASSERT_EQUAL(0, *ring.peek());
+  ring.requestDrain();
+  *ring.reserve() = 99;
+  ring.commit();
+  TEST_ASSERT_EQUAL(99, *ring.peek());
+  ring.pop();
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+// every entry must be received exactly once, in order and fully written.
+void test_producer_consumer_stress() {
+  SPSCRingBuffer<StressEntry> ring(4);
+  std::atomic<bool> failed{false};
+  std::thread consumer([&] {
+    uint32_t expected = 0;
+    while(expected < STRESS_ENTRIES && !failed) {
+      auto entry = ring.peek();
+      if(entry == nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      if(entry->sequence != expected || entry->check != ~expected) {
+        failed = true;
+      }
+      ring.pop();
+      expected++;
+    }
+  });
+  for(uint32_t sequence = 0; sequence < STRESS_ENTRIES && !failed; sequence++) {
+    StressEntry *entry;
+    while((entry = ring.reserve()) == nullptr) {
+      std::this_thread::yield();
+    }
+    entry->sequence = sequence;
+    entry->check = ~sequence;
+    ring.commit();
+  }
+  consumer.join();
+  TEST_ASSERT_FALSE(failed);
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+// with drains requested while the consumer is running entries may be
+// skipped but must never be repeated, reordered or torn.
+void test_drain_while_consuming_stress() {
+  SPSCRingBuffer<StressEntry> ring(8);
+  std::atomic<bool> done{false};
+  std::atomic<bool> failed{false};
+  std::atomic<uint32_t> received{0};
+  std::thread consumer([&] {
+    int64_t last = -1;
+    while(!failed) {
+      auto entry = ring.peek();
+      if(entry == nullptr) {
+        if(done) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      if((int64_t)entry->sequence <= last || entry->check != ~entry->sequence) {
+        failed = true;
+      }
+      last = entry->sequence;
+      ring.pop();
+      received++;
+    }
+  });
+  for(uint32_t sequence = 0; sequence < STRESS_ENTRIES && !failed; sequence++) {
+    StressEntry *entry;
+    while((entry = ring.reserve()) == nullptr) {
+      std::this_thread::yield();
+    }
+    entry->sequence = sequence;
+    entry->check = ~sequence;
+    ring.commit();
+    if(sequence % 1000 == 999) {
+      ring.requestDrain();
+    }
+  }
+  done = true;
+  consumer.join();
+  TEST_ASSERT_FALSE(failed);
+  TEST_ASSERT_GREATER_THAN(0, received.load());
+  TEST_ASSERT_LESS_OR_EQUAL(STRESS_ENTRIES, received.load());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_capacity_is_rounded_up_to_power_of_two);
+  RUN_TEST(test_allocator_is_used_for_entries);
+  RUN_TEST(test_new_aligns_instance);
+  RUN_TEST(test_drain_discards_committed_entries);
+  RUN_TEST(test_producer_consumer_stress);
+  RUN_TEST(test_drain_while_consuming_stress);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include "HostCommandStation.h"
+#include <soc/rmt_struct.h>
+
+// pulse widths generated by the RMT signal generator, this test is only built
+// by the native_rmt environment (DCC_SIGNAL_GENERATOR_RMT=true).
+
+static DCCTrackDecoder *opsTrack;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static bool isPacket(const DCCTrackDecoder::Packet &packet, std::vector<uint8_t> bytes) {
+  // the decoded packets include the checksum byte
+  uint8_t checksum = 0;
+  for(auto byte : bytes) {
+    checksum ^= byte;
+  }
+  bytes.push_back(checksum);
+  return packet.bytes == bytes;
+}
+
+void test_channel_memory_holds_only_dcc_bits() {
+  host::powerOnOps();
+  host::advance(100000);
+  auto generator = reinterpret_cast<SignalGenerator_RMT *>(dccSignal[DCC_SIGNAL_OPERATIONS]);
+  for(uint8_t block = 0; block < DCC_RMT_MEMORY_BLOCKS; block++) {
+    for(uint8_t index = 0; index < 64; index++) {
+      auto &item = RMTMEM.chan[generator->_channel + block].data32[index];
+      TEST_ASSERT_TRUE(item.val == DCC_RMT_ONE_BIT || item.val == DCC_RMT_ZERO_BIT);
+      // both halves of the bit have the same duration, HIGH then LOW
+      TEST_ASSERT_EQUAL(item.duration0, item.duration1);
+      TEST_ASSERT_EQUAL(1, item.level0);
+      TEST_ASSERT_EQUAL(0, item.level1);
+    }
+  }
+}
+
+void test_pulse_widths_match_bit_durations() {
+  opsTrack->clear();
+  host::advance(200000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  TEST_ASSERT_GREATER_THAN(20, opsTrack->getPackets().size());
+  TEST_ASSERT_EQUAL(DCC_ONE_BIT_PULSE_DURATION, opsTrack->getMinOneHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ONE_BIT_PULSE_DURATION, opsTrack->getMaxOneHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ZERO_BIT_PULSE_DURATION, opsTrack->getMinZeroHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ZERO_BIT_PULSE_DURATION, opsTrack->getMaxZeroHalfBit());
+}
+
+void test_isr_refills_half_of_the_channel_memory() {
+  auto before = dccSignal[DCC_SIGNAL_OPERATIONS]->getTelemetry();
+  host::advance(500000);
+  auto after = dccSignal[DCC_SIGNAL_OPERATIONS]->getTelemetry();
+  const uint32_t calls = after.isrCalls - before.isrCalls;
+  const uint64_t bits = after.bits - before.bits;
+  TEST_ASSERT_GREATER_THAN(0, calls);
+  // one ISR call for every DCC_RMT_ITEMS_PER_HALF bits, the bit counters are
+  // only updated at packet boundaries so allow one packet of slack.
+  TEST_ASSERT_UINT32_WITHIN(2, bits / DCC_RMT_ITEMS_PER_HALF, calls);
+}
+
+void test_packets_spanning_refills_are_intact() {
+  HostProtocolClient client;
+  opsTrack->clear();
+  // packets of differing lengths so packet boundaries fall at varying
+  // positions within the refilled half
+  TEST_ASSERT_EQUAL_STRING("<T 1 50 1>", client.command("<t 1 3 50 1>").c_str());
+  TEST_ASSERT_EQUAL_STRING("<T 2 20 0>", client.command("<t 2 1000 20 0>").c_str());
+  client.command("<f 3 144>");
+  client.command("<f 1000 222 1>");
+  host::advance(500000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  bool foundShort = false, foundLong = false, foundFunction = false, foundExpansion = false;
+  for(auto &packet : opsTrack->getPackets()) {
+    foundShort |= isPacket(packet, {0x03, 0x3F, 0x80 | 51});
+    foundLong |= isPacket(packet, {0xC3, 0xE8, 0x3F, 21});
+    foundFunction |= isPacket(packet, {0x03, 144});
+    foundExpansion |= isPacket(packet, {0xC3, 0xE8, 222, 1});
+  }
+  TEST_ASSERT_TRUE(foundShort);
+  TEST_ASSERT_TRUE(foundLong);
+  TEST_ASSERT_TRUE(foundFunction);
+  TEST_ASSERT_TRUE(foundExpansion);
+}
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  opsTrack = new DCCTrackDecoder(DCC_SIGNAL_PIN_OPERATIONS);
+  UNITY_BEGIN();
+  RUN_TEST(test_channel_memory_holds_only_dcc_bits);
+  RUN_TEST(test_pulse_widths_match_bit_durations);
+  RUN_TEST(test_isr_refills_half_of_the_channel_memory);
+  RUN_TEST(test_packets_spanning_refills_are_intact);
+  return UNITY_END();
+}
@@ -0,0 +1,305 @@
+/**********************************************************************
+DCC COMMAND STATION FOR ESP32
+
+COPYRIGHT (c) 2019 Mike Dunston
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses
+**********************************************************************/
+
+#include <unity.h>
+#include <chrono>
+#include "HostCommandStation.h"
+
+static DCCTrackDecoder *opsTrack;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static bool isPacket(const DCCTrackDecoder::Packet &packet, std::vector<uint8_t> bytes) {
+  // the decoded packets include the checksum byte
+  uint8_t checksum = 0;
+  for(auto byte : bytes) {
+    checksum ^= byte;
+  }
+  bytes.push_back(checksum);
+  return packet.bytes == bytes;
+}
+
+void test_power_on_starts_signal_with_reset_packet() {
+  host::powerOnOps();
+  host::advance(200000);
+  auto &packets = opsTrack->getPackets();
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  TEST_ASSERT_GREATER_THAN(20, packets.size());
+  TEST_ASSERT_TRUE(isPacket(packets[0], {0x00, 0x00}));
+}
+
+// S-9.2.4 section A requires at least 20 reset packets followed by at least
+// 10 idle packets when the signal is started.
+void test_power_on_sends_reset_then_idle_packets() {
+  host::advance(400000);
+  auto &packets = opsTrack->getPackets();
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  size_t index = 0;
+  while(index < packets.size() && isPacket(packets[index], {0x00, 0x00})) {
+    index++;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(20, index);
+  const size_t resetPackets = index;
+  while(index < packets.size() && isPacket(packets[index], {0xFF, 0x00})) {
+    index++;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(10, index - resetPackets);
+}
+
+void test_bit_timing_is_within_nmra_limits() {
+  TEST_ASSERT_EQUAL(DCC_ONE_BIT_PULSE_DURATION, opsTrack->getMinOneHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ONE_BIT_PULSE_DURATION, opsTrack->getMaxOneHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ZERO_BIT_PULSE_DURATION, opsTrack->getMinZeroHalfBit());
+  TEST_ASSERT_EQUAL(DCC_ZERO_BIT_PULSE_DURATION, opsTrack->getMaxZeroHalfBit());
+}
+
+void test_throttle_command_is_sent_on_the_track() {
+  HostProtocolClient client;
+  opsTrack->clear();
+  TEST_ASSERT_EQUAL_STRING("<T 1 50 1>", client.command("<t 1 3 50 1>").c_str());
+  host::advance(100000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  bool found = false;
+  for(auto &packet : opsTrack->getPackets()) {
+    // 128 speed step instruction, forward, speed step 50 is sent as 51 as
+    // speed step 1 is emergency stop.
+    found |= isPacket(packet, {0x03, 0x3F, 0x80 | 51});
+  }
+  TEST_ASSERT_TRUE(found);
+}
+
+// the repeats of a CV access packet on the OPS track are interleaved with the
+// packets for other decoders, the decoder still receives every copy without
+// any other packet addressed to it in between.
+void test_pom_packet_repeats_are_interleaved() {
+  HostProtocolClient client;
+  client.command("<t 2 4 20 1>");
+  host::advance(50000);
+  opsTrack->clear();
+  client.command("<t 2 4 30 1>");
+  client.command("<w 3 1 5>");
+  client.command("<f 4 144>");
+  host::advance(200000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  const std::vector<uint8_t> writeCV = {0x03, 0xEC, 0x00, 0x05};
+  auto &packets = opsTrack->getPackets();
+  size_t first = 0;
+  while(first < packets.size() && !isPacket(packets[first], writeCV)) {
+    first++;
+  }
+  TEST_ASSERT_LESS_THAN(packets.size(), first);
+  size_t count = 0;
+  size_t last = first;
+  for(size_t index = first; index < packets.size(); index++) {
+    if(isPacket(packets[index], writeCV)) {
+      count++;
+      last = index;
+    } else if(count < 5) {
+      TEST_ASSERT_TRUE(packets[index].bytes[0] != 0x03);
+    }
+  }
+  TEST_ASSERT_EQUAL(5, count);
+  // the packets for locomotive 4 were sent between the copies
+  TEST_ASSERT_GREATER_THAN(first + 4, last);
+}
+
+// returns the decoder address of a decoded packet using the same layout as
+// getDCCPacketAddressKey, broadcast and idle packets return zero.
+static uint16_t getAddressKey(const DCCTrackDecoder::Packet &packet) {
+  const uint8_t first = packet.bytes[0];
+  if(first == 0x00 || first == 0xFF) {
+    return 0;
+  } else if(first < 0x80) {
+    return first;
+  } else if(first < 0xC0) {
+    return (first << 8) | (packet.bytes[1] & 0x70);
+  }
+  return (first << 8) | packet.bytes[1];
+}
+
+// a throttle command queued behind a burst of repeated CV access and
+// accessory packets only waits for the packets queued ahead of it instead of
+// every repeat of them, and while packets for several decoders are queued no
+// decoder receives two packets in a row (S-9.2.4 packet spacing).
+void test_repeats_are_interleaved_with_other_traffic() {
+  static constexpr uint8_t CV_PACKETS = 4;
+  static constexpr uint8_t CV_REPEATS = 4;
+  static constexpr uint8_t ACCESSORY_PACKETS = 4;
+  HostProtocolClient client;
+  host::advance(50000);
+  opsTrack->clear();
+  char command[32];
+  for(uint8_t index = 0; index < ACCESSORY_PACKETS; index++) {
+    snprintf(command, sizeof(command), "<a %d 0 1>", 20 + index);
+    client.command(command);
+  }
+  for(uint8_t index = 0; index < CV_PACKETS; index++) {
+    snprintf(command, sizeof(command), "<w %d 1 5>", 10 + index);
+    client.command(command);
+  }
+  const uint64_t throttleQueuedAt = host::now();
+  client.command("<t 1 3 60 1>");
+  host::advance(1000000);
+  TEST_ASSERT_EQUAL(0, opsTrack->getErrors());
+  auto &packets = opsTrack->getPackets();
+
+  // the throttle packet waits for no more than two copies of each CV access
+  // packet (the first copy and a repeat queued before the throttle packet),
+  // sending the repeats back to back would put all of their copies ahead of
+  // it.
+  size_t throttle = 0;
+  size_t cvAhead = 0;
+  for(; throttle < packets.size(); throttle++) {
+    if(isPacket(packets[throttle], {0x03, 0x3F, 0x80 | 61})) {
+      break;
+    } else if(packets[throttle].bytes.size() == 5 && packets[throttle].bytes[1] == 0xEC) {
+      cvAhead++;
+    }
+  }
+  TEST_ASSERT_LESS_THAN(packets.size(), throttle);
+  TEST_ASSERT_LESS_OR_EQUAL(CV_PACKETS * 2, cvAhead);
+  // the shortest packet on the track is an idle packet, every packet sent
+  // ahead of the throttle packet takes at least that long.
+  uint64_t minPacketTime = UINT64_MAX;
+  for(size_t index = 1; index < packets.size(); index++) {
+    minPacketTime = std::min(minPacketTime, packets[index].time - packets[index - 1].time);
+  }
+  const uint64_t latency = packets[throttle].time - throttleQueuedAt;
+  TEST_ASSERT_LESS_THAN(CV_PACKETS * (CV_REPEATS + 1) * minPacketTime, latency);
+  char message[64];
+  snprintf(message, sizeof(message), "throttle packet latency %.1fms", latency / 1000.0);
+  TEST_MESSAGE(message);
+
+  // every CV access and accessory copy reached the track, and until the last
+  // of them no two consecutive packets were sent to the same decoder.
+  size_t cvCopies = 0;
+  size_t accessoryCopies = 0;
+  size_t lastQueued = 0;
+  for(size_t index = 0; index < packets.size(); index++) {
+    auto &packet = packets[index];
+    if(packet.bytes.size() == 5 && packet.bytes[1] == 0xEC) {
+      cvCopies++;
+      lastQueued = index;
+    } else if(packet.bytes.size() == 3 && (packet.bytes[0] & 0xC0) == 0x80) {
+      accessoryCopies++;
+      lastQueued = index;
+    }
+  }
+  TEST_ASSERT_EQUAL(CV_PACKETS * (CV_REPEATS + 1), cvCopies);
+  TEST_ASSERT_EQUAL(ACCESSORY_PACKETS * 2, accessoryCopies);
+  for(size_t index = 1; index <= lastQueued; index++) {
+    const uint16_t address = getAddressKey(packets[index]);
+    if(address != 0) {
+      TEST_ASSERT_TRUE(getAddressKey(packets[index - 1]) != address);
+    }
+  }
+}
+
+// reports the ISR cost per call as measured by the signal generator telemetry,
+// on the host the cycle counter runs at 1GHz (nanoseconds).
+void test_isr_cycles() {
+  auto before = dccSignal[DCC_SIGNAL_OPERATIONS]->getTelemetry();
+  host::advance(1000000);
+  auto after = dccSignal[DCC_SIGNAL_OPERATIONS]->getTelemetry();
+  const uint32_t calls = after.isrCalls - before.isrCalls;
+  TEST_ASSERT_GREATER_THAN(0, calls);
+  char message[128];
+  snprintf(message, sizeof(message), "%u ISR calls, average %.1f cycles, max %u cycles", calls,
+    (double)(after.isrCycles - before.isrCycles) / calls, after.isrMaxCycles);
+  TEST_MESSAGE(message);
+}
+
+#if !DCC_SIGNAL_GENERATOR_RMT
+// number of bits fetched by each round of test_isr_bit_fetch_against_legacy_isr.
+static constexpr uint32_t FETCH_BITS = 1000000;
+
+// fetches the half-bit durations the way the timer ISR did before they were
+// pre-rendered, getPacket() was called for every bit and the bit was looked up
+// with a divide/modulo. Returns the host time (ns) taken.
+static uint64_t legacyBitFetch(SignalGenerator_HardwareTimer *generator, volatile uint32_t &sink) {
+  const auto start = std::chrono::steady_clock::now();
+  for(uint32_t bit = 0; bit < FETCH_BITS; bit++) {
+    auto pkt = generator->getPacket();
+    if(pkt->buffer[pkt->currentBit / 8] & DCC_PACKET_BIT_MASK[pkt->currentBit % 8]) {
+      sink = DCC_ONE_BIT_PULSE_DURATION;
+    } else {
+      sink = DCC_ZERO_BIT_PULSE_DURATION;
+    }
+    pkt->currentBit++;
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// fetches the half-bit durations the way DCC_SIGNAL_ISR_IMPL does, getPacket()
+// is only called once the current packet has been sent.
+static uint64_t bitFetch(SignalGenerator_HardwareTimer *generator, volatile uint32_t &sink) {
+  const auto start = std::chrono::steady_clock::now();
+  for(uint32_t bit = 0; bit < FETCH_BITS; bit++) {
+    auto pkt = generator->_packet;
+    if(pkt == nullptr || pkt->currentBit >= pkt->numberOfBits) {
+      pkt = generator->getPacket();
+      generator->_packet = pkt;
+    }
+    sink = pkt->halfBitDurations[pkt->currentBit++];
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// compares the per-bit work of the ISR against the ISR before the half-bit
+// durations were pre-rendered, using the idle packets of the (stopped) PROG
+// signal generator. The pin and timer register writes are not compared as
+// on the host they are stand-ins for the hardware registers. The best of
+// several rounds is used to filter out host scheduling noise.
+void test_isr_bit_fetch_against_legacy_isr() {
+  auto generator = reinterpret_cast<SignalGenerator_HardwareTimer *>(dccSignal[DCC_SIGNAL_PROGRAMMING]);
+  TEST_ASSERT_FALSE(generator->isEnabled());
+  volatile uint32_t sink = 0;
+  uint64_t legacy = UINT64_MAX;
+  uint64_t current = UINT64_MAX;
+  for(uint8_t round = 0; round < 5; round++) {
+    legacy = std::min(legacy, legacyBitFetch(generator, sink));
+    current = std::min(current, bitFetch(generator, sink));
+  }
+  generator->_packet = nullptr;
+  char message[128];
+  snprintf(message, sizeof(message), "legacy %.2fns per bit, pre-rendered %.2fns per bit",
+    (double)legacy / FETCH_BITS, (double)current / FETCH_BITS);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(current < legacy);
+}
+#endif
+
+int main(int argc, char **argv) {
+  host::startCommandStation();
+  opsTrack = new DCCTrackDecoder(DCC_SIGNAL_PIN_OPERATIONS);
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on_starts_signal_with_reset_packet);
+  RUN_TEST(test_power_on_sends_reset_then_idle_packets);
+  RUN_TEST(test_bit_timing_is_within_nmra_limits);
+  RUN_TEST(test_throttle_command_is_sent_on_the_track);
+  RUN_TEST(test_pom_packet_repeats_are_interleaved);
+  RUN_TEST(test_repeats_are_interleaved_with_other_traffic);
+  RUN_TEST(test_isr_cycles);
+#if !DCC_SIGNAL_GENERATOR_RMT
+  RUN_TEST(test_isr_bit_fetch_against_legacy_isr);
+#endif
+  return UNITY_END();
+}